@@ -0,0 +1,118 @@
+/*
+    libstario.so
+    ------------
+    Library providing USB, serial, and parallel communications support for
+    Star Micronics devices.
+
+    Copyright (C) 2004 Star Micronics Co., Ltd.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+    The interface between the library and its port backends is declared
+    here.  Include this header file in the source of a backend plugin; an
+    application using only the functions of stario.h does not need it.
+*/
+
+#ifndef _included_stario_backend
+#define _included_stario_backend
+
+#include "stario-error.h"
+#include "stario-structures.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// PortImpl - structure
+// --------
+//
+// Functions implementing one kind of port.  Port functions receive the
+// backend's own port structure, as returned by openPort, so that no
+// per-call portName lookup is required.  Functions a backend does not
+// support are left 0, and the corresponding api call then fails with
+// STARIO_ERROR_NOT_AVAILABLE.
+//
+// The library serialises calls on one port; calls on different ports of
+// the same backend may run in parallel.
+typedef struct
+{
+    long (* matchPortName)          (char const * portName);
+    long (* openPort)               (char const * portName, char const * portSettings, void ** port);
+
+    // printer api
+    long (* writePort)              (void * port, char const * writeBuffer, long length);
+    long (* flushPort)              (void * port);
+    long (* readPort)               (void * port, char * readBuffer, long length);
+    long (* getStarPrinterStatus)   (void * port, StarPrinterStatus * status);
+    long (* beginCheckedBlock)      (void * port);
+    long (* endCheckedBlock)        (void * port, StarPrinterStatus * status);
+    long (* hdwrResetDevice)        (void * port);
+
+    // visual card api
+    long (* doVisualCardCmd)        (void * port, VisualCardCmd * request, long timeoutMillis);
+
+    long (* closePort)              (void * port);
+    void (* releaseImpl)            ();
+} PortImpl;
+
+// PortImplFactory - function type
+// ---------------
+//
+// Builds a backend's PortImpl.  Called once, when a port name routed to the
+// backend is first used, so a process initialises only the backends it uses.
+typedef PortImpl (* PortImplFactory) (void);
+
+/*
+    registerPortImpl
+    ----------------
+    This function routes port names beginning with prefix to a backend.  A
+    port name is handled by the backend with the longest matching prefix,
+    whose matchPortName function may still decline it.
+
+    Parameters: prefix - leading characters of the backend's port names, i.e. "tcp:" (1 ~ 31 characters)
+                factory - function building the backend's PortImpl on first use
+    Returns:    STARIO_ERROR_SUCCESS
+                    or
+    Errors:     STARIO_ERROR_NOT_AVAILABLE - prefix invalid or already registered, or registry full
+    Notes:      The built in usb ("usb:"), parallel ("/dev/parport"), serial
+                ("/dev/ttyS"), network ("tcp:") and simulator ("sim:")
+                backends are registered by the library itself.
+*/
+long registerPortImpl (char const * prefix, PortImplFactory factory);
+
+/*
+    Backend plugins
+    ---------------
+    When no registered prefix matches a port name of the form
+    "scheme:...", the library loads the plugin libstario-scheme.so from the
+    directories listed in the STARIO_PLUGIN_PATH environment variable
+    (colon separated), or from STARIO_PLUGIN_DIR if it is not set, and calls
+    its STARIO_PLUGIN_INIT function.  That function registers the plugin's
+    backends with registerPortImpl and returns STARIO_ERROR_SUCCESS.  Each
+    scheme is looked for once per process; plugins stay loaded until the
+    library is unloaded.
+*/
+#define STARIO_PLUGIN_DIR       "/usr/lib/stario"
+#define STARIO_PLUGIN_INIT      "starioPluginInit"
+
+typedef long (* StarIOPluginInit) (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,834 @@
+/*
+    libstario.so
+    ------------
+    Library providing USB, serial, and parallel communications support for
+    Star Micronics devices.
+
+    Copyright (C) 2004 Star Micronics Co., Ltd.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <errno.h>
+#include <memory.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+
+#include "stario-error.h"
+#include "stario-checkedblock.h"
+#include "stario-statuswatch.h"
+
+// intervals between status reads while waiting on the ETB counter
+// polling starts at CB_MIN_POLL_MILLIS and doubles up to CB_MAX_POLL_MILLIS;
+// a print time estimate may replace the first interval, up to CB_MAX_SEED_MILLIS
+#define CB_MIN_POLL_MILLIS      10
+#define CB_MAX_POLL_MILLIS      200
+#define CB_MAX_SEED_MILLIS      1000
+
+// a full pipeline gives up on the oldest block after CB_STALL_FACTOR times the
+// recent print time per block without a completion, and never before CB_MIN_STALL_MILLIS
+#define CB_STALL_FACTOR         4
+#define CB_MIN_STALL_MILLIS     10000
+
+// supervisor - handles registered for asynchronous completion or status watching
+// lock order: a handle's lock may be held when taking cbSupervisorLock, never the reverse
+static pthread_mutex_t cbSupervisorLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cbSupervisorWake;             // signalled on submit, on registration and on stop
+static pthread_cond_t cbSupervisorVisited = PTHREAD_COND_INITIALIZER;   // broadcast as each visit ends
+static StarIOHandle * cbSupervisedHandles[MAX_NUM_HANDLES];
+static StarIOHandle * cbSupervisorVisiting = NULL;  // handle being polled, or whose callbacks are running
+static unsigned char cbSupervisorRunning = 0;
+static unsigned char cbSupervisorStop = 0;
+static pthread_t cbSupervisor;
+
+static void cbSleep(long millis)
+{
+    struct timeval sleepTime = {millis / 1000, (millis % 1000) * 1000};
+
+    select(0, NULL, NULL, NULL, &sleepTime);
+}
+
+// interval before poll number attempt (0 based) of an ETB wait, without an estimate
+static long cbBackoffMillis(long attempt)
+{
+    long pollMillis = CB_MIN_POLL_MILLIS;
+
+    for (; (attempt > 0) && (pollMillis < CB_MAX_POLL_MILLIS); attempt--)
+    {
+        pollMillis *= 2;
+    }
+
+    return (pollMillis < CB_MAX_POLL_MILLIS)?pollMillis:CB_MAX_POLL_MILLIS;
+}
+
+void cbTimingBegin (CheckedBlockTiming * timing)
+{
+    timing->bytesSinceEtb = 0;
+}
+
+void cbTimingWritten (CheckedBlockTiming * timing, long length)
+{
+    if (length > 0)
+    {
+        timing->bytesSinceEtb += length;
+    }
+}
+
+void cbTimingEtb (CheckedBlockTiming * timing)
+{
+    GET_TIME(timing->etbTime);
+}
+
+// attempt 0 waits for the estimated print time of the block; after that the
+// estimate has been overshot, so polling restarts short and backs off
+long cbTimingPollMillis (CheckedBlockTiming * timing, long attempt)
+{
+    if ((attempt == 0) && (timing->bytesPerMilli > 0))
+    {
+        long estimateMillis = (long) (timing->bytesSinceEtb / timing->bytesPerMilli);
+
+        if (estimateMillis > CB_MAX_SEED_MILLIS)
+        {
+            return CB_MAX_SEED_MILLIS;
+        }
+
+        if (estimateMillis > CB_MIN_POLL_MILLIS)
+        {
+            return estimateMillis;
+        }
+    }
+
+    if (timing->bytesPerMilli > 0)
+    {
+        attempt--;
+    }
+
+    return cbBackoffMillis((attempt > 0)?attempt:0);
+}
+
+// folds the block just completed into the throughput estimate
+void cbTimingCompleted (CheckedBlockTiming * timing)
+{
+    struct timeval now;
+
+    GET_TIME(now);
+
+    double elapsedMillis = TIME_DIFF(timing->etbTime,now);
+
+    if ((timing->bytesSinceEtb > 0) && (elapsedMillis > 0))
+    {
+        double bytesPerMilli = timing->bytesSinceEtb / elapsedMillis;
+
+        if (timing->bytesPerMilli > 0)
+        {
+            timing->bytesPerMilli = (timing->bytesPerMilli * 3 + bytesPerMilli) / 4;
+        }
+        else
+        {
+            timing->bytesPerMilli = bytesPerMilli;
+        }
+    }
+
+    timing->bytesSinceEtb = 0;
+}
+
+// queues a completion for getCheckedBlockCompletions
+// if the application stops collecting, the oldest unreported completion is dropped
+static void cbPushCompletion(CheckedBlockPipeline * pipeline, unsigned char etbCounter, unsigned char failed, StarPrinterStatus * status)
+{
+    if (pipeline->numCompletions == MAX_PIPELINED_BLOCKS)
+    {
+        pipeline->firstCompletion = (pipeline->firstCompletion + 1) % MAX_PIPELINED_BLOCKS;
+        pipeline->numCompletions--;
+    }
+
+    CheckedBlockCompletion * completion = &pipeline->completions[(pipeline->firstCompletion + pipeline->numCompletions) % MAX_PIPELINED_BLOCKS];
+
+    completion->etbCounter = etbCounter;
+    completion->failed = failed;
+    memcpy(&completion->status, status, sizeof(StarPrinterStatus));
+
+    pipeline->numCompletions++;
+
+    if ((pipeline->notify != 0) && (pipeline->callback == NULL) && (pipeline->eventFd != -1))
+    {
+        uint64_t one = 1;
+
+        // the counter only saturates if the application never reads the fd
+        if (write(pipeline->eventFd, &one, sizeof(one)) == -1)
+        {
+        }
+    }
+}
+
+// reads device status once and retires the blocks the ETB counter has moved past
+// returns the number of blocks retired, or an error
+static long cbPoll(StarIOHandle * handle)
+{
+    CheckedBlockPipeline * pipeline = &handle->pipeline;
+
+    StarPrinterStatus status;
+
+    long ioResult = swReadStatus(handle, &status);
+
+    if (ioResult == STARIO_ERROR_NOT_OPEN)
+    {
+        return ioResult;
+    }
+
+    if (ioResult != STARIO_ERROR_SUCCESS)
+    {
+        // no status this round - tried again on the next poll
+        return 0;
+    }
+
+    long retired = 0;
+
+    if (status.offline)
+    {
+        // blocks in the device's buffer are lost - fail them all and reset
+        // the device, as endCheckedBlock does
+        for (; retired < pipeline->outstanding; retired++)
+        {
+            cbPushCompletion(pipeline, (pipeline->lastEtbCounter + 1 + retired) % 32, 1, &status);
+        }
+
+        pipeline->outstanding = 0;
+        pipeline->resync = 1;
+
+        if (handle->impl->hdwrResetDevice != 0)
+        {
+            ioResult = handle->impl->hdwrResetDevice(handle->port);
+
+            if (ioResult != STARIO_ERROR_SUCCESS)
+            {
+                return ioResult;
+            }
+        }
+
+        return retired;
+    }
+
+    long advanced = (status.etbCounter - pipeline->lastEtbCounter + 32) % 32;
+
+    // more ETBs than outstanding means blocks were ended outside the pipeline
+    if (advanced > pipeline->outstanding)
+    {
+        advanced = pipeline->outstanding;
+    }
+
+    for (; retired < advanced; retired++)
+    {
+        cbPushCompletion(pipeline, (pipeline->lastEtbCounter + 1 + retired) % 32, 0, &status);
+    }
+
+    if (retired > 0)
+    {
+        struct timeval now;
+
+        GET_TIME(now);
+
+        double blockMillis = TIME_DIFF(pipeline->progressTime,now) / retired;
+
+        pipeline->blockMillis = (pipeline->blockMillis > 0)?(pipeline->blockMillis * 3 + blockMillis) / 4:blockMillis;
+        pipeline->progressTime = now;
+    }
+
+    pipeline->outstanding -= retired;
+    pipeline->lastEtbCounter = status.etbCounter;
+
+    return retired;
+}
+
+static void cbTimingPipelineSubmitted(CheckedBlockPipeline * pipeline);
+
+void cbInitPipeline (StarIOHandle * handle)
+{
+    memset(&handle->pipeline, 0x00, sizeof(CheckedBlockPipeline));
+
+    handle->pipeline.eventFd = -1;
+}
+
+long cbBeginPipelined (StarIOHandle * handle, long maxOutstanding)
+{
+    if ((handle->impl->getStarPrinterStatus == 0) || (handle->impl->writePort == 0))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    if ((maxOutstanding < 1) || (maxOutstanding > MAX_PIPELINED_BLOCKS))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    StarPrinterStatus status;
+
+    long ioResult = swReadStatus(handle, &status);
+
+    if (ioResult != STARIO_ERROR_SUCCESS)
+    {
+        return ioResult;
+    }
+
+    if (status.etbAvailable == 0)
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    CheckedBlockPipeline previous;
+    memcpy(&previous, &handle->pipeline, sizeof(CheckedBlockPipeline));
+
+    memset(&handle->pipeline, 0x00, sizeof(CheckedBlockPipeline));
+
+    handle->pipeline.notify = previous.notify;
+    handle->pipeline.callback = previous.callback;
+    handle->pipeline.userData = previous.userData;
+    handle->pipeline.eventFd = previous.eventFd;
+
+    handle->pipeline.active = 1;
+    handle->pipeline.maxOutstanding = (unsigned char) maxOutstanding;
+    handle->pipeline.lastEtbCounter = status.etbCounter;
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+long cbSubmit (StarIOHandle * handle, unsigned char * etbCounter)
+{
+    CheckedBlockPipeline * pipeline = &handle->pipeline;
+
+    if (pipeline->active == 0)
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    long ioResult = STARIO_ERROR_SUCCESS;
+
+    long attempt = 0;
+
+    long stallMillis = (long) (pipeline->blockMillis * CB_STALL_FACTOR);
+    if (stallMillis < CB_MIN_STALL_MILLIS)
+    {
+        stallMillis = CB_MIN_STALL_MILLIS;
+    }
+
+    // at the limit, wait for the oldest block to print
+    while (pipeline->outstanding >= pipeline->maxOutstanding)
+    {
+        ioResult = cbPoll(handle);
+
+        if (ioResult < STARIO_ERROR_SUCCESS)
+        {
+            return ioResult;
+        }
+
+        if (ioResult == 0)
+        {
+            struct timeval now;
+
+            GET_TIME(now);
+
+            // no completion (or no status at all) for far longer than a block takes
+            if (TIME_DIFF(pipeline->progressTime,now) > stallMillis)
+            {
+                return STARIO_ERROR_IO_FAIL;
+            }
+
+            cbSleep(cbBackoffMillis(attempt++));
+        }
+    }
+
+    if (pipeline->resync != 0)
+    {
+        StarPrinterStatus status;
+
+        ioResult = swReadStatus(handle, &status);
+
+        if (ioResult != STARIO_ERROR_SUCCESS)
+        {
+            return ioResult;
+        }
+
+        pipeline->lastEtbCounter = status.etbCounter;
+        pipeline->resync = 0;
+    }
+
+    char etb[1] = {0x17};
+
+    ioResult = handle->impl->writePort(handle->port, etb, 1);
+
+    if (ioResult != 1)
+    {
+        return (ioResult < STARIO_ERROR_SUCCESS)?ioResult:STARIO_ERROR_IO_FAIL;
+    }
+
+    // checked block boundary - the ETB must reach the device before it is counted
+    if (handle->impl->flushPort != 0)
+    {
+        ioResult = handle->impl->flushPort(handle->port);
+
+        if (ioResult != STARIO_ERROR_SUCCESS)
+        {
+            return ioResult;
+        }
+    }
+
+    if (pipeline->outstanding == 0)
+    {
+        GET_TIME(pipeline->progressTime);
+    }
+
+    pipeline->outstanding++;
+
+    *etbCounter = (pipeline->lastEtbCounter + pipeline->outstanding) % 32;
+
+    if (pipeline->notify != 0)
+    {
+        cbTimingPipelineSubmitted(pipeline);
+    }
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+long cbGetCompletions (StarIOHandle * handle, CheckedBlockCompletion * completions, long maxCompletions, long timeoutMillis)
+{
+    CheckedBlockPipeline * pipeline = &handle->pipeline;
+
+    if (pipeline->active == 0)
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    struct timeval timeS;
+    struct timeval timeF;
+
+    GET_TIME(timeS);
+
+    long attempt = 0;
+
+    while (pipeline->outstanding > 0)
+    {
+        long ioResult = cbPoll(handle);
+
+        if (ioResult < STARIO_ERROR_SUCCESS)
+        {
+            return ioResult;
+        }
+
+        if (pipeline->numCompletions > 0)
+        {
+            break;
+        }
+
+        GET_TIME(timeF);
+
+        long remaining = timeoutMillis - (long) TIME_DIFF(timeS,timeF);
+        if (remaining <= 0)
+        {
+            break;
+        }
+
+        long pollMillis = cbBackoffMillis(attempt++);
+
+        cbSleep((remaining < pollMillis)?remaining:pollMillis);
+    }
+
+    long reported = 0;
+
+    for (; (reported < maxCompletions) && (pipeline->numCompletions > 0); reported++)
+    {
+        memcpy(&completions[reported], &pipeline->completions[pipeline->firstCompletion], sizeof(CheckedBlockCompletion));
+
+        pipeline->firstCompletion = (pipeline->firstCompletion + 1) % MAX_PIPELINED_BLOCKS;
+        pipeline->numCompletions--;
+    }
+
+    return reported;
+}
+
+// supervisor
+
+// restarts the supervisor's backoff for a port that has a new block, and wakes it
+static void cbTimingPipelineSubmitted(CheckedBlockPipeline * pipeline)
+{
+    pipeline->attempt = 0;
+
+    GET_TIME(pipeline->nextPoll);
+
+    pthread_mutex_lock(&cbSupervisorLock);
+    pthread_cond_signal(&cbSupervisorWake);
+    pthread_mutex_unlock(&cbSupervisorLock);
+}
+
+// polls one port if it is due and takes its completions for the callback
+// returns the milliseconds until the port next needs a poll, -1 if it has nothing outstanding
+static long cbSuperviseHandle(StarIOHandle * handle, CheckedBlockCompletion * done, long * numDone, CheckedBlockCallback * callback, void ** userData)
+{
+    *numDone = 0;
+
+    // a port busy with application i/o is retried shortly
+    if (pthread_mutex_trylock(&handle->lock) != 0)
+    {
+        return CB_MIN_POLL_MILLIS;
+    }
+
+    CheckedBlockPipeline * pipeline = &handle->pipeline;
+
+    long waitMillis = -1;
+
+    if ((pipeline->notify != 0) && (handle->port != NULL) && (pipeline->active != 0) && (pipeline->outstanding > 0))
+    {
+        struct timeval now;
+
+        GET_TIME(now);
+
+        waitMillis = (long) TIME_DIFF(now,pipeline->nextPoll);
+
+        if (waitMillis <= 0)
+        {
+            long ioResult = cbPoll(handle);
+
+            pipeline->attempt = (ioResult > 0)?0:(pipeline->attempt + 1);
+
+            waitMillis = cbBackoffMillis(pipeline->attempt);
+
+            GET_TIME(pipeline->nextPoll);
+            pipeline->nextPoll.tv_sec += waitMillis / 1000;
+            pipeline->nextPoll.tv_usec += (waitMillis % 1000) * 1000;
+            if (pipeline->nextPoll.tv_usec >= 1000 * 1000)
+            {
+                pipeline->nextPoll.tv_sec += 1;
+                pipeline->nextPoll.tv_usec -= 1000 * 1000;
+            }
+
+            if (pipeline->outstanding == 0)
+            {
+                waitMillis = -1;
+            }
+        }
+    }
+
+    if ((pipeline->notify != 0) && (pipeline->callback != NULL))
+    {
+        *callback = pipeline->callback;
+        *userData = pipeline->userData;
+
+        for (; pipeline->numCompletions > 0; (*numDone)++)
+        {
+            memcpy(&done[*numDone], &pipeline->completions[pipeline->firstCompletion], sizeof(CheckedBlockCompletion));
+
+            pipeline->firstCompletion = (pipeline->firstCompletion + 1) % MAX_PIPELINED_BLOCKS;
+            pipeline->numCompletions--;
+        }
+    }
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return waitMillis;
+}
+
+static void * cbSupervisorMain(void * arg)
+{
+    pthread_mutex_lock(&cbSupervisorLock);
+
+    while (cbSupervisorStop == 0)
+    {
+        StarIOHandle * supervisedHandles[MAX_NUM_HANDLES];
+        memcpy(supervisedHandles, cbSupervisedHandles, sizeof(supervisedHandles));
+
+        pthread_mutex_unlock(&cbSupervisorLock);
+
+        long sleepMillis = -1;
+
+        int i = 0;
+        for (; i < MAX_NUM_HANDLES; i++)
+        {
+            if (supervisedHandles[i] == NULL)
+            {
+                continue;
+            }
+
+            // from here until the callbacks return, cbSupervisorSync waits for this handle
+            pthread_mutex_lock(&cbSupervisorLock);
+            cbSupervisorVisiting = supervisedHandles[i];
+            pthread_mutex_unlock(&cbSupervisorLock);
+
+            CheckedBlockCompletion done[MAX_PIPELINED_BLOCKS];
+            long numDone = 0;
+            CheckedBlockCallback callback = NULL;
+            void * userData = NULL;
+
+            long waitMillis = cbSuperviseHandle(supervisedHandles[i], done, &numDone, &callback, &userData);
+
+            if ((waitMillis >= 0) && ((sleepMillis < 0) || (waitMillis < sleepMillis)))
+            {
+                sleepMillis = waitMillis;
+            }
+
+            StarPrinterStatus status;
+            unsigned long long changedMask = 0;
+            StatusChangeCallback statusCallback = NULL;
+            void * statusUserData = NULL;
+
+            waitMillis = swSuperviseHandle(supervisedHandles[i], &status, &changedMask, &statusCallback, &statusUserData);
+
+            if ((waitMillis >= 0) && ((sleepMillis < 0) || (waitMillis < sleepMillis)))
+            {
+                sleepMillis = waitMillis;
+            }
+
+            // outside the handle lock, so the callbacks may use the port
+            long doneIdx = 0;
+            for (; doneIdx < numDone; doneIdx++)
+            {
+                callback(supervisedHandles[i], &done[doneIdx], userData);
+            }
+
+            if (changedMask != 0)
+            {
+                statusCallback(supervisedHandles[i], changedMask, &status, statusUserData);
+            }
+
+            pthread_mutex_lock(&cbSupervisorLock);
+            cbSupervisorVisiting = NULL;
+            pthread_cond_broadcast(&cbSupervisorVisited);
+            pthread_mutex_unlock(&cbSupervisorLock);
+        }
+
+        pthread_mutex_lock(&cbSupervisorLock);
+
+        if (cbSupervisorStop != 0)
+        {
+            break;
+        }
+
+        if (sleepMillis < 0)
+        {
+            // nothing outstanding or watched anywhere - sleep until woken
+            pthread_cond_wait(&cbSupervisorWake, &cbSupervisorLock);
+        }
+        else if (sleepMillis > 0)
+        {
+            struct timespec waitUntil;
+            clock_gettime(CLOCK_MONOTONIC, &waitUntil);
+            waitUntil.tv_sec += sleepMillis / 1000;
+            waitUntil.tv_nsec += (sleepMillis % 1000) * 1000 * 1000;
+            if (waitUntil.tv_nsec >= 1000 * 1000 * 1000)
+            {
+                waitUntil.tv_sec += 1;
+                waitUntil.tv_nsec -= 1000 * 1000 * 1000;
+            }
+
+            pthread_cond_timedwait(&cbSupervisorWake, &cbSupervisorLock, &waitUntil);
+        }
+    }
+
+    pthread_mutex_unlock(&cbSupervisorLock);
+
+    return NULL;
+}
+
+// called with cbSupervisorLock held
+static long cbStartSupervisorLocked(void)
+{
+    if (cbSupervisorRunning != 0)
+    {
+        return STARIO_ERROR_SUCCESS;
+    }
+
+    pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+
+    pthread_cond_init(&cbSupervisorWake, &condAttr);
+
+    pthread_condattr_destroy(&condAttr);
+
+    cbSupervisorStop = 0;
+
+    if (pthread_create(&cbSupervisor, NULL, cbSupervisorMain, NULL) != 0)
+    {
+        pthread_cond_destroy(&cbSupervisorWake);
+
+        return STARIO_ERROR_RUNTIME;
+    }
+
+    cbSupervisorRunning = 1;
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+void cbStopSupervisor (void)
+{
+    pthread_mutex_lock(&cbSupervisorLock);
+
+    if (cbSupervisorRunning == 0)
+    {
+        pthread_mutex_unlock(&cbSupervisorLock);
+
+        return;
+    }
+
+    cbSupervisorStop = 1;
+    pthread_cond_signal(&cbSupervisorWake);
+
+    pthread_mutex_unlock(&cbSupervisorLock);
+
+    pthread_join(cbSupervisor, NULL);
+
+    pthread_cond_destroy(&cbSupervisorWake);
+
+    cbSupervisorRunning = 0;
+}
+
+long cbSupervisorAdd (StarIOHandle * handle)
+{
+    pthread_mutex_lock(&cbSupervisorLock);
+
+    long result = cbStartSupervisorLocked();
+
+    if (result == STARIO_ERROR_SUCCESS)
+    {
+        int freeIdx = -1;
+
+        int i = 0;
+        for (; i < MAX_NUM_HANDLES; i++)
+        {
+            if (cbSupervisedHandles[i] == handle)
+                break;
+
+            if ((cbSupervisedHandles[i] == NULL) && (freeIdx == -1))
+                freeIdx = i;
+        }
+
+        if (i == MAX_NUM_HANDLES)
+        {
+            cbSupervisedHandles[freeIdx] = handle;
+        }
+
+        pthread_cond_signal(&cbSupervisorWake);
+    }
+
+    pthread_mutex_unlock(&cbSupervisorLock);
+
+    return result;
+}
+
+// keeps the handle registered while the other user still needs it
+void cbSupervisorRemove (StarIOHandle * handle)
+{
+    if ((handle->pipeline.notify != 0) || (handle->watch.active != 0))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&cbSupervisorLock);
+
+    int i = 0;
+    for (; i < MAX_NUM_HANDLES; i++)
+    {
+        if (cbSupervisedHandles[i] == handle)
+        {
+            cbSupervisedHandles[i] = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&cbSupervisorLock);
+}
+
+void cbSupervisorSync (StarIOHandle * handle)
+{
+    pthread_mutex_lock(&cbSupervisorLock);
+
+    // a callback disabling its own port can not wait for itself
+    if ((cbSupervisorRunning == 0) || (pthread_equal(pthread_self(), cbSupervisor) != 0))
+    {
+        pthread_mutex_unlock(&cbSupervisorLock);
+
+        return;
+    }
+
+    while (cbSupervisorVisiting == handle)
+    {
+        pthread_cond_wait(&cbSupervisorVisited, &cbSupervisorLock);
+    }
+
+    pthread_mutex_unlock(&cbSupervisorLock);
+}
+
+long cbEnableNotify (StarIOHandle * handle, CheckedBlockCallback callback, void * userData)
+{
+    CheckedBlockPipeline * pipeline = &handle->pipeline;
+
+    if (pipeline->eventFd == -1)
+    {
+        pipeline->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if (pipeline->eventFd == -1)
+        {
+            return STARIO_ERROR_RUNTIME;
+        }
+    }
+
+    pipeline->notify = 1;
+    pipeline->callback = callback;
+    pipeline->userData = userData;
+    pipeline->attempt = 0;
+
+    GET_TIME(pipeline->nextPoll);
+
+    long result = cbSupervisorAdd(handle);
+
+    if (result != STARIO_ERROR_SUCCESS)
+    {
+        pipeline->notify = 0;
+        pipeline->callback = NULL;
+        pipeline->userData = NULL;
+    }
+
+    return result;
+}
+
+long cbDisableNotify (StarIOHandle * handle)
+{
+    CheckedBlockPipeline * pipeline = &handle->pipeline;
+
+    pipeline->notify = 0;
+    pipeline->callback = NULL;
+    pipeline->userData = NULL;
+
+    cbSupervisorRemove(handle);
+
+    if (pipeline->eventFd != -1)
+    {
+        close(pipeline->eventFd);
+        pipeline->eventFd = -1;
+    }
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+long cbGetEventFd (StarIOHandle * handle)
+{
+    if ((handle->pipeline.notify == 0) || (handle->pipeline.eventFd == -1))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    return handle->pipeline.eventFd;
+}
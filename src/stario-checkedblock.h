@@ -0,0 +1,64 @@
+/*
+    libstario.so
+    ------------
+    Library providing USB, serial, and parallel communications support for
+    Star Micronics devices.
+
+    Copyright (C) 2004 Star Micronics Co., Ltd.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _included_stario_checkedblock
+#define _included_stario_checkedblock
+
+#include "stario-prvstructures.h"
+
+// pipelined checked blocks - built on the backend's write, flush, status and
+// reset functions, so every backend with an ETB counter supports them
+// all functions are called with the handle's lock held
+
+// ETB counter polling - the first interval is seeded from the bytes in the
+// block and the port's recent throughput, later ones back off exponentially
+// backends call cbTimingWritten from writePort and the rest from their checked block functions
+
+void cbTimingBegin      (CheckedBlockTiming * timing);
+void cbTimingWritten    (CheckedBlockTiming * timing, long length);
+void cbTimingEtb        (CheckedBlockTiming * timing);
+long cbTimingPollMillis (CheckedBlockTiming * timing, long attempt);
+void cbTimingCompleted  (CheckedBlockTiming * timing);
+
+void cbInitPipeline     (StarIOHandle * handle);
+long cbBeginPipelined   (StarIOHandle * handle, long maxOutstanding);
+long cbSubmit           (StarIOHandle * handle, unsigned char * etbCounter);
+long cbGetCompletions   (StarIOHandle * handle, CheckedBlockCompletion * completions, long maxCompletions, long timeoutMillis);
+
+// asynchronous completion - a single supervisor thread polls every port with
+// notify enabled, so no application thread has to block per printer
+// the status watch shares the thread; a handle stays registered while either needs it
+
+long cbSupervisorAdd    (StarIOHandle * handle);
+void cbSupervisorRemove (StarIOHandle * handle);
+// waits for the supervisor to finish its visit of the handle, so none of the
+// callbacks it took from the handle is still to run; called without the
+// handle's lock, and returns at once on the supervisor thread
+void cbSupervisorSync   (StarIOHandle * handle);
+
+long cbEnableNotify     (StarIOHandle * handle, CheckedBlockCallback callback, void * userData);
+long cbDisableNotify    (StarIOHandle * handle);
+long cbGetEventFd       (StarIOHandle * handle);
+void cbStopSupervisor   (void);
+
+#endif
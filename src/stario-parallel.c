@@ -27,22 +27,25 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <memory.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <linux/ppdev.h>
 #include <linux/parport.h>
 
 #include "stario-error.h"
+#include "stario-status.h"
 #include "stario-parallel.h"
+#include "stario-checkedblock.h"
 
 static long parMatchPortName        (char const * portName);
-static long parOpenPort             (char const * portName, char const * portSettings);
-static long parWritePort            (char const * portName, char const * writeBuffer, long length);
-static long parReadPort             (char const * portName, char * readBuffer, long length);
-static long parGetStarPrinterStatus (char const * portName, StarPrinterStatus * status);
-static long parBeginCheckedBlock    (char const * portName);
-static long parEndCheckedBlock      (char const * portName, StarPrinterStatus * status);
-static long parHdwrResetDevice      (char const * portName);
-static long parClosePort            (char const * portName);
+static long parOpenPort             (char const * portName, char const * portSettings, void ** port);
+static long parWritePort            (void * port, char const * writeBuffer, long length);
+static long parReadPort             (void * port, char * readBuffer, long length);
+static long parGetStarPrinterStatus (void * port, StarPrinterStatus * status);
+static long parBeginCheckedBlock    (void * port);
+static long parEndCheckedBlock      (void * port, StarPrinterStatus * status);
+static long parHdwrResetDevice      (void * port);
+static long parClosePort            (void * port);
 static void parReleaseImpl          ();
 
 #define MAX_NUM_PORTS 20
@@ -54,9 +57,13 @@ typedef struct
     int port;
 
     StarPrinterStatus statusCache;
+    CheckedBlockTiming timing;          // print time estimate pacing endCheckedBlock polls
 } ParPort;
 
-ParPort parPorts[MAX_NUM_PORTS];
+static ParPort parPorts[MAX_NUM_PORTS];
+
+// guards parPorts slots - held by open and close only, port i/o is serialised per port by the caller
+static pthread_mutex_t parPortsLock = PTHREAD_MUTEX_INITIALIZER;
 
 PortImpl getParPortImpl()
 {
@@ -67,6 +74,7 @@ PortImpl getParPortImpl()
     impl.matchPortName          = parMatchPortName;
     impl.openPort               = parOpenPort;
     impl.writePort              = parWritePort;
+    impl.flushPort              = NULL;
     impl.readPort               = parReadPort;
     impl.getStarPrinterStatus   = parGetStarPrinterStatus;
     impl.beginCheckedBlock      = parBeginCheckedBlock;
@@ -107,11 +115,13 @@ static long parMatchPortName (char const * portName)
     return STARIO_ERROR_NOT_AVAILABLE;
 }
 
-static long parOpenPort (char const * portName, char const * portSettings)
+static long parOpenPortPrv (char const * portName, char const * portSettings, void ** port)
 {
     ParPort * oldParPort = parFindPort(portName);
     if (oldParPort != NULL)
     {
+        *port = oldParPort;
+
         return STARIO_ERROR_SUCCESS;
     }
 
@@ -149,9 +159,23 @@ static long parOpenPort (char const * portName, char const * portSettings)
 
     memcpy(&parPorts[i], &parPort, sizeof(ParPort));
 
+    *port = &parPorts[i];
+
     return STARIO_ERROR_SUCCESS;
 }
 
+// the table lock is held across the whole open so that two opens can not claim one slot
+static long parOpenPort (char const * portName, char const * portSettings, void ** port)
+{
+    pthread_mutex_lock(&parPortsLock);
+
+    long result = parOpenPortPrv(portName, portSettings, port);
+
+    pthread_mutex_unlock(&parPortsLock);
+
+    return result;
+}
+
 static unsigned char getOnlineStatus(ParPort * parPort)
 {
     int mode = IEEE1284_MODE_COMPAT;
@@ -169,10 +193,10 @@ static unsigned char getOnlineStatus(ParPort * parPort)
     return (((portError & PARPORT_STATUS_ERROR) != 0) && ((portError & PARPORT_STATUS_BUSY) != 0) )     ?1:0;
 }
 
-static long parWritePort (char const * portName, char const * writeBuffer, long length)
+static long parWritePort (void * port, char const * writeBuffer, long length)
 {
-    ParPort * parPort = parFindPort(portName);
-    if (parPort == NULL)
+    ParPort * parPort = (ParPort *) port;
+    if (parPort->set == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
@@ -223,13 +247,15 @@ static long parWritePort (char const * portName, char const * writeBuffer, long
             writeLength += subWriteLength;
     }
 
+    cbTimingWritten(&parPort->timing, writeLength);
+
     return writeLength;
 }
 
-static long parReadPort (char const * portName, char * readBuffer, long length)
+static long parReadPort (void * port, char * readBuffer, long length)
 {
-    ParPort * parPort = parFindPort(portName);
-    if (parPort == NULL)
+    ParPort * parPort = (ParPort *) port;
+    if (parPort->set == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
@@ -252,11 +278,11 @@ static long parReadPort (char const * portName, char * readBuffer, long length)
     return readLength;
 }
 
-static long parGetStarPrinterStatus (char const * portName, StarPrinterStatus * status)
+static long parGetStarPrinterStatus (void * port, StarPrinterStatus * status)
 {
     memset(status, 0x00, sizeof(StarPrinterStatus));
 
-    long readResult = parReadPort(portName, status->raw, sizeof(status->raw));
+    long readResult = parReadPort(port, status->raw, sizeof(status->raw));
 
     if (readResult < STARIO_ERROR_SUCCESS)
     {
@@ -270,57 +296,20 @@ static long parGetStarPrinterStatus (char const * portName, StarPrinterStatus *
 
     status->rawLength = (unsigned char) readResult;
 
-    // printer status 1
-    status->coverOpen           = ((status->raw[2] & 0x20)!=0)?1:0;
-    status->offline             = ((status->raw[2] & 0x08)!=0)?1:0;
-    status->compulsionSwitch    = ((status->raw[2] & 0x04)!=0)?1:0;
-
-    // printer status 2
-    status->overTemp            = ((status->raw[3] & 0x40)!=0)?1:0;
-    status->unrecoverableError  = ((status->raw[3] & 0x20)!=0)?1:0;
-    status->cutterError         = ((status->raw[3] & 0x08)!=0)?1:0;
-    status->mechError           = ((status->raw[3] & 0x04)!=0)?1:0;
-
-    // printer status 3
-    status->pageModeCmdError        = ((status->raw[4] & 0x20)!=0)?1:0;
-    status->paperSizeError          = ((status->raw[4] & 0x08)!=0)?1:0;
-    status->presenterPaperJamError  = ((status->raw[4] & 0x04)!=0)?1:0;
-    status->headUpError             = ((status->raw[4] & 0x02)!=0)?1:0;
-
-    // printer status 4
-    status->blackMarkDetectStatus   = ((status->raw[5] & 0x20)!=0)?1:0;
-    status->paperEmpty              = ((status->raw[5] & 0x08)!=0)?1:0;
-    status->paperNearEmptyInner     = ((status->raw[5] & 0x04)!=0)?1:0;
-    status->paperNearEmptyOuter     = ((status->raw[5] & 0x02)!=0)?1:0;
-
-    // printer status 5
-    status->stackerFull             = ((status->raw[6] & 0x02)!=0)?1:0;
-
-    // printer status 6
-    status->etbAvailable            = (status->rawLength >= 9)?1:0;
-    status->etbCounter              = (((status->raw[7] & 0x40) >> 2) |
-                                       ((status->raw[7] & 0x20) >> 2) |
-                                       ((status->raw[7] & 0x08) >> 1) |
-                                       ((status->raw[7] & 0x04) >> 1) |
-                                       ((status->raw[7] & 0x02) >> 1));
-
-    // printer status 7
-    status->presenterState          = (((status->raw[8] & 0x08) >> 1) |
-                                       ((status->raw[8] & 0x04) >> 1) |
-                                       ((status->raw[8] & 0x02) >> 1));
+    asbDecode(status);
 
     return STARIO_ERROR_SUCCESS;
 }
 
-static long parBeginCheckedBlock (char const * portName)
+static long parBeginCheckedBlock (void * port)
 {
-    ParPort * parPort = parFindPort(portName);
-    if (parPort == NULL)
+    ParPort * parPort = (ParPort *) port;
+    if (parPort->set == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
 
-    long ioResult = parGetStarPrinterStatus(portName, &parPort->statusCache);
+    long ioResult = parGetStarPrinterStatus(port, &parPort->statusCache);
 
     if (ioResult != STARIO_ERROR_SUCCESS)
     {
@@ -332,13 +321,15 @@ static long parBeginCheckedBlock (char const * portName)
         return STARIO_ERROR_NOT_AVAILABLE;
     }
 
+    cbTimingBegin(&parPort->timing);
+
     return STARIO_ERROR_SUCCESS;
 }
 
-static long parEndCheckedBlock (char const * portName, StarPrinterStatus * status)
+static long parEndCheckedBlock (void * port, StarPrinterStatus * status)
 {
-    ParPort * parPort = parFindPort(portName);
-    if (parPort == NULL)
+    ParPort * parPort = (ParPort *) port;
+    if (parPort->set == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
@@ -357,15 +348,19 @@ static long parEndCheckedBlock (char const * portName, StarPrinterStatus * statu
     {
         char etb[1] = {0x17};
 
-        ioResult = parWritePort(portName, etb, 1);
+        ioResult = parWritePort(port, etb, 1);
 
         if (ioResult == 1)
         {
             unsigned char nextEtbCounter = (parPort->statusCache.etbCounter + 1) % 32;
 
+            cbTimingEtb(&parPort->timing);
+
+            long attempt = 0;
+
             do
             {
-                ioResult = parGetStarPrinterStatus(portName, status);
+                ioResult = parGetStarPrinterStatus(port, status);
 
                 if (ioResult == STARIO_ERROR_IO_FAIL)
                 {
@@ -378,7 +373,9 @@ static long parEndCheckedBlock (char const * portName, StarPrinterStatus * statu
                     (status->offline == 0) &&
                     (status->etbCounter != nextEtbCounter))
                 {
-                    struct timeval sleepTime = {0, 200 * 1000};
+                    long pollMillis = cbTimingPollMillis(&parPort->timing, attempt++);
+
+                    struct timeval sleepTime = {pollMillis / 1000, (pollMillis % 1000) * 1000};
 
                     select(0, NULL, NULL, NULL, &sleepTime);
 
@@ -387,11 +384,17 @@ static long parEndCheckedBlock (char const * portName, StarPrinterStatus * statu
 
                 break;
             } while (1);
+
+            if ((ioResult >= STARIO_ERROR_SUCCESS) &&
+                (status->offline == 0))
+            {
+                cbTimingCompleted(&parPort->timing);
+            }
         }
 
         if (status->offline)
         {
-            ioResult = parHdwrResetDevice(portName);
+            ioResult = parHdwrResetDevice(port);
 
             if (ioResult != STARIO_ERROR_SUCCESS)
             {
@@ -403,10 +406,10 @@ static long parEndCheckedBlock (char const * portName, StarPrinterStatus * statu
     return STARIO_ERROR_SUCCESS;
 }
 
-static long parHdwrResetDevice (char const * portName)
+static long parHdwrResetDevice (void * port)
 {
-    ParPort * parPort = parFindPort(portName);
-    if (parPort == NULL)
+    ParPort * parPort = (ParPort *) port;
+    if (parPort->set == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
@@ -439,10 +442,10 @@ static long parHdwrResetDevice (char const * portName)
     return STARIO_ERROR_IO_FAIL;
 }
 
-static long parClosePort (char const * portName)
+static long parClosePort (void * port)
 {
-    ParPort * parPort = parFindPort(portName);
-    if (parPort == NULL)
+    ParPort * parPort = (ParPort *) port;
+    if (parPort->set == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
@@ -451,7 +454,9 @@ static long parClosePort (char const * portName)
 
     close(parPort->port);
 
+    pthread_mutex_lock(&parPortsLock);
     memset(parPort, 0x00, sizeof(ParPort));
+    pthread_mutex_unlock(&parPortsLock);
 
     return STARIO_ERROR_SUCCESS;
 }
@@ -463,7 +468,7 @@ static void parReleaseImpl ()
     {
         if (parPorts[i].set != 0)
         {
-            parClosePort(parPorts[i].portName);
+            parClosePort(&parPorts[i]);
         }
     }
 }
@@ -24,37 +24,124 @@
 #ifndef _included_stario_prvstructures
 #define _included_stario_prvstructures
 
+#include <pthread.h>
+#include <sys/time.h>
+
 #include "stario-structures.h"
+#include "stario-backend.h"
 
 #define GET_TIME(time) (gettimeofday(&time, NULL))
 #define TIME_DIFF(start,finish) (((finish.tv_sec  - start.tv_sec ) * 1e3) + ((finish.tv_usec - start.tv_usec) / 1e3))
 
 #define MAX_NUM_PORTS          20
 
-// Serial, Parallel, and USB supported - 3 impls
-#define USB_IMPL_IDX            0
-#define PAR_IMPL_IDX            1
-#define SER_IMPL_IDX            2
-#define NUM_IMPLS               3
+// registered backends - the built in usb, parallel and serial plus plugins
+#define MAX_NUM_IMPLS           16
+
+// open handles across all backends
+#define MAX_NUM_HANDLES         60
+
+// CheckedBlockTiming - structure
+// ------------------
+//
+// Per-port print time estimate used to pace ETB counter polling.
+typedef struct
+{
+    long bytesSinceEtb;                 // bytes written since the last checked block began or ended
+    double bytesPerMilli;               // recent print throughput, 0 until measured
+    struct timeval etbTime;             // when the last ETB was written
+} CheckedBlockTiming;
+
+// pipelined checked blocks - the ETB counter is 5 bits, so at most 31 blocks
+// can be outstanding without two of them sharing a counter value
+#define MAX_PIPELINED_BLOCKS    31
 
+// CheckedBlockPipeline - structure
+// --------------------
+//
+// Per-port state of the pipelined checked block api.  Outstanding blocks are
+// tagged lastEtbCounter + 1 ... lastEtbCounter + outstanding (mod 32).
 typedef struct
 {
-    long (* matchPortName)          (char const * portName);
-    long (* openPort)               (char const * portName, char const * portSettings);
-
-    // printer api
-    long (* writePort)              (char const * portName, char const * writeBuffer, long length);
-    long (* readPort)               (char const * portName, char * readBuffer, long length);
-    long (* getStarPrinterStatus)   (const char * portName, StarPrinterStatus * status);
-    long (* beginCheckedBlock)      (char const * portName);
-    long (* endCheckedBlock)        (char const * portName, StarPrinterStatus * status);
-    long (* hdwrResetDevice)        (char const * portName);
-
-    // visual card api
-    long (* doVisualCardCmd)        (char const * portName, VisualCardCmd * request, long timeoutMillis);
-
-    long (* closePort)              (char const * portName);
-    void (* releaseImpl)            ();
-} PortImpl;
+    unsigned char active;               // if 0, beginPipelinedCheckedBlocks not called
+    unsigned char maxOutstanding;       // 1 ~ MAX_PIPELINED_BLOCKS
+    unsigned char lastEtbCounter;       // device ETB counter as last observed
+    unsigned char outstanding;          // blocks submitted and not yet completed
+    unsigned char resync;               // if 1, lastEtbCounter is re-read before the next submit (i.e. after a reset)
+    struct timeval progressTime;        // when a block last completed, or the first outstanding one was submitted
+    double blockMillis;                 // recent print time per completed block, 0 until measured
+
+    CheckedBlockCompletion completions[MAX_PIPELINED_BLOCKS];   // completed, not yet reported - ring
+    unsigned char firstCompletion;      // index of the oldest unreported completion
+    unsigned char numCompletions;       // count of unreported completions
+
+    // asynchronous completion - kept across beginPipelinedCheckedBlocks
+    unsigned char notify;               // if 1, the supervisor thread polls this port
+    CheckedBlockCallback callback;      // if set, receives completions instead of the queue
+    void * userData;                    // passed to callback
+    int eventFd;                        // eventfd signalled per queued completion, -1 if none
+    long attempt;                       // supervisor poll backoff, reset on progress
+    struct timeval nextPoll;            // earliest time of the supervisor's next status read
+} CheckedBlockPipeline;
+
+// StatusCache - structure
+// -----------
+//
+// Last status read from a port through the handle, whoever asked for it,
+// and the read in progress, if any.  Callers that arrive while a read runs
+// take its result instead of reading again.  Guarded by the status watch's
+// cache lock rather than the handle's, so that such callers need not wait
+// for the port.
+typedef struct
+{
+    unsigned char valid;                // if 0, no status read yet
+    StarPrinterStatus status;           // status as last read
+    struct timeval received;            // when the read that produced status completed
+    unsigned char reading;              // if 1, a read is in progress
+    struct timeval started;             // when the read in progress began
+    long reads;                         // reads completed, successful or not
+    long lastResult;                    // result of the last read completed
+} StatusCache;
+
+// StatusWatch - structure
+// -----------
+//
+// Per-port state of a status change subscription.  The supervisor thread
+// reads status on an interval that shortens while the device is changing
+// and backs off while it is idle.
+typedef struct
+{
+    unsigned char active;               // if 1, subscribeStatusChanges called
+    StatusChangeCallback callback;      // receives each change
+    void * userData;                    // passed to callback
+    unsigned char haveLast;             // if 0, nothing reported yet
+    StarPrinterStatus last;             // status as last reported
+    long attempt;                       // poll backoff, reset on change
+    struct timeval nextPoll;            // earliest time of the next status read
+} StatusWatch;
+
+// StarIOHandle - structure
+// ------------
+//
+// Binds an open port to its backend and backend port structure.
+// Resolved once in openPortHandle; every later call is a direct dispatch.
+//
+// lock serialises all calls on the port, so independent ports run in parallel.
+// set and portName are guarded by the handle table lock; impl and port are
+// written holding both lock and the table lock, so either one is enough to read them.
+struct StarIOHandle
+{
+    unsigned char set;                  // if 0, not set
+    char portName[100];                 // string port name the handle was opened with
+
+    PortImpl * impl;                    // supporting backend
+    void * port;                        // backend port structure, NULL once the handle goes stale
+
+    CheckedBlockPipeline pipeline;      // pipelined checked block state, guarded by lock
+    StatusWatch watch;                  // status change subscription, guarded by lock
+    StatusCache lastStatus;             // status cache, guarded by the status watch's cache lock
+
+    pthread_mutex_t lock;               // per-port lock, taken before the handle table lock
+};
 
 #endif
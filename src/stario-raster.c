@@ -0,0 +1,1528 @@
+/*
+    libstario.so
+    ------------
+    Library providing USB, serial, and parallel communications support for
+    Star Micronics devices.
+
+    Copyright (C) 2004 Star Micronics Co., Ltd.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "stario.h"
+#include "stario-error.h"
+#include "stario-raster.h"
+
+// ESC * r R, ESC * r A, ESC * r E '1' NUL, ESC * r P '0' NUL
+#define RASTER_HEADER_LENGTH    (4 + 4 + 6 + 6)
+// ESC * r B
+#define RASTER_FOOTER_LENGTH    4
+// ESC d '3'
+#define RASTER_CUT_LENGTH       3
+// 'b' nL nH
+#define RASTER_LINE_HEADER      3
+// ESC * r Y n NUL, n being 1 ~ 255 in ascii decimal
+#define RASTER_SKIP_MAX_LENGTH  8
+#define RASTER_SKIP_MAX_LINES   255
+
+#define RASTER_DEFAULT_THRESHOLD    128
+
+// writeRasterImage encodes ahead into a ring of this many bands of this size
+#define RASTER_NUM_BANDS            4
+#define RASTER_BAND_LENGTH          16384
+
+// large images are split into stripes of about this many bytes of job,
+// encoded by up to this many workers into twice as many stripe buffers
+#define RASTER_STRIPE_LENGTH        65536
+#define RASTER_STRIPE_MIN_LINES     64
+#define RASTER_MAX_WORKERS          4
+#define RASTER_MAX_SLOTS            (RASTER_MAX_WORKERS * 2)
+
+// error diffusion threads diffuse a line this many pixels at a time between
+// looking at how far the line above has got
+#define RASTER_WAVE_SPAN            128
+
+#if defined(__SSE2__)
+
+// movemask yields the first pixel in the least significant bit, raster
+// data wants it in the most significant
+#define RASTER_R2(n) n, n + 2 * 64, n + 1 * 64, n + 3 * 64
+#define RASTER_R4(n) RASTER_R2(n), RASTER_R2(n + 2 * 16), RASTER_R2(n + 1 * 16), RASTER_R2(n + 3 * 16)
+#define RASTER_R6(n) RASTER_R4(n), RASTER_R4(n + 2 * 4), RASTER_R4(n + 1 * 4), RASTER_R4(n + 3 * 4)
+
+static unsigned char const rasterBitReverse[256] =
+{
+    RASTER_R6(0), RASTER_R6(2), RASTER_R6(1), RASTER_R6(3)
+};
+
+#endif
+
+// 8 x 8 Bayer matrix
+static unsigned char const rasterBayer[8][8] =
+{
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+void rasterPackLine (unsigned char const * gray, long width, unsigned char const * thresholds, unsigned char * line)
+{
+    long x = 0;
+
+#if defined(__SSE2__)
+    // the thresholds row repeats every 8 pixels, so one register of it
+    // lines up with every 16 or 32 pixel step
+    long long row = 0;
+
+    memcpy(&row, thresholds, sizeof(row));
+#endif
+
+#if defined(__AVX2__)
+    {
+        // compare unsigned values as signed by flipping the top bit of both
+        __m256i bias = _mm256_set1_epi8((char) 0x80);
+        __m256i limit = _mm256_xor_si256(_mm256_set1_epi64x(row), bias);
+
+        for (; x + 32 <= width; x += 32)
+        {
+            __m256i pixels = _mm256_xor_si256(_mm256_loadu_si256((__m256i const *) (gray + x)), bias);
+            unsigned int mask = (unsigned int) _mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, pixels));
+
+            line[x / 8 + 0] = rasterBitReverse[mask & 0xff];
+            line[x / 8 + 1] = rasterBitReverse[(mask >> 8) & 0xff];
+            line[x / 8 + 2] = rasterBitReverse[(mask >> 16) & 0xff];
+            line[x / 8 + 3] = rasterBitReverse[mask >> 24];
+        }
+    }
+#endif
+
+#if defined(__SSE2__)
+    {
+        __m128i bias = _mm_set1_epi8((char) 0x80);
+        __m128i limit = _mm_xor_si128(_mm_set1_epi64x(row), bias);
+
+        for (; x + 16 <= width; x += 16)
+        {
+            __m128i pixels = _mm_xor_si128(_mm_loadu_si128((__m128i const *) (gray + x)), bias);
+            unsigned int mask = (unsigned int) _mm_movemask_epi8(_mm_cmplt_epi8(pixels, limit));
+
+            line[x / 8 + 0] = rasterBitReverse[mask & 0xff];
+            line[x / 8 + 1] = rasterBitReverse[mask >> 8];
+        }
+    }
+#elif defined(__ARM_NEON)
+    {
+        // weight each compare result by its bit, then add the eight weights of a byte
+        static unsigned char const weights[16] =
+        {
+            0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+            0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01
+        };
+
+        uint8x16_t bits = vld1q_u8(weights);
+        uint8x16_t limit = vcombine_u8(vld1_u8(thresholds), vld1_u8(thresholds));
+
+        for (; x + 16 <= width; x += 16)
+        {
+            uint8x16_t black = vandq_u8(vcltq_u8(vld1q_u8(gray + x), limit), bits);
+            uint8x8_t sum = vpadd_u8(vget_low_u8(black), vget_high_u8(black));
+
+            sum = vpadd_u8(sum, sum);
+            sum = vpadd_u8(sum, sum);
+
+            line[x / 8 + 0] = vget_lane_u8(sum, 0);
+            line[x / 8 + 1] = vget_lane_u8(sum, 1);
+        }
+    }
+#endif
+
+    for (; x < width; x += 8)
+    {
+        unsigned char bits = 0;
+
+        long i = 0;
+        for (; (i < 8) && (x + i < width); i++)
+        {
+            if (gray[x + i] < thresholds[i])
+            {
+                bits |= 0x80 >> i;
+            }
+        }
+
+        line[x / 8] = bits;
+    }
+}
+
+long rasterInkLength (unsigned char const * line, long length)
+{
+    long inkLength = length;
+
+    // drop white 16 byte blocks from the end, then single bytes
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+
+    while (inkLength >= 16)
+    {
+        __m128i bytes = _mm_loadu_si128((__m128i const *) (line + inkLength - 16));
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero)) != 0xffff)
+        {
+            break;
+        }
+
+        inkLength -= 16;
+    }
+#elif defined(__ARM_NEON)
+    while (inkLength >= 16)
+    {
+        uint64x2_t bytes = vreinterpretq_u64_u8(vld1q_u8(line + inkLength - 16));
+
+        if ((vgetq_lane_u64(bytes, 0) | vgetq_lane_u64(bytes, 1)) != 0)
+        {
+            break;
+        }
+
+        inkLength -= 16;
+    }
+#endif
+
+    while ((inkLength > 0) && (line[inkLength - 1] == 0))
+    {
+        inkLength--;
+    }
+
+    return inkLength;
+}
+
+long rasterConverterInit (RasterConverter * converter, unsigned char const * gray, long width, long height, long stride, RasterOptions const * options)
+{
+    memset(converter, 0x00, sizeof(RasterConverter));
+
+    converter->gray = gray;
+    converter->width = width;
+    converter->height = height;
+    converter->stride = stride;
+    converter->threshold = RASTER_DEFAULT_THRESHOLD;
+    converter->dither = STARIO_DITHER_NONE;
+
+    if (options != NULL)
+    {
+        converter->threshold = options->threshold;
+        converter->dither = options->dither;
+    }
+
+    switch (converter->dither)
+    {
+        case STARIO_DITHER_NONE:
+        case STARIO_DITHER_ORDERED:
+            break;
+
+        case STARIO_DITHER_FLOYD_STEINBERG:
+        case STARIO_DITHER_ATKINSON:
+            // x - 1 ~ x + 2 of each row are written, so 2 columns of margin each side
+            converter->errors = (int *) calloc(3 * (width + 4), sizeof(int));
+
+            if (converter->errors == NULL)
+            {
+                return STARIO_ERROR_RUNTIME;
+            }
+
+            converter->rows[0] = converter->errors + 2;
+            converter->rows[1] = converter->errors + 2 + (width + 4);
+            converter->rows[2] = converter->errors + 2 + (width + 4) * 2;
+            break;
+
+        default:
+            return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// error carried along a line from one span of it to the next
+typedef struct
+{
+    int right;                          // error for x from x - 1 (and x - 2, Atkinson)
+    int belowLeft;                      // Floyd-Steinberg - error for x - 1 of the next line from x - 2 and x - 1
+    int below;                          // Floyd-Steinberg - error for x of the next line from x - 1
+    int rightNext;                      // Atkinson - error for x + 1 from x - 1
+    int left;                           // Atkinson - error of x - 1
+    int leftLeft;                       // Atkinson - error of x - 2
+    unsigned int bits;                  // dots of the byte being packed
+} RasterCarry;
+
+// error diffusion of pixels x0 ~ x1 - 1 of a line - errors are held in 16ths
+// (Floyd-Steinberg) or 8ths (Atkinson) of a gray level; current is the
+// line's error row, next and after those of the two lines below it
+// x0 must be a multiple of 8; next[x] is final once x + 2 is diffused
+static void rasterDiffuseSpan (unsigned char dither, int threshold, unsigned char const * gray, long x0, long x1,
+                               int * current, int * next, int * after, RasterCarry * carry, unsigned char * line)
+{
+    int shift = (dither == STARIO_DITHER_FLOYD_STEINBERG)?4:3;
+    int half = 1 << (shift - 1);
+    unsigned int bits = carry->bits;
+
+    // branch free - a black pixel is 1 in black, and keeps its whole value
+    // as error; error passed along the line and to the next line's
+    // neighbouring pixels is carried in registers and stored once
+    long x = x0;
+    if (dither == STARIO_DITHER_FLOYD_STEINBERG)
+    {
+        int right = carry->right;
+        int belowLeft = carry->belowLeft;
+        int below = carry->below;
+
+        for (; x < x1; x++)
+        {
+            int value = gray[x] + ((current[x] + right + half) >> shift);
+            int black = (value < threshold);
+            int error = value - 255 + black * 255;
+
+            bits = (bits << 1) | black;
+
+            if ((x % 8) == 7)
+            {
+                line[x / 8] = (unsigned char) bits;
+            }
+
+            right = error * 7;
+            next[x - 1] = belowLeft + error * 3;
+            belowLeft = below + error * 5;
+            below = error;
+        }
+
+        carry->right = right;
+        carry->belowLeft = belowLeft;
+        carry->below = below;
+    }
+    else
+    {
+        // Atkinson passes on 6/8 of the error, keeping highlights and shadows clean
+        int right = carry->right;
+        int rightNext = carry->rightNext;
+        int left = carry->left;
+        int leftLeft = carry->leftLeft;
+
+        for (; x < x1; x++)
+        {
+            int value = gray[x] + ((current[x] + right + half) >> shift);
+            int black = (value < threshold);
+            int error = value - 255 + black * 255;
+
+            bits = (bits << 1) | black;
+
+            if ((x % 8) == 7)
+            {
+                line[x / 8] = (unsigned char) bits;
+            }
+
+            right = rightNext + error;
+            rightNext = error;
+            next[x - 1] += leftLeft + left + error;
+            after[x] += error;
+            leftLeft = left;
+            left = error;
+        }
+
+        carry->right = right;
+        carry->rightNext = rightNext;
+        carry->left = left;
+        carry->leftLeft = leftLeft;
+    }
+
+    carry->bits = bits;
+}
+
+// completes a line diffused up to width - the last error below it, and the
+// dots of a last partial byte
+static void rasterDiffuseEnd (unsigned char dither, long width, int * next, RasterCarry * carry, unsigned char * line)
+{
+    if (dither == STARIO_DITHER_FLOYD_STEINBERG)
+    {
+        next[width - 1] = carry->belowLeft;
+    }
+    else
+    {
+        next[width - 1] += carry->leftLeft + carry->left;
+    }
+
+    if ((width % 8) != 0)
+    {
+        line[width / 8] = (unsigned char) (carry->bits << (8 - width % 8));
+    }
+}
+
+// error diffusion of one line - only the current line's errors and the two
+// below it are kept
+static void rasterDiffuseLine (RasterConverter * converter, unsigned char const * gray, unsigned char * line)
+{
+    int * current = converter->rows[0];
+    int * next = converter->rows[1];
+    int * after = converter->rows[2];
+
+    RasterCarry carry;
+
+    memset(&carry, 0x00, sizeof(RasterCarry));
+
+    rasterDiffuseSpan(converter->dither, converter->threshold, gray, 0, converter->width, current, next, after, &carry, line);
+    rasterDiffuseEnd(converter->dither, converter->width, next, &carry, line);
+
+    memset(current - 2, 0x00, (converter->width + 4) * sizeof(int));
+
+    converter->rows[0] = next;
+    converter->rows[1] = after;
+    converter->rows[2] = current;
+}
+
+// error diffusion by several threads - each takes the next line and diffuses
+// it a span at a time, starting a span only once the line above has
+// diffused past its end, so that every error it reads is final; the lines
+// in flight share a ring of error rows, and diffused lines are handed to
+// the converter in order through a ring of lines
+typedef struct RasterWavefront
+{
+    unsigned char const * gray;
+    long width;
+    long height;
+    long stride;
+    long lineLength;
+    unsigned char threshold;
+    unsigned char dither;
+    long numRows;                       // error rows - 2 more than the lines in flight
+    int * errors;                       // numRows rows of width + 4
+    long * progress;                    // per error row, y * (width + 1) + pixels of line y diffused, the next line's start once complete
+    long numLines;                      // diffused lines held for the converter
+    unsigned char * lines;
+    long * lineY;                       // line held by each entry of lines, -1 if none
+    long nextLine;                      // next line for a thread to diffuse
+    long taken;                         // lines taken by the converter
+    unsigned char abort;
+    pthread_t threads[RASTER_MAX_WORKERS];
+    long numThreads;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} RasterWavefront;
+
+static void * rasterWavefrontThread (void * arg)
+{
+    RasterWavefront * wavefront = (RasterWavefront *) arg;
+
+    long width = wavefront->width;
+    long numRows = wavefront->numRows;
+
+    pthread_mutex_lock(&wavefront->lock);
+
+    while (1)
+    {
+        // a line is not diffused before the one numLines above it is taken
+        while ((wavefront->abort == 0) &&
+               (wavefront->nextLine < wavefront->height) &&
+               (wavefront->nextLine - wavefront->taken >= wavefront->numLines))
+        {
+            pthread_cond_wait(&wavefront->changed, &wavefront->lock);
+        }
+
+        if ((wavefront->abort) || (wavefront->nextLine == wavefront->height))
+        {
+            break;
+        }
+
+        long y = wavefront->nextLine++;
+
+        wavefront->progress[y % numRows] = y * (width + 1);
+
+        int * current = wavefront->errors + 2 + (y % numRows) * (width + 4);
+        int * next = wavefront->errors + 2 + ((y + 1) % numRows) * (width + 4);
+        int * after = wavefront->errors + 2 + ((y + 2) % numRows) * (width + 4);
+
+        unsigned char const * gray = wavefront->gray + y * wavefront->stride;
+        unsigned char * line = wavefront->lines + (y % wavefront->numLines) * wavefront->lineLength;
+
+        RasterCarry carry;
+
+        memset(&carry, 0x00, sizeof(RasterCarry));
+
+        long x0 = 0;
+        while (1)
+        {
+            long x1 = (width - x0 > RASTER_WAVE_SPAN)?(x0 + RASTER_WAVE_SPAN):width;
+
+            // errors for x0 ~ x1 - 1 are final once the line above has diffused x1
+            while ((y > 0) && (wavefront->abort == 0) &&
+                   (wavefront->progress[(y - 1) % numRows] < (y - 1) * (width + 1) + x1 + 1))
+            {
+                pthread_cond_wait(&wavefront->changed, &wavefront->lock);
+            }
+
+            if (wavefront->abort)
+            {
+                break;
+            }
+
+            pthread_mutex_unlock(&wavefront->lock);
+
+            rasterDiffuseSpan(wavefront->dither, wavefront->threshold, gray, x0, x1, current, next, after, &carry, line);
+
+            if (x1 == width)
+            {
+                rasterDiffuseEnd(wavefront->dither, width, next, &carry, line);
+
+                memset(current - 2, 0x00, (width + 4) * sizeof(int));
+            }
+
+            pthread_mutex_lock(&wavefront->lock);
+
+            wavefront->progress[y % numRows] = y * (width + 1) + ((x1 == width)?(width + 1):x1);
+
+            if (x1 == width)
+            {
+                wavefront->lineY[y % wavefront->numLines] = y;
+            }
+
+            pthread_cond_broadcast(&wavefront->changed);
+
+            if (x1 == width)
+            {
+                break;
+            }
+
+            x0 = x1;
+        }
+    }
+
+    pthread_mutex_unlock(&wavefront->lock);
+
+    return NULL;
+}
+
+// starts up to numThreads threads diffusing the converter's image; if none
+// can be started, the converter diffuses alone
+static long rasterWavefrontStart (RasterWavefront * wavefront, RasterConverter * converter, long numThreads)
+{
+    memset(wavefront, 0x00, sizeof(RasterWavefront));
+
+    if (numThreads > RASTER_MAX_WORKERS)
+    {
+        numThreads = RASTER_MAX_WORKERS;
+    }
+
+    wavefront->gray = converter->gray;
+    wavefront->width = converter->width;
+    wavefront->height = converter->height;
+    wavefront->stride = converter->stride;
+    wavefront->lineLength = (converter->width + 7) / 8;
+    wavefront->threshold = converter->threshold;
+    wavefront->dither = converter->dither;
+    wavefront->numRows = numThreads + 2;
+    wavefront->numLines = RASTER_STRIPE_LENGTH / wavefront->lineLength;
+
+    if (wavefront->numLines < numThreads * 2)
+    {
+        wavefront->numLines = numThreads * 2;
+    }
+
+    wavefront->errors = (int *) calloc(wavefront->numRows * (wavefront->width + 4), sizeof(int));
+    wavefront->progress = (long *) calloc(wavefront->numRows, sizeof(long));
+    wavefront->lines = (unsigned char *) malloc(wavefront->numLines * wavefront->lineLength);
+    wavefront->lineY = (long *) malloc(wavefront->numLines * sizeof(long));
+
+    if ((wavefront->errors == NULL) || (wavefront->progress == NULL) || (wavefront->lines == NULL) || (wavefront->lineY == NULL))
+    {
+        free(wavefront->errors);
+        free(wavefront->progress);
+        free(wavefront->lines);
+        free(wavefront->lineY);
+
+        return STARIO_ERROR_RUNTIME;
+    }
+
+    long i = 0;
+    for (; i < wavefront->numLines; i++)
+    {
+        wavefront->lineY[i] = -1;
+    }
+
+    pthread_mutex_init(&wavefront->lock, NULL);
+    pthread_cond_init(&wavefront->changed, NULL);
+
+    for (; wavefront->numThreads < numThreads; wavefront->numThreads++)
+    {
+        if (pthread_create(&wavefront->threads[wavefront->numThreads], NULL, rasterWavefrontThread, wavefront) != 0)
+        {
+            break;
+        }
+    }
+
+    if (wavefront->numThreads > 0)
+    {
+        converter->wavefront = wavefront;
+    }
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+static void rasterWavefrontStop (RasterWavefront * wavefront, RasterConverter * converter)
+{
+    pthread_mutex_lock(&wavefront->lock);
+
+    wavefront->abort = 1;
+
+    pthread_cond_broadcast(&wavefront->changed);
+    pthread_mutex_unlock(&wavefront->lock);
+
+    long i = 0;
+    for (; i < wavefront->numThreads; i++)
+    {
+        pthread_join(wavefront->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&wavefront->changed);
+    pthread_mutex_destroy(&wavefront->lock);
+
+    free(wavefront->errors);
+    free(wavefront->progress);
+    free(wavefront->lines);
+    free(wavefront->lineY);
+
+    converter->wavefront = NULL;
+}
+
+// lines are taken in order from 0
+static void rasterWavefrontTake (RasterWavefront * wavefront, long y, unsigned char * line)
+{
+    long entry = y % wavefront->numLines;
+
+    pthread_mutex_lock(&wavefront->lock);
+
+    while (wavefront->lineY[entry] != y)
+    {
+        pthread_cond_wait(&wavefront->changed, &wavefront->lock);
+    }
+
+    memcpy(line, wavefront->lines + entry * wavefront->lineLength, wavefront->lineLength);
+
+    wavefront->lineY[entry] = -1;
+    wavefront->taken = y + 1;
+
+    pthread_cond_broadcast(&wavefront->changed);
+    pthread_mutex_unlock(&wavefront->lock);
+}
+
+// lines must be converted in order from 0 for error diffusion
+void rasterConvertLine (RasterConverter * converter, long y, unsigned char * line)
+{
+    if (converter->wavefront != NULL)
+    {
+        rasterWavefrontTake(converter->wavefront, y, line);
+        return;
+    }
+
+    unsigned char const * gray = converter->gray + y * converter->stride;
+
+    unsigned char thresholds[8];
+
+    switch (converter->dither)
+    {
+        case STARIO_DITHER_ORDERED:
+        {
+            // black below 2 ~ 254, so pure black and pure white stay solid
+            long i = 0;
+            for (; i < 8; i++)
+            {
+                thresholds[i] = rasterBayer[y % 8][i] * 4 + 2;
+            }
+
+            rasterPackLine(gray, converter->width, thresholds, line);
+            break;
+        }
+
+        case STARIO_DITHER_FLOYD_STEINBERG:
+        case STARIO_DITHER_ATKINSON:
+            rasterDiffuseLine(converter, gray, line);
+            break;
+
+        default:
+            memset(thresholds, converter->threshold, sizeof(thresholds));
+
+            rasterPackLine(gray, converter->width, thresholds, line);
+            break;
+    }
+}
+
+void rasterConverterRelease (RasterConverter * converter)
+{
+    if (converter->errors != NULL)
+    {
+        free(converter->errors);
+    }
+
+    memset(converter, 0x00, sizeof(RasterConverter));
+}
+
+static unsigned char const rasterHeader[RASTER_HEADER_LENGTH] =
+{
+    0x1b, '*', 'r', 'R',                // initialise raster mode
+    0x1b, '*', 'r', 'A',                // enter raster mode
+    0x1b, '*', 'r', 'E', '1', 0x00,     // eot mode
+    0x1b, '*', 'r', 'P', '0', 0x00      // page length - continuous
+};
+
+long rasterEncoderInit (RasterEncoder * encoder, unsigned char const * gray, long width, long height, long stride, RasterOptions const * options)
+{
+    memset(encoder, 0x00, sizeof(RasterEncoder));
+
+    long lineLength = (width + 7) / 8;
+
+    if ((gray == NULL) || (width <= 0) || (height <= 0) || (stride < width) || (lineLength > 0xffff))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    if ((options != NULL) && (options->dither > STARIO_DITHER_ATKINSON))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    encoder->lineLength = lineLength;
+    encoder->height = height;
+    encoder->y = -1;
+    encoder->yEnd = height;
+    encoder->footer = 1;
+    encoder->cut = 1;
+    encoder->compact = 1;
+
+    if (options != NULL)
+    {
+        encoder->cut = options->cut;
+        encoder->compact = options->compact;
+    }
+
+    if (encoder->compact)
+    {
+        encoder->line = (unsigned char *) malloc(lineLength);
+
+        if (encoder->line == NULL)
+        {
+            return STARIO_ERROR_RUNTIME;
+        }
+    }
+
+    return rasterConverterInit(&encoder->converter, gray, width, height, stride, options);
+}
+
+long rasterEncoderLength (RasterEncoder * encoder)
+{
+    long maxLineLength = RASTER_LINE_HEADER + encoder->lineLength;
+
+    // a line skipped on its own costs a whole skip command, which is longer than very narrow lines
+    if ((encoder->compact) && (maxLineLength < RASTER_SKIP_MAX_LENGTH))
+    {
+        maxLineLength = RASTER_SKIP_MAX_LENGTH;
+    }
+
+    long length = RASTER_HEADER_LENGTH + maxLineLength * encoder->height + RASTER_FOOTER_LENGTH;
+
+    if (encoder->cut)
+    {
+        length += RASTER_CUT_LENGTH;
+    }
+
+    return length;
+}
+
+long rasterEncoderMinBand (RasterEncoder * encoder)
+{
+    long minBand = RASTER_LINE_HEADER + encoder->lineLength;
+
+    if (minBand < RASTER_HEADER_LENGTH)
+    {
+        minBand = RASTER_HEADER_LENGTH;
+    }
+
+    if (minBand < RASTER_FOOTER_LENGTH + RASTER_CUT_LENGTH)
+    {
+        minBand = RASTER_FOOTER_LENGTH + RASTER_CUT_LENGTH;
+    }
+
+    if (minBand < RASTER_SKIP_MAX_LENGTH)
+    {
+        minBand = RASTER_SKIP_MAX_LENGTH;
+    }
+
+    return minBand;
+}
+
+long rasterEncoderStripe (RasterEncoder * encoder, long y0, long y1)
+{
+    // error diffusion carries error from every line into the next, so it
+    // only converts the whole image in one pass
+    if ((y0 > 0) && (encoder->converter.errors != NULL))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    encoder->yEnd = y1;
+    encoder->footer = (y1 == encoder->height)?1:0;
+
+    if (y0 > 0)
+    {
+        encoder->y = y0;
+        encoder->leading = 1;
+    }
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// ESC * r Y n NUL for the next RASTER_SKIP_MAX_LINES or fewer of blankLines
+// returns the command's length
+static long rasterSkipCommand (long * blankLines, char * skip)
+{
+    long skipLines = (*blankLines > RASTER_SKIP_MAX_LINES)?RASTER_SKIP_MAX_LINES:*blankLines;
+
+    *blankLines -= skipLines;
+
+    return snprintf(skip, RASTER_SKIP_MAX_LENGTH, "\x1b*rY%ld", skipLines) + 1;
+}
+
+// fills band with the next whole commands of the job that fit
+long rasterEncodeBand (RasterEncoder * encoder, unsigned char * band, long bandLength)
+{
+    long bandIdx = 0;
+
+    if (encoder->y < 0)
+    {
+        if (bandLength < RASTER_HEADER_LENGTH)
+        {
+            return bandIdx;
+        }
+
+        memcpy(band, rasterHeader, RASTER_HEADER_LENGTH);
+        bandIdx += RASTER_HEADER_LENGTH;
+
+        encoder->y = 0;
+    }
+
+    long lineLength = encoder->lineLength;
+
+    if (encoder->compact)
+    {
+        while (1)
+        {
+            if ((encoder->lineInk == 0) && (encoder->y < encoder->yEnd))
+            {
+                rasterConvertLine(&encoder->converter, encoder->y, encoder->line);
+                encoder->y++;
+
+                encoder->lineInk = rasterInkLength(encoder->line, lineLength);
+
+                if (encoder->lineInk == 0)
+                {
+                    encoder->blankLines++;
+                    continue;
+                }
+            }
+
+            // a stripe leaves the blank lines it ends with to the writer
+            if ((encoder->lineInk == 0) && (encoder->footer == 0))
+            {
+                break;
+            }
+
+            // and those it starts with
+            if (encoder->leading)
+            {
+                encoder->leadBlank = encoder->blankLines;
+                encoder->blankLines = 0;
+                encoder->leading = 0;
+            }
+
+            // blank lines before this one - or before the footer - become paper feed
+            while (encoder->blankLines > 0)
+            {
+                long blankLines = encoder->blankLines;
+
+                char skip[RASTER_SKIP_MAX_LENGTH];
+                long skipLength = rasterSkipCommand(&blankLines, skip);
+
+                if (bandLength - bandIdx < skipLength)
+                {
+                    return bandIdx;
+                }
+
+                memcpy(band + bandIdx, skip, skipLength);
+                bandIdx += skipLength;
+
+                encoder->blankLines = blankLines;
+            }
+
+            if (encoder->lineInk == 0)
+            {
+                break;
+            }
+
+            // white bytes past the last black dot are left to the device
+            if (bandLength - bandIdx < RASTER_LINE_HEADER + encoder->lineInk)
+            {
+                return bandIdx;
+            }
+
+            band[bandIdx++] = 'b';
+            band[bandIdx++] = (unsigned char) (encoder->lineInk % 0x0100);
+            band[bandIdx++] = (unsigned char) (encoder->lineInk / 0x0100);
+
+            memcpy(band + bandIdx, encoder->line, encoder->lineInk);
+            bandIdx += encoder->lineInk;
+
+            encoder->lineInk = 0;
+        }
+    }
+
+    for (; encoder->y < encoder->yEnd; encoder->y++)
+    {
+        if (bandLength - bandIdx < RASTER_LINE_HEADER + lineLength)
+        {
+            return bandIdx;
+        }
+
+        band[bandIdx++] = 'b';
+        band[bandIdx++] = (unsigned char) (lineLength % 0x0100);
+        band[bandIdx++] = (unsigned char) (lineLength / 0x0100);
+
+        rasterConvertLine(&encoder->converter, encoder->y, band + bandIdx);
+        bandIdx += lineLength;
+    }
+
+    if ((encoder->y == encoder->yEnd) && (encoder->finished == 0))
+    {
+        if (encoder->footer)
+        {
+            if (bandLength - bandIdx < RASTER_FOOTER_LENGTH + ((encoder->cut)?RASTER_CUT_LENGTH:0))
+            {
+                return bandIdx;
+            }
+
+            band[bandIdx++] = 0x1b;
+            band[bandIdx++] = '*';
+            band[bandIdx++] = 'r';
+            band[bandIdx++] = 'B';
+
+            if (encoder->cut)
+            {
+                band[bandIdx++] = 0x1b;
+                band[bandIdx++] = 'd';
+                band[bandIdx++] = '3';
+            }
+        }
+
+        encoder->finished = 1;
+    }
+
+    return bandIdx;
+}
+
+void rasterEncoderRelease (RasterEncoder * encoder)
+{
+    if (encoder->line != NULL)
+    {
+        free(encoder->line);
+    }
+
+    rasterConverterRelease(&encoder->converter);
+
+    memset(encoder, 0x00, sizeof(RasterEncoder));
+}
+
+long buildRasterJob (unsigned char const * gray, long width, long height, long stride,
+                     RasterOptions const * options, unsigned char * job, long jobLength)
+{
+    RasterEncoder encoder;
+
+    long result = rasterEncoderInit(&encoder, gray, width, height, stride, options);
+
+    if (result == STARIO_ERROR_SUCCESS)
+    {
+        result = rasterEncoderLength(&encoder);
+
+        if (job != NULL)
+        {
+            if (jobLength < result)
+            {
+                result = STARIO_ERROR_NOT_AVAILABLE;
+            }
+            else
+            {
+                result = rasterEncodeBand(&encoder, job, jobLength);
+            }
+        }
+    }
+
+    rasterEncoderRelease(&encoder);
+
+    return result;
+}
+
+// streaming - an encoder thread fills a ring of bands while the caller's
+// thread writes the bands already filled, so memory use does not grow with
+// the image and output starts after the first band
+
+typedef struct
+{
+    RasterEncoder * encoder;
+    unsigned char * bands[RASTER_NUM_BANDS];
+    long lengths[RASTER_NUM_BANDS];
+    long bandLength;
+    long filled;                        // bands encoded so far
+    long sent;                          // bands written so far
+    unsigned char finished;             // the encoder has produced the last band
+    unsigned char abort;                // the writer has given up
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} RasterRing;
+
+static void * rasterEncodeThread (void * arg)
+{
+    RasterRing * ring = (RasterRing *) arg;
+
+    while (1)
+    {
+        pthread_mutex_lock(&ring->lock);
+
+        while ((ring->filled - ring->sent == RASTER_NUM_BANDS) && (ring->abort == 0))
+        {
+            pthread_cond_wait(&ring->changed, &ring->lock);
+        }
+
+        if (ring->abort)
+        {
+            pthread_mutex_unlock(&ring->lock);
+            break;
+        }
+
+        long slot = ring->filled % RASTER_NUM_BANDS;
+
+        pthread_mutex_unlock(&ring->lock);
+
+        long length = rasterEncodeBand(ring->encoder, ring->bands[slot], ring->bandLength);
+
+        pthread_mutex_lock(&ring->lock);
+
+        if (length > 0)
+        {
+            ring->lengths[slot] = length;
+            ring->filled++;
+        }
+        else
+        {
+            ring->finished = 1;
+        }
+
+        pthread_cond_broadcast(&ring->changed);
+        pthread_mutex_unlock(&ring->lock);
+
+        if (length <= 0)
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+// with error diffusion, numWorkers threads diffuse the image for the encoder thread
+static long rasterWriteBands (unsigned char const * gray, long width, long height, long stride,
+                              RasterOptions const * options, long numWorkers, RasterWriteFn writeFn, void * port)
+{
+    RasterEncoder encoder;
+
+    long result = rasterEncoderInit(&encoder, gray, width, height, stride, options);
+
+    if (result != STARIO_ERROR_SUCCESS)
+    {
+        rasterEncoderRelease(&encoder);
+
+        return result;
+    }
+
+    RasterRing ring;
+
+    memset(&ring, 0x00, sizeof(RasterRing));
+
+    ring.encoder = &encoder;
+    ring.bandLength = rasterEncoderMinBand(&encoder);
+
+    if (ring.bandLength < RASTER_BAND_LENGTH)
+    {
+        ring.bandLength = RASTER_BAND_LENGTH;
+    }
+
+    // one allocation for the whole ring
+    ring.bands[0] = (unsigned char *) malloc(ring.bandLength * RASTER_NUM_BANDS);
+
+    if (ring.bands[0] == NULL)
+    {
+        rasterEncoderRelease(&encoder);
+
+        return STARIO_ERROR_RUNTIME;
+    }
+
+    long i = 1;
+    for (; i < RASTER_NUM_BANDS; i++)
+    {
+        ring.bands[i] = ring.bands[0] + ring.bandLength * i;
+    }
+
+    RasterWavefront wavefront;
+
+    if ((numWorkers > 1) && (encoder.converter.errors != NULL))
+    {
+        if (rasterWavefrontStart(&wavefront, &encoder.converter, numWorkers) != STARIO_ERROR_SUCCESS)
+        {
+            free(ring.bands[0]);
+
+            rasterEncoderRelease(&encoder);
+
+            return STARIO_ERROR_RUNTIME;
+        }
+    }
+
+    pthread_mutex_init(&ring.lock, NULL);
+    pthread_cond_init(&ring.changed, NULL);
+
+    pthread_t encodeThread;
+
+    if (pthread_create(&encodeThread, NULL, rasterEncodeThread, &ring) != 0)
+    {
+        result = STARIO_ERROR_RUNTIME;
+    }
+    else
+    {
+        while (1)
+        {
+            pthread_mutex_lock(&ring.lock);
+
+            while ((ring.filled == ring.sent) && (ring.finished == 0))
+            {
+                pthread_cond_wait(&ring.changed, &ring.lock);
+            }
+
+            if (ring.filled == ring.sent)
+            {
+                pthread_mutex_unlock(&ring.lock);
+                break;
+            }
+
+            long slot = ring.sent % RASTER_NUM_BANDS;
+
+            pthread_mutex_unlock(&ring.lock);
+
+            long writeResult = writeFn(port, (char const *) ring.bands[slot], ring.lengths[slot]);
+
+            pthread_mutex_lock(&ring.lock);
+
+            if (writeResult != ring.lengths[slot])
+            {
+                result = (writeResult < STARIO_ERROR_SUCCESS)?writeResult:STARIO_ERROR_IO_FAIL;
+
+                ring.abort = 1;
+            }
+            else
+            {
+                ring.sent++;
+            }
+
+            pthread_cond_broadcast(&ring.changed);
+            pthread_mutex_unlock(&ring.lock);
+
+            if (result != STARIO_ERROR_SUCCESS)
+            {
+                break;
+            }
+        }
+
+        pthread_join(encodeThread, NULL);
+    }
+
+    // the encoder thread has taken its last line
+    if (encoder.converter.wavefront != NULL)
+    {
+        rasterWavefrontStop(&wavefront, &encoder.converter);
+    }
+
+    pthread_cond_destroy(&ring.changed);
+    pthread_mutex_destroy(&ring.lock);
+
+    free(ring.bands[0]);
+
+    rasterEncoderRelease(&encoder);
+
+    return result;
+}
+
+// parallel streaming - workers take stripes in order, each encoding a whole
+// stripe into a slot of its own, while the caller's thread writes the
+// slots in stripe order; a worker waits when it would get more than the
+// slots ahead of the writer
+
+typedef struct
+{
+    unsigned char const * gray;
+    long width;
+    long height;
+    long stride;
+    RasterOptions const * options;
+    long stripeLines;
+    long numStripes;
+    unsigned char * slots[RASTER_MAX_SLOTS];
+    long lengths[RASTER_MAX_SLOTS];     // encoded length, -1 while the stripe in the slot is not ready
+    long leadBlank[RASTER_MAX_SLOTS];   // compact - blank lines the stripe starts with, not encoded
+    long trailBlank[RASTER_MAX_SLOTS];  // compact - blank lines the stripe ends with, not encoded
+    long numSlots;
+    long slotLength;
+    long nextStripe;                    // next stripe to hand to a worker
+    long sent;                          // stripes written so far
+    long result;                        // first worker failure
+    unsigned char abort;                // stop the workers
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} RasterStripes;
+
+static long rasterEncodeStripe (RasterStripes * stripes, long stripe, unsigned char * slot, long * leadBlank, long * trailBlank)
+{
+    RasterEncoder encoder;
+
+    long result = rasterEncoderInit(&encoder, stripes->gray, stripes->width, stripes->height, stripes->stride, stripes->options);
+
+    long y0 = stripe * stripes->stripeLines;
+    long y1 = y0 + stripes->stripeLines;
+
+    if (y1 > stripes->height)
+    {
+        y1 = stripes->height;
+    }
+
+    if (result == STARIO_ERROR_SUCCESS)
+    {
+        result = rasterEncoderStripe(&encoder, y0, y1);
+    }
+
+    if (result == STARIO_ERROR_SUCCESS)
+    {
+        // the slot holds the whole stripe
+        result = rasterEncodeBand(&encoder, slot, stripes->slotLength);
+
+        if (encoder.finished == 0)
+        {
+            result = STARIO_ERROR_RUNTIME;
+        }
+
+        *leadBlank = encoder.leadBlank;
+        *trailBlank = encoder.blankLines;
+    }
+
+    rasterEncoderRelease(&encoder);
+
+    return result;
+}
+
+static void * rasterStripeThread (void * arg)
+{
+    RasterStripes * stripes = (RasterStripes *) arg;
+
+    pthread_mutex_lock(&stripes->lock);
+
+    while (1)
+    {
+        while ((stripes->abort == 0) &&
+               (stripes->nextStripe < stripes->numStripes) &&
+               (stripes->nextStripe - stripes->sent >= stripes->numSlots))
+        {
+            pthread_cond_wait(&stripes->changed, &stripes->lock);
+        }
+
+        if ((stripes->abort) || (stripes->nextStripe == stripes->numStripes))
+        {
+            break;
+        }
+
+        long stripe = stripes->nextStripe++;
+        long slot = stripe % stripes->numSlots;
+
+        pthread_mutex_unlock(&stripes->lock);
+
+        long leadBlank = 0;
+        long trailBlank = 0;
+
+        long length = rasterEncodeStripe(stripes, stripe, stripes->slots[slot], &leadBlank, &trailBlank);
+
+        pthread_mutex_lock(&stripes->lock);
+
+        if (length < STARIO_ERROR_SUCCESS)
+        {
+            if (stripes->result == STARIO_ERROR_SUCCESS)
+            {
+                stripes->result = length;
+            }
+
+            stripes->abort = 1;
+        }
+        else
+        {
+            stripes->lengths[slot] = length;
+            stripes->leadBlank[slot] = leadBlank;
+            stripes->trailBlank[slot] = trailBlank;
+        }
+
+        pthread_cond_broadcast(&stripes->changed);
+    }
+
+    pthread_mutex_unlock(&stripes->lock);
+
+    return NULL;
+}
+
+// writes the skip commands for blankLines, in one write unless the run is very long
+static long rasterWriteSkip (long blankLines, RasterWriteFn writeFn, void * port)
+{
+    char skips[RASTER_SKIP_MAX_LENGTH * 32];
+
+    while (blankLines > 0)
+    {
+        long length = 0;
+
+        while ((blankLines > 0) && (length + RASTER_SKIP_MAX_LENGTH <= (long) sizeof(skips)))
+        {
+            length += rasterSkipCommand(&blankLines, skips + length);
+        }
+
+        long writeResult = writeFn(port, skips, length);
+
+        if (writeResult != length)
+        {
+            return (writeResult < STARIO_ERROR_SUCCESS)?writeResult:STARIO_ERROR_IO_FAIL;
+        }
+    }
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+static long rasterWriteStripes (RasterStripes * stripes, long numWorkers, RasterWriteFn writeFn, void * port)
+{
+    pthread_t workers[RASTER_MAX_WORKERS];
+
+    long numStarted = 0;
+    for (; numStarted < numWorkers; numStarted++)
+    {
+        if (pthread_create(&workers[numStarted], NULL, rasterStripeThread, stripes) != 0)
+        {
+            break;
+        }
+    }
+
+    long result = STARIO_ERROR_SUCCESS;
+
+    if (numStarted == 0)
+    {
+        result = STARIO_ERROR_RUNTIME;
+    }
+
+    long blankLines = 0;
+
+    long stripe = 0;
+    for (; (result == STARIO_ERROR_SUCCESS) && (stripe < stripes->numStripes); stripe++)
+    {
+        long slot = stripe % stripes->numSlots;
+
+        pthread_mutex_lock(&stripes->lock);
+
+        while ((stripes->lengths[slot] < 0) && (stripes->abort == 0))
+        {
+            pthread_cond_wait(&stripes->changed, &stripes->lock);
+        }
+
+        if (stripes->lengths[slot] < 0)
+        {
+            result = stripes->result;
+
+            pthread_mutex_unlock(&stripes->lock);
+            break;
+        }
+
+        long length = stripes->lengths[slot];
+
+        pthread_mutex_unlock(&stripes->lock);
+
+        // a run of blank lines across stripes is skipped as in a single pass
+        blankLines += stripes->leadBlank[slot];
+
+        if (length > 0)
+        {
+            result = rasterWriteSkip(blankLines, writeFn, port);
+
+            blankLines = 0;
+        }
+
+        if ((result == STARIO_ERROR_SUCCESS) && (length > 0))
+        {
+            long writeResult = writeFn(port, (char const *) stripes->slots[slot], length);
+
+            if (writeResult != length)
+            {
+                result = (writeResult < STARIO_ERROR_SUCCESS)?writeResult:STARIO_ERROR_IO_FAIL;
+            }
+        }
+
+        blankLines += stripes->trailBlank[slot];
+
+        pthread_mutex_lock(&stripes->lock);
+
+        stripes->lengths[slot] = -1;
+        stripes->sent++;
+
+        if (result != STARIO_ERROR_SUCCESS)
+        {
+            stripes->abort = 1;
+        }
+
+        pthread_cond_broadcast(&stripes->changed);
+        pthread_mutex_unlock(&stripes->lock);
+    }
+
+    long i = 0;
+    for (; i < numStarted; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    return result;
+}
+
+long rasterWriteImage (unsigned char const * gray, long width, long height, long stride,
+                       RasterOptions const * options, RasterWriteFn writeFn, void * port)
+{
+    return rasterWriteImageWorkers(gray, width, height, stride, options, sysconf(_SC_NPROCESSORS_ONLN), writeFn, port);
+}
+
+long rasterWriteImageWorkers (unsigned char const * gray, long width, long height, long stride,
+                              RasterOptions const * options, long numWorkers, RasterWriteFn writeFn, void * port)
+{
+    if (numWorkers > RASTER_MAX_WORKERS)
+    {
+        numWorkers = RASTER_MAX_WORKERS;
+    }
+
+    // every line of an error diffused image depends on the one above it, so
+    // it is not striped but diffused a line per thread in a wavefront
+    if ((options != NULL) &&
+        ((options->dither == STARIO_DITHER_FLOYD_STEINBERG) || (options->dither == STARIO_DITHER_ATKINSON)))
+    {
+        return rasterWriteBands(gray, width, height, stride, options, (height > RASTER_STRIPE_MIN_LINES)?numWorkers:1, writeFn, port);
+    }
+
+    // invalid images are reported by the single threaded path
+    long lineLength = (width + 7) / 8;
+    long maxLineLength = RASTER_LINE_HEADER + lineLength;
+
+    if (maxLineLength < RASTER_SKIP_MAX_LENGTH)
+    {
+        maxLineLength = RASTER_SKIP_MAX_LENGTH;
+    }
+
+    long stripeLines = RASTER_STRIPE_LENGTH / maxLineLength;
+
+    if (stripeLines < RASTER_STRIPE_MIN_LINES)
+    {
+        stripeLines = RASTER_STRIPE_MIN_LINES;
+    }
+
+    if ((numWorkers < 2) || (width <= 0) || (height <= stripeLines) || (lineLength > 0xffff))
+    {
+        return rasterWriteBands(gray, width, height, stride, options, 1, writeFn, port);
+    }
+
+    RasterStripes stripes;
+
+    memset(&stripes, 0x00, sizeof(RasterStripes));
+
+    stripes.gray = gray;
+    stripes.width = width;
+    stripes.height = height;
+    stripes.stride = stride;
+    stripes.options = options;
+    stripes.stripeLines = stripeLines;
+    stripes.numStripes = (height + stripeLines - 1) / stripeLines;
+    stripes.numSlots = numWorkers * 2;
+    stripes.slotLength = RASTER_HEADER_LENGTH + maxLineLength * stripeLines + RASTER_FOOTER_LENGTH + RASTER_CUT_LENGTH;
+
+    // check the image and options once, before any worker starts
+    RasterEncoder encoder;
+
+    long result = rasterEncoderInit(&encoder, gray, width, height, stride, options);
+
+    rasterEncoderRelease(&encoder);
+
+    if (result != STARIO_ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    // one allocation for all the slots
+    stripes.slots[0] = (unsigned char *) malloc(stripes.slotLength * stripes.numSlots);
+
+    if (stripes.slots[0] == NULL)
+    {
+        return STARIO_ERROR_RUNTIME;
+    }
+
+    long i = 0;
+    for (; i < stripes.numSlots; i++)
+    {
+        stripes.slots[i] = stripes.slots[0] + stripes.slotLength * i;
+        stripes.lengths[i] = -1;
+    }
+
+    pthread_mutex_init(&stripes.lock, NULL);
+    pthread_cond_init(&stripes.changed, NULL);
+
+    result = rasterWriteStripes(&stripes, numWorkers, writeFn, port);
+
+    pthread_cond_destroy(&stripes.changed);
+    pthread_mutex_destroy(&stripes.lock);
+
+    free(stripes.slots[0]);
+
+    return result;
+}
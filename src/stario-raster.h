@@ -0,0 +1,110 @@
+/*
+    libstario.so
+    ------------
+    Library providing USB, serial, and parallel communications support for
+    Star Micronics devices.
+
+    Copyright (C) 2004 Star Micronics Co., Ltd.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _included_stario_raster
+#define _included_stario_raster
+
+#include "stario-structures.h"
+
+// Star raster graphics generation - shared by the raster api
+
+struct RasterWavefront;
+
+// converts an image to raster lines one line at a time, in order, carrying
+// error diffusion state from each line to the next
+typedef struct
+{
+    unsigned char const * gray;
+    long width;
+    long height;
+    long stride;
+    unsigned char threshold;
+    unsigned char dither;               // StarIODither
+    int * errors;                       // error diffusion - 3 rows of width + 4, NULL otherwise
+    int * rows[3];                      // current line, next line, line after next
+    struct RasterWavefront * wavefront; // error diffusion by several threads - lines are taken from it, NULL otherwise
+} RasterConverter;
+
+// produces a raster job a band at a time - header, lines and footer, each
+// whole in one band
+typedef struct
+{
+    RasterConverter converter;
+    long lineLength;                    // bytes of raster data per line
+    long height;
+    long y;                             // next line to convert, -1 before the header
+    long yEnd;                          // line after the last to encode - height unless a stripe
+    unsigned char footer;               // 1 -> end the job after line yEnd - 1
+    unsigned char finished;
+    unsigned char cut;
+    unsigned char compact;              // trim lines and skip blank ones
+    unsigned char * line;               // compact - converted line waiting for room in a band
+    long lineInk;                       // compact - bytes of line up to its last black dot, 0 if none waiting
+    long blankLines;                    // compact - blank lines not yet skipped
+    unsigned char leading;              // compact stripe - no inked line yet
+    long leadBlank;                     // compact stripe - blank lines before its first inked line, not skipped
+} RasterEncoder;
+
+// transport for rasterWriteImage - a PortImpl writePort
+typedef long (* RasterWriteFn) (void * port, char const * writeBuffer, long length);
+
+// packs one line of gray pixels into 1 bit per pixel, most significant bit
+// first; a pixel prints black when its gray value is below the entry of the
+// 8 entry thresholds row for its column modulo 8, and the last byte is
+// padded with white
+void rasterPackLine         (unsigned char const * gray, long width, unsigned char const * thresholds, unsigned char * line);
+
+long rasterConverterInit    (RasterConverter * converter, unsigned char const * gray, long width, long height, long stride, RasterOptions const * options);
+void rasterConvertLine      (RasterConverter * converter, long y, unsigned char * line);
+void rasterConverterRelease (RasterConverter * converter);
+
+// bytes of line up to and including its last non zero byte
+long rasterInkLength        (unsigned char const * line, long length);
+
+long rasterEncoderInit      (RasterEncoder * encoder, unsigned char const * gray, long width, long height, long stride, RasterOptions const * options);
+// exact, or an upper bound when compact
+long rasterEncoderLength    (RasterEncoder * encoder);
+// smallest band every command of the job fits in
+long rasterEncoderMinBand   (RasterEncoder * encoder);
+// limits the encoder to lines y0 ~ y1 - 1 of the job, with the header only
+// if y0 is 0 and the footer only if y1 is the height; not available past
+// line 0 with error diffusion
+// when compact, blank lines at the start (after line 0) and at the end
+// (before the height) of the stripe are not skipped but left in leadBlank
+// and blankLines, for the writer to join to those of the stripes around it
+long rasterEncoderStripe    (RasterEncoder * encoder, long y0, long y1);
+// returns the length encoded into band, 0 once the job is complete
+long rasterEncodeBand       (RasterEncoder * encoder, unsigned char * band, long bandLength);
+void rasterEncoderRelease   (RasterEncoder * encoder);
+
+// encodes the image and writes it band by band through writeFn
+long rasterWriteImage       (unsigned char const * gray, long width, long height, long stride,
+                             RasterOptions const * options, RasterWriteFn writeFn, void * port);
+// as rasterWriteImage, with up to numWorkers threads in place of one per
+// processor - stripe encoding threads, or with error diffusion threads each
+// diffusing a line a little behind the one above it; the job written is the
+// same for any number
+long rasterWriteImageWorkers(unsigned char const * gray, long width, long height, long stride,
+                             RasterOptions const * options, long numWorkers, RasterWriteFn writeFn, void * port);
+
+#endif
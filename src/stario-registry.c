@@ -0,0 +1,325 @@
+/*
+    libstario.so
+    ------------
+    Library providing USB, serial, and parallel communications support for
+    Star Micronics devices.
+
+    Copyright (C) 2004 Star Micronics Co., Ltd.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "stario-error.h"
+#include "stario-registry.h"
+#include "stario-usb.h"
+#include "stario-parallel.h"
+#include "stario-serial.h"
+#include "stario-tcp.h"
+#include "stario-sim.h"
+
+#define REG_MAX_PREFIX_LENGTH   31
+
+// schemes a plugin has been looked for, found or not
+#define REG_MAX_PLUGINS         16
+
+typedef struct
+{
+    char prefix[REG_MAX_PREFIX_LENGTH + 1];
+    long prefixLength;
+    PortImplFactory factory;
+    unsigned char built;                // if 0, factory not called yet
+    PortImpl impl;                      // as returned by factory
+} RegEntry;
+
+typedef struct
+{
+    char scheme[REG_MAX_PREFIX_LENGTH + 1];
+    void * library;                     // NULL if no usable plugin was found
+} RegPlugin;
+
+// entries are never removed, so handles may keep pointers to their impl
+static RegEntry regEntries[MAX_NUM_IMPLS];
+static long regNumEntries = 0;
+
+static RegPlugin regPlugins[REG_MAX_PLUGINS];
+static long regNumPlugins = 0;
+
+// guards regEntries
+static pthread_mutex_t regLock = PTHREAD_MUTEX_INITIALIZER;
+
+// serialises plugin loading - held without regLock, as a plugin's init
+// function registers its backends
+static pthread_mutex_t regPluginLock = PTHREAD_MUTEX_INITIALIZER;
+
+void regInit (void)
+{
+    memset(regEntries, 0x00, sizeof(regEntries));
+    memset(regPlugins, 0x00, sizeof(regPlugins));
+
+    regNumEntries = 0;
+    regNumPlugins = 0;
+
+    registerPortImpl("usb:",            getUsbPortImpl);
+    registerPortImpl("/dev/parport",    getParPortImpl);
+    registerPortImpl("/dev/ttyS",       getSerPortImpl);
+    registerPortImpl("tcp:",            getTcpPortImpl);
+    registerPortImpl("sim:",            getSimPortImpl);
+}
+
+long registerPortImpl (char const * prefix, PortImplFactory factory)
+{
+    if ((prefix == NULL) || (factory == NULL))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    long prefixLength = strlen(prefix);
+
+    if ((prefixLength == 0) || (prefixLength > REG_MAX_PREFIX_LENGTH))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    pthread_mutex_lock(&regLock);
+
+    long i = 0;
+    for (; i < regNumEntries; i++)
+    {
+        if (strcmp(regEntries[i].prefix, prefix) == 0)
+            break;
+    }
+
+    if ((i < regNumEntries) || (regNumEntries == MAX_NUM_IMPLS))
+    {
+        pthread_mutex_unlock(&regLock);
+
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    RegEntry * entry = &regEntries[regNumEntries];
+
+    strcpy(entry->prefix, prefix);
+    entry->prefixLength = prefixLength;
+    entry->factory = factory;
+    entry->built = 0;
+
+    regNumEntries++;
+
+    pthread_mutex_unlock(&regLock);
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// called with regLock held
+static PortImpl * regFindImplLocked(char const * portName)
+{
+    RegEntry * found = NULL;
+
+    // longest matching prefix - there are only a handful of backends, and
+    // ports are resolved once at open
+    long i = 0;
+    for (; i < regNumEntries; i++)
+    {
+        RegEntry * entry = &regEntries[i];
+
+        if ((found != NULL) && (entry->prefixLength <= found->prefixLength))
+            continue;
+
+        if (strncmp(portName, entry->prefix, entry->prefixLength) == 0)
+            found = entry;
+    }
+
+    if (found == NULL)
+    {
+        return NULL;
+    }
+
+    if (found->built == 0)
+    {
+        found->impl = found->factory();
+        found->built = 1;
+    }
+
+    // a backend whose factory failed (i.e. libusb missing) leaves matchPortName 0
+    if ((found->impl.matchPortName == 0) ||
+        (found->impl.matchPortName(portName) != STARIO_ERROR_SUCCESS))
+    {
+        return NULL;
+    }
+
+    return &found->impl;
+}
+
+// tries STARIO_PLUGIN_INIT of libstario-scheme.so in each plugin directory
+static void * regLoadPlugin(char const * scheme)
+{
+    char const * pluginPath = secure_getenv("STARIO_PLUGIN_PATH");
+
+    if ((pluginPath == NULL) || (pluginPath[0] == 0))
+    {
+        pluginPath = STARIO_PLUGIN_DIR;
+    }
+
+    while (pluginPath[0] != 0)
+    {
+        long dirLength = strcspn(pluginPath, ":");
+
+        char libraryName[PATH_MAX];
+
+        if ((dirLength > 0) &&
+            (dirLength + strlen("/libstario-") + strlen(scheme) + strlen(".so") < sizeof(libraryName)))
+        {
+            memcpy(libraryName, pluginPath, dirLength);
+            strcpy(&libraryName[dirLength], "/libstario-");
+            strcat(libraryName, scheme);
+            strcat(libraryName, ".so");
+
+            void * library = dlopen(libraryName, RTLD_NOW | RTLD_LOCAL);
+
+            if (library != NULL)
+            {
+                StarIOPluginInit pluginInit = (StarIOPluginInit) dlsym(library, STARIO_PLUGIN_INIT);
+
+                if ((pluginInit != NULL) && (pluginInit() == STARIO_ERROR_SUCCESS))
+                {
+                    return library;
+                }
+
+                dlclose(library);
+            }
+        }
+
+        pluginPath += dirLength;
+
+        if (pluginPath[0] == ':')
+        {
+            pluginPath++;
+        }
+    }
+
+    return NULL;
+}
+
+// loads the plugin for the port name's scheme, once per scheme
+static void regLoadPluginFor(char const * portName)
+{
+    long schemeLength = strcspn(portName, ":");
+
+    if ((portName[schemeLength] != ':') || (schemeLength == 0) || (schemeLength > REG_MAX_PREFIX_LENGTH))
+    {
+        return;
+    }
+
+    // the scheme becomes part of a file name
+    long i = 0;
+    for (; i < schemeLength; i++)
+    {
+        char c = portName[i];
+
+        if (! (((c >= 'a') && (c <= 'z')) || ((c >= '0') && (c <= '9')) || (c == '-') || (c == '_')))
+        {
+            return;
+        }
+    }
+
+    char scheme[REG_MAX_PREFIX_LENGTH + 1];
+
+    memcpy(scheme, portName, schemeLength);
+    scheme[schemeLength] = 0;
+
+    pthread_mutex_lock(&regPluginLock);
+
+    for (i = 0; i < regNumPlugins; i++)
+    {
+        if (strcmp(regPlugins[i].scheme, scheme) == 0)
+            break;
+    }
+
+    if ((i == regNumPlugins) && (regNumPlugins < REG_MAX_PLUGINS))
+    {
+        strcpy(regPlugins[i].scheme, scheme);
+        regPlugins[i].library = regLoadPlugin(scheme);
+
+        regNumPlugins++;
+    }
+
+    pthread_mutex_unlock(&regPluginLock);
+}
+
+PortImpl * regFindImpl (char const * portName)
+{
+    pthread_mutex_lock(&regLock);
+
+    PortImpl * impl = regFindImplLocked(portName);
+
+    pthread_mutex_unlock(&regLock);
+
+    if (impl != NULL)
+    {
+        return impl;
+    }
+
+    regLoadPluginFor(portName);
+
+    pthread_mutex_lock(&regLock);
+
+    impl = regFindImplLocked(portName);
+
+    pthread_mutex_unlock(&regLock);
+
+    return impl;
+}
+
+void regRelease (void)
+{
+    pthread_mutex_lock(&regLock);
+
+    long i = regNumEntries - 1;
+    for (; i >= 0; i--)
+    {
+        if ((regEntries[i].built != 0) && (regEntries[i].impl.releaseImpl != 0))
+        {
+            regEntries[i].impl.releaseImpl();
+        }
+    }
+
+    memset(regEntries, 0x00, sizeof(regEntries));
+    regNumEntries = 0;
+
+    pthread_mutex_unlock(&regLock);
+
+    pthread_mutex_lock(&regPluginLock);
+
+    for (i = 0; i < regNumPlugins; i++)
+    {
+        if (regPlugins[i].library != NULL)
+        {
+            dlclose(regPlugins[i].library);
+        }
+    }
+
+    memset(regPlugins, 0x00, sizeof(regPlugins));
+    regNumPlugins = 0;
+
+    pthread_mutex_unlock(&regPluginLock);
+}
@@ -0,0 +1,72 @@
+/*
+    libstario.so
+    ------------
+    Library providing USB, serial, and parallel communications support for
+    Star Micronics devices.
+
+    Copyright (C) 2004 Star Micronics Co., Ltd.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+
+#include "stario-error.h"
+#include "stario-serial-baud.h"
+
+long serSetCustomBaud(int port, long baud)
+{
+#ifdef BOTHER
+    struct termios2 options;
+
+    if (ioctl(port, TCGETS2, &options) == -1)
+    {
+        return STARIO_ERROR_IO_FAIL;
+    }
+
+    options.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    options.c_cflag |= (BOTHER | (BOTHER << IBSHIFT));
+    options.c_ispeed = baud;
+    options.c_ospeed = baud;
+
+    if (ioctl(port, TCSETS2, &options) == -1)
+    {
+        return STARIO_ERROR_IO_FAIL;
+    }
+
+    // drivers round to the nearest rate their divisor supports - reject
+    // anything more than 3% off, as a mismatched printer would see garbage
+    if (ioctl(port, TCGETS2, &options) == -1)
+    {
+        return STARIO_ERROR_IO_FAIL;
+    }
+
+    long rateError = ((long) options.c_ospeed) - baud;
+    if (rateError < 0)
+    {
+        rateError = -rateError;
+    }
+
+    if (rateError * 100 > baud * 3)
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    return STARIO_ERROR_SUCCESS;
+#else
+    return STARIO_ERROR_NOT_AVAILABLE;
+#endif
+}
@@ -23,32 +23,67 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <memory.h>
+#include <time.h>
 #include <termios.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
 
 #include "stario-error.h"
+#include "stario-status.h"
 #include "stario-serial.h"
+#include "stario-serial-baud.h"
+#include "stario-checkedblock.h"
 
 static long serMatchPortName        (char const * portName);
-static long serOpenPort             (char const * portName, char const * portSettings);
-static long serWritePort            (char const * portName, char const * writeBuffer, long length);
-static long serReadPortPrv          (char const * portName, char * readBuffer, long length, long minLength, long timeMillis);
-static long serReadPort             (char const * portName, char * readBuffer, long length);
-static long serGetStarPrinterStatus (char const * portName, StarPrinterStatus * status);
-static long serBeginCheckedBlock    (char const * portName);
-static long serEndCheckedBlock      (char const * portName, StarPrinterStatus * status);
-static long serHdwrResetDevice      (char const * portName);
-static long serDoVisualCardCmd      (char const * portName, VisualCardCmd * request, long timeoutMillis);
-static long serClosePort            (char const * portName);
+static long serOpenPort             (char const * portName, char const * portSettings, void ** port);
+static long serWritePort            (void * port, char const * writeBuffer, long length);
+static long serFlushPort            (void * port);
+static long serReadPortPrv          (void * port, char * readBuffer, long length, long minLength, long timeMillis);
+static long serReadPort             (void * port, char * readBuffer, long length);
+static long serGetStarPrinterStatus (void * port, StarPrinterStatus * status);
+static long serBeginCheckedBlock    (void * port);
+static long serEndCheckedBlock      (void * port, StarPrinterStatus * status);
+static long serHdwrResetDevice      (void * port);
+static long serDoVisualCardCmd      (void * port, VisualCardCmd * request, long timeoutMillis);
+static long serClosePort            (void * port);
 static void serReleaseImpl          ();
 
 #define MAX_NUM_PORTS 20
 #define MAX_COM_PORT  99
 
+// supported baud rate range - rates without a B* constant use termios2
+#define SER_MIN_BAUD            300
+#define SER_MAX_BAUD            4000000
+
+// maximum time without the device accepting any output data
+#define SER_WRITE_TIMEOUT       5000
+
+// output bytes kept queued in the tty while using hdwr flow control
+#define SER_HDWR_MAX_QUEUED     256
+
+// upper bound on one wait for a DSR watcher wake-up before DSR is re-read,
+// in case a change fell between two of the watcher's TIOCMIWAIT calls
+#define SER_DSR_RECHECK_MILLIS  50
+
+// without TIOCMIWAIT support in the driver, DSR is re-read at intervals
+// doubling from 1 millisecond up to this
+#define SER_DSR_MAX_POLL_MILLIS 8
+
+// application data received and not yet read - the oldest is dropped beyond this
+#define SER_RX_BUFFER_SIZE      4096
+
+// a partial ASB frame with no further input for this long was application data
+#define SER_ASB_GAP_MILLIS      50
+
+// longest ASB frame - header 0x2f
+#define SER_ASB_MAX_LENGTH      15
+
 typedef struct
 {
     long baud;
@@ -66,12 +101,40 @@ typedef struct
     int port;
 
     SerPortSettings originalPortSettings;
+    long charTimeMicros;                // time to transmit one character at the configured settings
+
+    // DSR watcher - hdwr flow control only
+    pthread_t dsrWatcher;               // thread blocking in TIOCMIWAIT for DSR changes
+    unsigned char dsrWatcherStarted;    // if 0, no watcher thread to cancel at close
+    unsigned char dsrWatcherRunning;    // if 0, DSR is polled instead
+    long dsrChanges;                    // DSR transitions seen by the watcher
+    pthread_mutex_t dsrLock;
+    pthread_cond_t dsrChanged;          // broadcast on every DSR transition
+
+    // receive layer - input is split into ASB frames and application data
+    unsigned char rxData[SER_RX_BUFFER_SIZE];   // application data not yet read - ring
+    long rxFirst;                       // index of the oldest byte in rxData
+    long rxLength;                      // count of bytes in rxData
+    struct timeval rxTime;              // when input last arrived
+    unsigned char asbFrame[SER_ASB_MAX_LENGTH]; // ASB frame being received
+    long asbFrameLength;                // bytes of asbFrame received, 0 if none
+    long asbFrameExpected;              // length given by the frame's header
+    StarPrinterStatus asbStatus;        // last complete ASB frame, decoded
+    unsigned long asbFrames;            // count of complete ASB frames received
+    long asbRequested;                  // status requests still awaiting their response
+    unsigned char asbPushed;            // if 1, the device sends ASB unsolicited ("asb" in portSettings)
+    unsigned char rxRaw;                // if 1, all input is application data (Visual Card exchange)
 
     StarPrinterStatus statusCache;
+    CheckedBlockTiming timing;          // print time estimate pacing endCheckedBlock polls
 } SerPort;
 
-SerPort serPorts[MAX_NUM_PORTS];
-unsigned char portHasBeenInitialized[MAX_COM_PORT];
+static SerPort serPorts[MAX_NUM_PORTS];
+static unsigned char portHasBeenInitialized[MAX_COM_PORT];
+
+// guards serPorts slots and portHasBeenInitialized - held by open and close only,
+// port i/o is serialised per port by the caller
+static pthread_mutex_t serPortsLock = PTHREAD_MUTEX_INITIALIZER;
 
 PortImpl getSerPortImpl()
 {
@@ -82,6 +145,7 @@ PortImpl getSerPortImpl()
     impl.matchPortName          = serMatchPortName;
     impl.openPort               = serOpenPort;
     impl.writePort              = serWritePort;
+    impl.flushPort              = serFlushPort;
     impl.readPort               = serReadPort;
     impl.getStarPrinterStatus   = serGetStarPrinterStatus;
     impl.beginCheckedBlock      = serBeginCheckedBlock;
@@ -126,6 +190,7 @@ static long serMatchPortName (char const * portName)
 static long serConfigurePort(SerPort * serPort, unsigned char saveSettings, SerPortSettings * settings)
 {
     struct termios options;
+    unsigned char customBaud = 0;
 
     if (tcgetattr(serPort->port, &options) == -1)
     {
@@ -134,14 +199,37 @@ static long serConfigurePort(SerPort * serPort, unsigned char saveSettings, SerP
 
     if (settings->baud != 0)
     {
-        speed_t baudRate = B9600;
+        // rates without a B* constant are programmed through termios2 below
+        speed_t baudRate = B38400;
         switch (settings->baud)
         {
+#ifdef B4000000
+        case 4000000:	baudRate = B4000000;	break;
+        case 3500000:	baudRate = B3500000;	break;
+        case 3000000:	baudRate = B3000000;	break;
+        case 2500000:	baudRate = B2500000;	break;
+        case 2000000:	baudRate = B2000000;	break;
+        case 1500000:	baudRate = B1500000;	break;
+        case 1152000:	baudRate = B1152000;	break;
+        case 1000000:	baudRate = B1000000;	break;
+        case 921600:	baudRate = B921600;	break;
+        case 576000:	baudRate = B576000;	break;
+        case 500000:	baudRate = B500000;	break;
+        case 460800:	baudRate = B460800;	break;
+#endif
+        case 230400:	baudRate = B230400;	break;
+        case 115200:	baudRate = B115200;	break;
+        case 57600:	baudRate = B57600;	break;
         case 38400:	baudRate = B38400;	break;
         case 19200:	baudRate = B19200;	break;
         case 9600:	baudRate = B9600;	break;
         case 4800:	baudRate = B4800;	break;
         case 2400:	baudRate = B2400;	break;
+        case 1800:	baudRate = B1800;	break;
+        case 1200:	baudRate = B1200;	break;
+        case 600:	baudRate = B600;	break;
+        case 300:	baudRate = B300;	break;
+        default:	customBaud = 1;	break;
         }
 
         if ((cfsetispeed(&options, baudRate) == -1) || (cfsetospeed(&options, baudRate) == -1))
@@ -223,19 +311,207 @@ static long serConfigurePort(SerPort * serPort, unsigned char saveSettings, SerP
         return STARIO_ERROR_IO_FAIL;
     }
 
+    if (customBaud != 0)
+    {
+        long customBaudResult = serSetCustomBaud(serPort->port, settings->baud);
+
+        if (customBaudResult != STARIO_ERROR_SUCCESS)
+        {
+            return customBaudResult;
+        }
+    }
+
     if (saveSettings != 0)
     {
         memcpy(&serPort->originalPortSettings, settings, sizeof(SerPortSettings));
+
+        // start bit + data bits + parity bit + stop bits
+        long charBits = 1 + settings->dataBits + ((settings->parity != 'n')?1:0) + settings->stopBits;
+
+        serPort->charTimeMicros = (charBits * 1000000 + settings->baud - 1) / settings->baud;
     }
 
     return STARIO_ERROR_SUCCESS;
 }
 
-static long serOpenPort (char const * portName, char const * portSettings)
+// the watcher is stopped by cancellation, so no signal handler is needed to
+// break it out of TIOCMIWAIT; it is cancellable only while blocked there,
+// holding nothing
+static void * serDsrWatcherMain(void * arg)
+{
+    SerPort * serPort = (SerPort *) arg;
+
+    while (1)
+    {
+        int cancelType = 0;
+
+        pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &cancelType);
+
+        int waitResult = ioctl(serPort->port, TIOCMIWAIT, TIOCM_DSR);
+        int waitError = errno;
+
+        pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, &cancelType);
+
+        pthread_mutex_lock(&serPort->dsrLock);
+
+        if ((waitResult != 0) && (waitError != EINTR))
+        {
+            // driver without TIOCMIWAIT support - writers fall back to polling
+            serPort->dsrWatcherRunning = 0;
+
+            pthread_cond_broadcast(&serPort->dsrChanged);
+            pthread_mutex_unlock(&serPort->dsrLock);
+            break;
+        }
+
+        serPort->dsrChanges++;
+
+        pthread_cond_broadcast(&serPort->dsrChanged);
+        pthread_mutex_unlock(&serPort->dsrLock);
+    }
+
+    return NULL;
+}
+
+static void serStartDsrWatcher(SerPort * serPort)
+{
+    pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+
+    pthread_mutex_init(&serPort->dsrLock, NULL);
+    pthread_cond_init(&serPort->dsrChanged, &condAttr);
+
+    pthread_condattr_destroy(&condAttr);
+
+    serPort->dsrWatcherRunning = 1;
+
+    if (pthread_create(&serPort->dsrWatcher, NULL, serDsrWatcherMain, serPort) != 0)
+    {
+        serPort->dsrWatcherRunning = 0;
+
+        return;
+    }
+
+    serPort->dsrWatcherStarted = 1;
+}
+
+static void serStopDsrWatcher(SerPort * serPort)
+{
+    if (serPort->originalPortSettings.flowControl != 'h')
+    {
+        return;
+    }
+
+    if (serPort->dsrWatcherStarted != 0)
+    {
+        pthread_cancel(serPort->dsrWatcher);
+        pthread_join(serPort->dsrWatcher, NULL);
+    }
+
+    pthread_cond_destroy(&serPort->dsrChanged);
+    pthread_mutex_destroy(&serPort->dsrLock);
+}
+
+// wait for the printer to raise DSR
+// returns 1 once DSR is high, 0 on timeout
+static long serWaitDsr(SerPort * serPort, long timeMillis)
+{
+    long timeout = timeMillis;
+
+    long pollMillis = 1;
+
+    while (1)
+    {
+        // a change after this count is taken wakes the wait below
+        pthread_mutex_lock(&serPort->dsrLock);
+
+        long dsrChanges = serPort->dsrChanges;
+
+        pthread_mutex_unlock(&serPort->dsrLock);
+
+        int portStatus = 0;
+        if (ioctl(serPort->port, TIOCMGET, &portStatus) != 0)
+        {
+            return STARIO_ERROR_IO_FAIL;
+        }
+
+        if ((portStatus & TIOCM_DSR) != 0)
+        {
+            return 1;
+        }
+
+        if (timeout <= 0)
+        {
+            return 0;
+        }
+
+        struct timeval timeS;
+        struct timeval timeF;
+
+        GET_TIME(timeS);
+
+        pthread_mutex_lock(&serPort->dsrLock);
+
+        if (serPort->dsrWatcherRunning != 0)
+        {
+            // woken by the watcher the instant DSR changes
+            long waitMillis = (timeout < SER_DSR_RECHECK_MILLIS)?timeout:SER_DSR_RECHECK_MILLIS;
+
+            struct timespec waitUntil;
+            clock_gettime(CLOCK_MONOTONIC, &waitUntil);
+            waitUntil.tv_sec += waitMillis / 1000;
+            waitUntil.tv_nsec += (waitMillis % 1000) * 1000 * 1000;
+            if (waitUntil.tv_nsec >= 1000 * 1000 * 1000)
+            {
+                waitUntil.tv_sec += 1;
+                waitUntil.tv_nsec -= 1000 * 1000 * 1000;
+            }
+
+            while ((serPort->dsrChanges == dsrChanges) && (serPort->dsrWatcherRunning != 0))
+            {
+                if (pthread_cond_timedwait(&serPort->dsrChanged, &serPort->dsrLock, &waitUntil) != 0)
+                {
+                    break;
+                }
+            }
+
+            pthread_mutex_unlock(&serPort->dsrLock);
+        }
+        else
+        {
+            pthread_mutex_unlock(&serPort->dsrLock);
+
+            long waitMillis = (timeout < pollMillis)?timeout:pollMillis;
+
+            struct timeval sleepTime = {0, waitMillis * 1000};
+
+            select(0, NULL, NULL, NULL, &sleepTime);
+
+            if (pollMillis < SER_DSR_MAX_POLL_MILLIS)
+            {
+                pollMillis *= 2;
+            }
+        }
+
+        GET_TIME(timeF);
+
+        long interval = TIME_DIFF(timeS,timeF);
+
+        if (timeout > interval)
+            timeout -= interval;
+        else
+            timeout = 0;
+    }
+}
+
+static long serOpenPortPrv (char const * portName, char const * portSettings, void ** port)
 {
     SerPort * oldSerPort = serFindPort(portName);
     if (oldSerPort != NULL)
     {
+        *port = oldSerPort;
+
         return STARIO_ERROR_SUCCESS;
     }
 
@@ -283,11 +559,8 @@ static long serOpenPort (char const * portName, char const * portSettings)
     }
 
     settings.baud = atol(baudToken);
-    if ((settings.baud != 38400) &&
-        (settings.baud != 19200) &&
-        (settings.baud !=  9600) &&
-        (settings.baud !=  4800) &&
-        (settings.baud !=  2400))
+    if ((settings.baud < SER_MIN_BAUD) ||
+        (settings.baud > SER_MAX_BAUD))
     {
         return STARIO_ERROR_NOT_AVAILABLE;
     }
@@ -336,6 +609,18 @@ static long serOpenPort (char const * portName, char const * portSettings)
         return STARIO_ERROR_NOT_AVAILABLE;
     }
 
+    // optional - the device is set up to send ASB on every change of state
+    char * asbToken = strstr(flowControlToken, ",");
+    if (asbToken != NULL)
+    {
+        if (strcmp(++asbToken, "asb") != 0)
+        {
+            return STARIO_ERROR_NOT_AVAILABLE;
+        }
+
+        serPort.asbPushed = 1;
+    }
+
     strcpy(serPort.portName, portName);
 
     serPort.port = open(serPort.portName, O_RDWR | O_NOCTTY | O_NDELAY);
@@ -355,177 +640,572 @@ static long serOpenPort (char const * portName, char const * portSettings)
 
     memcpy(&serPorts[i], &serPort, sizeof(SerPort));
 
+    *port = &serPorts[i];
+
+    if (settings.flowControl == 'h')
+    {
+        serStartDsrWatcher(&serPorts[i]);
+    }
+
     if (portHasBeenInitialized[atoi(&serPort.portName[9])] == 0)
     {
         portHasBeenInitialized[atoi(&serPort.portName[9])] = 1;
 
-        serHdwrResetDevice(portName);
+        serHdwrResetDevice(&serPorts[i]);
     }
 
     return STARIO_ERROR_SUCCESS;
 }
 
-static long serWritePort (char const * portName, char const * writeBuffer, long length)
+// the table lock is held across the whole open so that two opens can not claim one slot
+static long serOpenPort (char const * portName, char const * portSettings, void ** port)
+{
+    pthread_mutex_lock(&serPortsLock);
+
+    long result = serOpenPortPrv(portName, portSettings, port);
+
+    pthread_mutex_unlock(&serPortsLock);
+
+    return result;
+}
+
+// sleep for the time the line needs to transmit the given number of characters
+static void serSleepChars(SerPort * serPort, long chars)
 {
-    SerPort * serPort = serFindPort(portName);
-    if (serPort == NULL)
+    long sleepMicros = chars * serPort->charTimeMicros;
+
+    if (sleepMicros < 1000)
     {
-        return STARIO_ERROR_NOT_OPEN;
+        sleepMicros = 1000;
     }
 
-    long timeout = 5 * 1000;
+    struct timeval sleepTime = {sleepMicros / 1000000, sleepMicros % 1000000};
 
-    long writeLength = (long) length;
-    long totalWriteLength = 0;
-    long partialWriteLength = 0;
+    select(0, NULL, NULL, NULL, &sleepTime);
+}
+
+// wait until the tty accepts more output data
+// returns 1 when writable, 0 on timeout
+static long serWaitWritable(SerPort * serPort, long timeMillis)
+{
+    struct pollfd writePoll = {serPort->port, POLLOUT, 0};
 
-    char const * bufferElements = writeBuffer;
+    int pollResult = poll(&writePoll, 1, timeMillis);
 
-    while ((totalWriteLength < writeLength) && (timeout > 0))
+    if (pollResult == -1)
     {
-        if (serPort->originalPortSettings.flowControl == 'h')
-        {
-            while (timeout > 0)
-            {
-                int portStatus = 0;
-                if (ioctl(serPort->port, TIOCMGET, &portStatus) == 0)
-                {
-                    if ((portStatus & TIOCM_DSR) != 0)
-                    {
-                        break;
-                    }
-                }
-                else
-                {
-                    return STARIO_ERROR_IO_FAIL;
-                }
+        return (errno == EINTR)?0:STARIO_ERROR_IO_FAIL;
+    }
 
-                struct timeval sleepTime = {0, 20 * 1000};
+    if ((pollResult == 1) && ((writePoll.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0))
+    {
+        return STARIO_ERROR_IO_FAIL;
+    }
 
-                select(0, NULL, NULL, NULL, &sleepTime);
+    return pollResult;
+}
 
-                if (timeout > 20)
-                    timeout -= 20;
-                else
-                    timeout = 0;
-            }
-            if (timeout == 0)
-            {
-                break;
-            }
+// queue data on the tty regardless of DSR - used for status requests and ETB
+static long serWriteRawPrv(SerPort * serPort, char const * writeBuffer, long length)
+{
+    long timeout = SER_WRITE_TIMEOUT;
+    long totalWriteLength = 0;
+
+    while ((totalWriteLength < length) && (timeout > 0))
+    {
+        long partialWriteLength = write(serPort->port, &writeBuffer[totalWriteLength], length - totalWriteLength);
+
+        if (partialWriteLength > 0)
+        {
+            totalWriteLength += partialWriteLength;
+
+            continue;
         }
 
-        if (serPort->originalPortSettings.flowControl == 'h')
+        if ((partialWriteLength == -1) && (errno != EAGAIN) && (errno != EINTR))
         {
-            partialWriteLength = write(serPort->port, &bufferElements[totalWriteLength], ((writeLength - totalWriteLength) < 256)?(writeLength - totalWriteLength):256);
+            return STARIO_ERROR_IO_FAIL;
         }
-        else
+
+        struct timeval timeS;
+        struct timeval timeF;
+
+        GET_TIME(timeS);
+        long waitResult = serWaitWritable(serPort, timeout);
+        GET_TIME(timeF);
+
+        if (waitResult < STARIO_ERROR_SUCCESS)
         {
-            partialWriteLength = write(serPort->port, &bufferElements[totalWriteLength], (writeLength - totalWriteLength));
+            return waitResult;
         }
 
-        if (partialWriteLength == -1)
+        long interval = TIME_DIFF(timeS,timeF);
+
+        if (timeout > interval)
+            timeout -= interval;
+        else
+            timeout = 0;
+    }
+
+    return totalWriteLength;
+}
+
+// wait until all queued output data has left the tty
+static long serDrainPrv(SerPort * serPort)
+{
+    long timeout = SER_WRITE_TIMEOUT;
+    int queuedLength = 0;
+    int lastQueuedLength = -1;
+
+    while (timeout > 0)
+    {
+        if (ioctl(serPort->port, TIOCOUTQ, &queuedLength) != 0)
         {
             return STARIO_ERROR_IO_FAIL;
         }
 
-        totalWriteLength += partialWriteLength;
+        if (queuedLength == 0)
+        {
+            break;
+        }
 
-        if (tcdrain(serPort->port) != 0)
+        if (queuedLength != lastQueuedLength)
         {
-            return STARIO_ERROR_IO_FAIL;
+            timeout = SER_WRITE_TIMEOUT;
+            lastQueuedLength = queuedLength;
         }
 
-        if (partialWriteLength > 0)
+        struct timeval timeS;
+        struct timeval timeF;
+
+        GET_TIME(timeS);
+        serSleepChars(serPort, queuedLength);
+        GET_TIME(timeF);
+
+        long interval = TIME_DIFF(timeS,timeF);
+
+        if (timeout > interval)
+            timeout -= interval;
+        else
+            timeout = 0;
+    }
+
+    if (queuedLength != 0)
+    {
+        return STARIO_ERROR_IO_FAIL;
+    }
+
+    // the kernel queue is empty - wait out the uart fifo
+    if (tcdrain(serPort->port) != 0)
+    {
+        return STARIO_ERROR_IO_FAIL;
+    }
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// receive layer
+// star devices may send ASB unsolicited on every change of state, so input
+// can hold ASB frames interleaved with application data; frames are taken
+// out into asbStatus and the rest is queued in rxData for readPort
+
+static void serRxPut(SerPort * serPort, unsigned char data)
+{
+    if (serPort->rxLength == SER_RX_BUFFER_SIZE)
+    {
+        serPort->rxFirst = (serPort->rxFirst + 1) % SER_RX_BUFFER_SIZE;
+        serPort->rxLength--;
+    }
+
+    serPort->rxData[(serPort->rxFirst + serPort->rxLength) % SER_RX_BUFFER_SIZE] = data;
+    serPort->rxLength++;
+}
+
+static long serRxTake(SerPort * serPort, char * readBuffer, long length)
+{
+    long takeLength = 0;
+
+    for (; (takeLength < length) && (serPort->rxLength > 0); takeLength++)
+    {
+        readBuffer[takeLength] = serPort->rxData[serPort->rxFirst];
+
+        serPort->rxFirst = (serPort->rxFirst + 1) % SER_RX_BUFFER_SIZE;
+        serPort->rxLength--;
+    }
+
+    return takeLength;
+}
+
+static void serDemuxPrv(SerPort * serPort, unsigned char data);
+
+// the bytes held as a partial ASB frame were application data after all
+// the header goes to rxData and the rest is examined again, as it may hold a real frame
+static void serAsbRejectPrv(SerPort * serPort)
+{
+    unsigned char held[SER_ASB_MAX_LENGTH];
+    long heldLength = serPort->asbFrameLength;
+
+    memcpy(held, serPort->asbFrame, heldLength);
+
+    serPort->asbFrameLength = 0;
+
+    serRxPut(serPort, held[0]);
+
+    long i = 1;
+    for (; i < heldLength; i++)
+    {
+        serDemuxPrv(serPort, held[i]);
+    }
+}
+
+static void serDemuxPrv(SerPort * serPort, unsigned char data)
+{
+    if (serPort->asbFrameLength == 0)
+    {
+        long frameLength = asbFrameLength(data);
+
+        if (frameLength == 0)
         {
-            timeout = 5 * 1000;
+            serRxPut(serPort, data);
+
+            return;
         }
+
+        serPort->asbFrame[0] = data;
+        serPort->asbFrameLength = 1;
+        serPort->asbFrameExpected = frameLength;
+
+        return;
     }
 
-    return totalWriteLength;
+    // bits 0 and 4 of the second header byte and bits 0, 4 and 7 of every
+    // status byte are 0
+    if (((serPort->asbFrameLength == 1) && ((data & 0x11) != 0)) ||
+        ((serPort->asbFrameLength >= 2) && ((data & 0x91) != 0)))
+    {
+        serAsbRejectPrv(serPort);
+        serDemuxPrv(serPort, data);
+
+        return;
+    }
+
+    serPort->asbFrame[serPort->asbFrameLength++] = data;
+
+    if (serPort->asbFrameLength < serPort->asbFrameExpected)
+    {
+        return;
+    }
+
+    StarPrinterStatus * status = &serPort->asbStatus;
+
+    memset(status, 0x00, sizeof(StarPrinterStatus));
+    memcpy(status->raw, serPort->asbFrame, serPort->asbFrameLength);
+    status->rawLength = (unsigned char) serPort->asbFrameLength;
+
+    asbDecode(status);
+
+    serPort->asbFrameLength = 0;
+    serPort->asbFrames++;
+
+    if (serPort->asbRequested > 0)
+    {
+        serPort->asbRequested--;
+    }
 }
 
-static long serReadPortPrv (char const * portName, char * readBuffer, long length, long minLength, long timeMillis)
+// ASB frames are only looked for while the device is known to send them -
+// otherwise any byte 0x0f or 0x21 ~ 0x2f of application data could start one
+static unsigned char serDemuxActive(SerPort * serPort)
 {
-    SerPort * serPort = serFindPort(portName);
-    if (serPort == NULL)
+    if (serPort->rxRaw != 0)
     {
-        return STARIO_ERROR_NOT_OPEN;
+        return 0;
     }
 
-    int availableReadLength = 0;
-    int timeout = timeMillis;
+    return ((serPort->asbPushed != 0) || (serPort->asbRequested > 0) || (serPort->asbFrameLength > 0))?1:0;
+}
 
-    while (timeout > 0)
+// reads what the tty holds, waiting up to timeMillis for it, and demultiplexes it
+// returns the number of bytes read, 0 if none arrived
+static long serReceivePrv(SerPort * serPort, long timeMillis)
+{
+    // a partial frame is given up after a gap, so application data that
+    // merely starts like an ASB header is not held back for long
+    if ((serPort->asbFrameLength > 0) && (timeMillis > SER_ASB_GAP_MILLIS))
+    {
+        timeMillis = SER_ASB_GAP_MILLIS;
+    }
+
+    struct pollfd readPoll = {serPort->port, POLLIN, 0};
+
+    int pollResult = poll(&readPoll, 1, timeMillis);
+
+    if (pollResult == -1)
+    {
+        return (errno == EINTR)?0:STARIO_ERROR_IO_FAIL;
+    }
+
+    char readBuffer[256];
+    long readLength = 0;
+
+    if (pollResult == 1)
     {
-        int startingAvailableReadLength = availableReadLength;
+        readLength = read(serPort->port, readBuffer, sizeof(readBuffer));
 
-        if (ioctl(serPort->port, FIONREAD, &availableReadLength) != 0)
+        if (readLength == -1)
+        {
+            if ((errno != EAGAIN) && (errno != EINTR))
+            {
+                return STARIO_ERROR_IO_FAIL;
+            }
+
+            readLength = 0;
+        }
+
+        if ((readLength == 0) && ((readPoll.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0))
         {
             return STARIO_ERROR_IO_FAIL;
         }
+    }
 
-        if (availableReadLength >= minLength)
+    if (readLength == 0)
+    {
+        if (serPort->asbFrameLength > 0)
         {
-            break;
+            struct timeval now;
+
+            GET_TIME(now);
+
+            if (TIME_DIFF(serPort->rxTime,now) >= SER_ASB_GAP_MILLIS)
+            {
+                serAsbRejectPrv(serPort);
+            }
         }
 
-        struct timeval sleepTime = {0, 20 * 1000};
+        return 0;
+    }
 
-        select(0, NULL, NULL, NULL, &sleepTime);
+    GET_TIME(serPort->rxTime);
 
-        if (startingAvailableReadLength != availableReadLength)
+    long i = 0;
+    for (; i < readLength; i++)
+    {
+        if (serDemuxActive(serPort) != 0)
         {
-            timeout = timeMillis;
+            serDemuxPrv(serPort, (unsigned char) readBuffer[i]);
         }
         else
         {
-            if (timeout > 20)
-                timeout -= 20;
+            serRxPut(serPort, (unsigned char) readBuffer[i]);
+        }
+    }
+
+    return readLength;
+}
+
+// data is streamed into the tty without draining between writes so that the
+// line never idles while more data is pending; with hdwr flow control the
+// queue is kept topped up to SER_HDWR_MAX_QUEUED bytes only, which bounds the
+// data still in flight when the printer drops DSR
+static long serWritePort (void * port, char const * writeBuffer, long length)
+{
+    SerPort * serPort = (SerPort *) port;
+    if (serPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    long timeout = SER_WRITE_TIMEOUT;
+
+    long totalWriteLength = 0;
+
+    struct timeval timeS;
+    struct timeval timeF;
+
+    while ((totalWriteLength < length) && (timeout > 0))
+    {
+        long writeAttemptLength = length - totalWriteLength;
+
+        if (serPort->originalPortSettings.flowControl == 'h')
+        {
+            GET_TIME(timeS);
+            long dsrResult = serWaitDsr(serPort, timeout);
+            GET_TIME(timeF);
+
+            if (dsrResult < STARIO_ERROR_SUCCESS)
+            {
+                return dsrResult;
+            }
+
+            if (dsrResult == 0)
+            {
+                break;
+            }
+
+            long interval = TIME_DIFF(timeS,timeF);
+
+            if (timeout > interval)
+                timeout -= interval;
             else
-                timeout = 0;
+                timeout = 1;
+
+            int queuedLength = 0;
+            if (ioctl(serPort->port, TIOCOUTQ, &queuedLength) != 0)
+            {
+                return STARIO_ERROR_IO_FAIL;
+            }
+
+            if (queuedLength >= SER_HDWR_MAX_QUEUED)
+            {
+                // let half the queue go out, then re-check DSR and top up
+                GET_TIME(timeS);
+                serSleepChars(serPort, queuedLength - SER_HDWR_MAX_QUEUED / 2);
+                GET_TIME(timeF);
+
+                long interval = TIME_DIFF(timeS,timeF);
+
+                if (timeout > interval)
+                    timeout -= interval;
+                else
+                    timeout = 0;
+
+                continue;
+            }
+
+            if (writeAttemptLength > (SER_HDWR_MAX_QUEUED - queuedLength))
+            {
+                writeAttemptLength = SER_HDWR_MAX_QUEUED - queuedLength;
+            }
         }
+
+        long partialWriteLength = write(serPort->port, &writeBuffer[totalWriteLength], writeAttemptLength);
+
+        if (partialWriteLength > 0)
+        {
+            totalWriteLength += partialWriteLength;
+
+            timeout = SER_WRITE_TIMEOUT;
+
+            continue;
+        }
+
+        if ((partialWriteLength == -1) && (errno != EAGAIN) && (errno != EINTR))
+        {
+            return STARIO_ERROR_IO_FAIL;
+        }
+
+        // kernel buffer full - sleep until the line has drained some of it
+        GET_TIME(timeS);
+        long waitResult = serWaitWritable(serPort, timeout);
+        GET_TIME(timeF);
+
+        if (waitResult < STARIO_ERROR_SUCCESS)
+        {
+            return waitResult;
+        }
+
+        long interval = TIME_DIFF(timeS,timeF);
+
+        if (timeout > interval)
+            timeout -= interval;
+        else
+            timeout = 0;
     }
 
-    if (availableReadLength < minLength)
+    cbTimingWritten(&serPort->timing, totalWriteLength);
+
+    return totalWriteLength;
+}
+
+static long serFlushPort (void * port)
+{
+    SerPort * serPort = (SerPort *) port;
+    if (serPort->set == 0)
     {
-        return STARIO_ERROR_IO_FAIL;
+        return STARIO_ERROR_NOT_OPEN;
     }
 
-    if (availableReadLength == 0)
+    return serDrainPrv(serPort);
+}
+
+// application data only - ASB frames in the input are routed to the status cache
+static long serReadPortPrv (void * port, char * readBuffer, long length, long minLength, long timeMillis)
+{
+    SerPort * serPort = (SerPort *) port;
+    if (serPort->set == 0)
     {
-        return 0;
+        return STARIO_ERROR_NOT_OPEN;
     }
 
-    if (availableReadLength < length)
+    if (length <= 0)
     {
-        length = availableReadLength;
+        return 0;
     }
 
-    length = read(serPort->port, readBuffer, length);
+    // timeMillis is the maximum time without any application data arriving
+    long totalReadLength = 0;
+    long timeout = timeMillis;
 
-    if (length == -1)
+    while (1)
     {
-        return STARIO_ERROR_IO_FAIL;
+        long takeLength = serRxTake(serPort, &readBuffer[totalReadLength], length - totalReadLength);
+
+        if (takeLength > 0)
+        {
+            totalReadLength += takeLength;
+
+            timeout = timeMillis;
+        }
+
+        if ((totalReadLength >= minLength) || (timeout <= 0))
+        {
+            break;
+        }
+
+        struct timeval timeS;
+        struct timeval timeF;
+
+        GET_TIME(timeS);
+        long receiveResult = serReceivePrv(serPort, timeout);
+        GET_TIME(timeF);
+
+        if (receiveResult < STARIO_ERROR_SUCCESS)
+        {
+            return receiveResult;
+        }
+
+        long interval = TIME_DIFF(timeS,timeF);
+
+        if (timeout > interval)
+            timeout -= interval;
+        else
+            timeout = 0;
+    }
+
+    if (totalReadLength == 0)
+    {
+        return (minLength > 0)?STARIO_ERROR_IO_FAIL:0;
     }
 
-    return length;
+    return totalReadLength;
 }
 
-static long serReadPort (char const * portName, char * readBuffer, long length)
+static long serReadPort (void * port, char * readBuffer, long length)
 {
     if (length == 0)
     {
         return 0;
     }
 
-    return serReadPortPrv(portName, readBuffer, length, 1, 200);
+    return serReadPortPrv(port, readBuffer, length, 1, 200);
 }
 
-static long serGetStarPrinterStatus (char const * portName, StarPrinterStatus * status)
+// with unsolicited ASB the device reports every change of state, so the last
+// frame is current however old it is, and a request is sent only before the first
+static long serGetStarPrinterStatus (void * port, StarPrinterStatus * status)
 {
-    SerPort * serPort = serFindPort(portName);
-    if (serPort == NULL)
+    SerPort * serPort = (SerPort *) port;
+    if (serPort->set == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
@@ -534,104 +1214,103 @@ static long serGetStarPrinterStatus (char const * portName, StarPrinterStatus *
 
     long ioResult = STARIO_ERROR_SUCCESS;
 
-    char const statusReqCmd[] = {0x1b, 0x06, 0x01};
-    if (write(serPort->port, statusReqCmd, 3) != 3)
+    // take in any frames the device has already sent
+    do
     {
-        return STARIO_ERROR_IO_FAIL;
-    }
-
-    ioResult = serReadPortPrv(portName, status->raw, sizeof(status->raw), 7, 200);
+        ioResult = serReceivePrv(serPort, 0);
+    } while (ioResult > 0);
 
     if (ioResult < STARIO_ERROR_SUCCESS)
     {
         return ioResult;
     }
 
-    if (ioResult < 7)
+    if ((serPort->asbPushed != 0) && (serPort->asbFrames > 0))
     {
-        return STARIO_ERROR_IO_FAIL;
-    }
+        memcpy(status, &serPort->asbStatus, sizeof(StarPrinterStatus));
 
-    long statusLength = 0;
-
-    switch (status->raw[0])
-    {
-        case 0x0f:  statusLength =  7; break;
-        case 0x21:  statusLength =  8; break;
-        case 0x23:  statusLength =  9; break;
-        case 0x25:  statusLength = 10; break;
-        case 0x27:  statusLength = 11; break;
-        case 0x29:  statusLength = 12; break;
-        case 0x2b:  statusLength = 13; break;
-        case 0x2d:  statusLength = 14; break;
-        case 0x2f:  statusLength = 15; break;
+        return STARIO_ERROR_SUCCESS;
     }
 
-    ioResult += serReadPortPrv(portName, &status->raw[ioResult], statusLength - ioResult, statusLength - ioResult, 200);
+    struct timeval timeS;
+    struct timeval timeF;
+
+    // the request must not queue behind print data still in the tty
+    ioResult = serDrainPrv(serPort);
 
-    if (ioResult < STARIO_ERROR_SUCCESS)
+    if (ioResult != STARIO_ERROR_SUCCESS)
     {
         return ioResult;
     }
 
-    if (ioResult != statusLength)
+    char const statusReqCmd[] = {0x1b, 0x06, 0x01};
+    if (serWriteRawPrv(serPort, statusReqCmd, 3) != 3)
     {
         return STARIO_ERROR_IO_FAIL;
     }
 
-    status->rawLength = (unsigned char) ioResult;
+    // with pushed ASB, counted until the response arrives, even after the timeout below
+    serPort->asbRequested++;
 
-    // printer status 1
-    status->coverOpen           = ((status->raw[2] & 0x20)!=0)?1:0;
-    status->offline             = ((status->raw[2] & 0x08)!=0)?1:0;
-    status->compulsionSwitch    = ((status->raw[2] & 0x04)!=0)?1:0;
+    unsigned long asbFrames = serPort->asbFrames;
+    long timeout = 200;
 
-    // printer status 2
-    status->overTemp            = ((status->raw[3] & 0x40)!=0)?1:0;
-    status->unrecoverableError  = ((status->raw[3] & 0x20)!=0)?1:0;
-    status->cutterError         = ((status->raw[3] & 0x08)!=0)?1:0;
-    status->mechError           = ((status->raw[3] & 0x04)!=0)?1:0;
+    while ((serPort->asbFrames == asbFrames) && (timeout > 0))
+    {
+        GET_TIME(timeS);
+        ioResult = serReceivePrv(serPort, timeout);
+        GET_TIME(timeF);
 
-    // printer status 3
-    status->pageModeCmdError        = ((status->raw[4] & 0x20)!=0)?1:0;
-    status->paperSizeError          = ((status->raw[4] & 0x08)!=0)?1:0;
-    status->presenterPaperJamError  = ((status->raw[4] & 0x04)!=0)?1:0;
-    status->headUpError             = ((status->raw[4] & 0x02)!=0)?1:0;
+        if (ioResult < STARIO_ERROR_SUCCESS)
+        {
+            return ioResult;
+        }
 
-    // printer status 4
-    status->blackMarkDetectStatus   = ((status->raw[5] & 0x20)!=0)?1:0;
-    status->paperEmpty              = ((status->raw[5] & 0x08)!=0)?1:0;
-    status->paperNearEmptyInner     = ((status->raw[5] & 0x04)!=0)?1:0;
-    status->paperNearEmptyOuter     = ((status->raw[5] & 0x02)!=0)?1:0;
+        if (ioResult > 0)
+        {
+            timeout = 200;
+
+            continue;
+        }
+
+        long interval = TIME_DIFF(timeS,timeF);
+
+        if (timeout > interval)
+            timeout -= interval;
+        else
+            timeout = 0;
+    }
 
-    // printer status 5
-    status->stackerFull             = ((status->raw[6] & 0x02)!=0)?1:0;
+    if (serPort->asbFrames == asbFrames)
+    {
+        // a response arriving after this is taken as application data
+        if (serPort->asbPushed == 0)
+        {
+            serPort->asbRequested = 0;
+
+            if (serPort->asbFrameLength > 0)
+            {
+                serAsbRejectPrv(serPort);
+            }
+        }
 
-    // printer status 6
-    status->etbAvailable            = (status->rawLength >= 9)?1:0;
-    status->etbCounter              = (((status->raw[7] & 0x40) >> 2) |
-                                       ((status->raw[7] & 0x20) >> 2) |
-                                       ((status->raw[7] & 0x08) >> 1) |
-                                       ((status->raw[7] & 0x04) >> 1) |
-                                       ((status->raw[7] & 0x02) >> 1));
+        return STARIO_ERROR_IO_FAIL;
+    }
 
-    // printer status 7
-    status->presenterState          = (((status->raw[8] & 0x08) >> 1) |
-                                       ((status->raw[8] & 0x04) >> 1) |
-                                       ((status->raw[8] & 0x02) >> 1));
+    memcpy(status, &serPort->asbStatus, sizeof(StarPrinterStatus));
 
     return STARIO_ERROR_SUCCESS;
 }
 
-static long serBeginCheckedBlock (char const * portName)
+static long serBeginCheckedBlock (void * port)
 {
-    SerPort * serPort = serFindPort(portName);
-    if (serPort == NULL)
+    SerPort * serPort = (SerPort *) port;
+    if (serPort->set == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
 
-    long ioResult = serGetStarPrinterStatus(portName, &serPort->statusCache);
+    long ioResult = serGetStarPrinterStatus(port, &serPort->statusCache);
 
     if (ioResult != STARIO_ERROR_SUCCESS)
     {
@@ -643,13 +1322,15 @@ static long serBeginCheckedBlock (char const * portName)
         return STARIO_ERROR_NOT_AVAILABLE;
     }
 
+    cbTimingBegin(&serPort->timing);
+
     return STARIO_ERROR_SUCCESS;
 }
 
-static long serEndCheckedBlock (char const * portName, StarPrinterStatus * status)
+static long serEndCheckedBlock (void * port, StarPrinterStatus * status)
 {
-    SerPort * serPort = serFindPort(portName);
-    if (serPort == NULL)
+    SerPort * serPort = (SerPort *) port;
+    if (serPort->set == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
@@ -668,15 +1349,25 @@ static long serEndCheckedBlock (char const * portName, StarPrinterStatus * statu
     {
         char etb[1] = {0x17};
 
-        ioResult = write(serPort->port, etb, 1);
+        ioResult = serWriteRawPrv(serPort, etb, 1);
 
         if (ioResult == 1)
+        {
+            // checked block boundary - everything up to the ETB goes out on the wire
+            ioResult = serDrainPrv(serPort);
+        }
+
+        if (ioResult == STARIO_ERROR_SUCCESS)
         {
             unsigned char nextEtbCounter = (serPort->statusCache.etbCounter + 1) % 32;
 
+            cbTimingEtb(&serPort->timing);
+
+            long attempt = 0;
+
             do
             {
-                ioResult = serGetStarPrinterStatus(portName, status);
+                ioResult = serGetStarPrinterStatus(port, status);
 
                 if (ioResult != STARIO_ERROR_SUCCESS)
                 {
@@ -697,7 +1388,9 @@ static long serEndCheckedBlock (char const * portName, StarPrinterStatus * statu
                     (status->offline == 0) &&
                     (status->etbCounter != nextEtbCounter))
                 {
-                    struct timeval sleepTime = {0, 200 * 1000};
+                    long pollMillis = cbTimingPollMillis(&serPort->timing, attempt++);
+
+                    struct timeval sleepTime = {pollMillis / 1000, (pollMillis % 1000) * 1000};
 
                     select(0, NULL, NULL, NULL, &sleepTime);
 
@@ -706,11 +1399,17 @@ static long serEndCheckedBlock (char const * portName, StarPrinterStatus * statu
 
                 break;
             } while (1);
+
+            if ((ioResult >= STARIO_ERROR_SUCCESS) &&
+                (status->offline == 0))
+            {
+                cbTimingCompleted(&serPort->timing);
+            }
         }
 
         if (status->offline)
         {
-            ioResult = serHdwrResetDevice(portName);
+            ioResult = serHdwrResetDevice(port);
 
             if (ioResult != STARIO_ERROR_SUCCESS)
             {
@@ -722,10 +1421,10 @@ static long serEndCheckedBlock (char const * portName, StarPrinterStatus * statu
     return STARIO_ERROR_SUCCESS;
 }
 
-static long serHdwrResetDevice (char const * portName)
+static long serHdwrResetDevice (void * port)
 {
-    SerPort * serPort = serFindPort(portName);
-    if (serPort == NULL)
+    SerPort * serPort = (SerPort *) port;
+    if (serPort->set == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
@@ -757,7 +1456,7 @@ static long serHdwrResetDevice (char const * portName)
     return STARIO_ERROR_IO_FAIL;
 }
 
-static long serDoVisualCardCmd (char const * portName, VisualCardCmd * request, long timeoutMillis)
+static long serDoVisualCardCmdPrv (void * port, VisualCardCmd * request, long timeoutMillis)
 {
     long ioResult = STARIO_ERROR_SUCCESS;
     long timeRemaining = timeoutMillis;
@@ -775,7 +1474,7 @@ static long serDoVisualCardCmd (char const * portName, VisualCardCmd * request,
 
     // send ACK to confirm any packets received after previous timeout
     //printf("tx leading ack\n");
-    ioResult = serWritePort(portName, &ack, 1);
+    ioResult = serWritePort(port, &ack, 1);
     if (ioResult != 1)
     {
         return STARIO_ERROR_IO_FAIL;
@@ -786,7 +1485,7 @@ static long serDoVisualCardCmd (char const * portName, VisualCardCmd * request,
     do
     {
         char bitBucket[1 + 1 + 1 + 128 + 1 + 1];
-        ioResult = serReadPortPrv(portName, bitBucket, sizeof(bitBucket), 1, 10);
+        ioResult = serReadPortPrv(port, bitBucket, sizeof(bitBucket), 1, 10);
         //printf("cleared %d bytes\n", (int) ioResult);
     } while (ioResult > 0);
 
@@ -817,7 +1516,7 @@ static long serDoVisualCardCmd (char const * portName, VisualCardCmd * request,
         //printf("timeRemaining = %d\n", (int) timeRemaining);
 
         //printf("tx cmd\n");
-        ioResult = serWritePort(portName, txCmd, txCmdLength);
+        ioResult = serWritePort(port, txCmd, txCmdLength);
 
         if (ioResult != txCmdLength)
         {
@@ -836,7 +1535,7 @@ static long serDoVisualCardCmd (char const * portName, VisualCardCmd * request,
 
             //printf("rx resp\n");
             GET_TIME(timeS);
-            ioResult = serReadPortPrv(portName, response, 1, 1, timeRemaining);
+            ioResult = serReadPortPrv(port, response, 1, 1, timeRemaining);
             GET_TIME(timeF);
             interval = TIME_DIFF(timeS,timeF);
             //printf("rx took %d millisec\n", (int) interval);
@@ -927,11 +1626,11 @@ static long serDoVisualCardCmd (char const * portName, VisualCardCmd * request,
             GET_TIME(timeS);
             if (rxCmdLength < 5)
             {
-                ioResult = serReadPortPrv(portName, &rxCmd[rxCmdLength], sizeof(rxCmd) - rxCmdLength, 5 - rxCmdLength, timeRemaining);
+                ioResult = serReadPortPrv(port, &rxCmd[rxCmdLength], sizeof(rxCmd) - rxCmdLength, 5 - rxCmdLength, timeRemaining);
             }
             else
             {
-                ioResult = serReadPortPrv(portName, &rxCmd[rxCmdLength], sizeof(rxCmd) - rxCmdLength, 1, timeRemaining);
+                ioResult = serReadPortPrv(port, &rxCmd[rxCmdLength], sizeof(rxCmd) - rxCmdLength, 1, timeRemaining);
             }
             GET_TIME(timeF);
             interval = TIME_DIFF(timeS,timeF);
@@ -984,7 +1683,7 @@ static long serDoVisualCardCmd (char const * portName, VisualCardCmd * request,
         {
             //printf("resp OK - tx ack\n");
 
-            ioResult = serWritePort(portName, &ack, 1);
+            ioResult = serWritePort(port, &ack, 1);
 
             if (ioResult != 1)
             {
@@ -1000,7 +1699,7 @@ static long serDoVisualCardCmd (char const * portName, VisualCardCmd * request,
 
         //printf("resp malformed - tx nak\n");
 
-        ioResult = serWritePort(portName, &nak, 1);
+        ioResult = serWritePort(port, &nak, 1);
 
         if (ioResult != 1)
         {
@@ -1032,19 +1731,49 @@ static long serDoVisualCardCmd (char const * portName, VisualCardCmd * request,
     return STARIO_ERROR_SUCCESS;
 }
 
-static long serClosePort (char const * portName)
+// a Visual Card response may hold any byte value, so none of the exchange is taken for ASB
+static long serDoVisualCardCmd (void * port, VisualCardCmd * request, long timeoutMillis)
 {
-    SerPort * serPort = serFindPort(portName);
-    if (serPort == NULL)
+    SerPort * serPort = (SerPort *) port;
+    if (serPort->set == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
 
+    serPort->rxRaw = 1;
+
+    // nor is a partial frame held from before it
+    while (serPort->asbFrameLength > 0)
+    {
+        serAsbRejectPrv(serPort);
+    }
+
+    long result = serDoVisualCardCmdPrv(port, request, timeoutMillis);
+
+    serPort->rxRaw = 0;
+
+    return result;
+}
+
+static long serClosePort (void * port)
+{
+    SerPort * serPort = (SerPort *) port;
+    if (serPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    serDrainPrv(serPort);
+
+    serStopDsrWatcher(serPort);
+
     tcflush(serPort->port, TCIOFLUSH);
 
     close(serPort->port);
 
+    pthread_mutex_lock(&serPortsLock);
     memset(serPort, 0x00, sizeof(SerPort));
+    pthread_mutex_unlock(&serPortsLock);
 
     return STARIO_ERROR_SUCCESS;
 }
@@ -1056,7 +1785,7 @@ static void serReleaseImpl ()
     {
         if (serPorts[i].set != 0)
         {
-            serClosePort(serPorts[i].portName);
+            serClosePort(&serPorts[i]);
         }
     }
 }
@@ -0,0 +1,794 @@
+/*
+    libstario.so
+    ------------
+    Library providing USB, serial, and parallel communications support for
+    Star Micronics devices.
+
+    Copyright (C) 2004 Star Micronics Co., Ltd.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <memory.h>
+#include <sys/time.h>
+
+#include "stario-error.h"
+#include "stario-status.h"
+#include "stario-sim.h"
+#include "stario-checkedblock.h"
+
+static long simMatchPortName        (char const * portName);
+static long simOpenPort             (char const * portName, char const * portSettings, void ** port);
+static long simWritePort            (void * port, char const * writeBuffer, long length);
+static long simFlushPort            (void * port);
+static long simReadPort             (void * port, char * readBuffer, long length);
+static long simGetStarPrinterStatus (void * port, StarPrinterStatus * status);
+static long simBeginCheckedBlock    (void * port);
+static long simEndCheckedBlock      (void * port, StarPrinterStatus * status);
+static long simHdwrResetDevice      (void * port);
+static long simDoVisualCardCmd      (void * port, VisualCardCmd * request, long timeoutMillis);
+static long simClosePort            (void * port);
+static void simReleaseImpl          ();
+
+#define MAX_NUM_PORTS 20
+
+// model defaults - roughly a usb connected 80 mm thermal printer
+#define SIM_DEFAULT_RATE        1000000     // line rate, bytes per second
+#define SIM_DEFAULT_BUFFER      16384       // receive buffer, bytes
+#define SIM_DEFAULT_SPEED       144000      // print speed, bytes per second (72 byte raster lines at 2000 lines per second)
+#define SIM_DEFAULT_LATENCY     1           // status and visual card round trip, milliseconds
+
+// maximum time without the device accepting any output data
+#define SIM_WRITE_TIMEOUT       5000
+
+// the model advances in slices of at most this long while data is written
+#define SIM_SLICE_MILLIS        10
+
+#define SIM_MAX_EVENTS          16
+#define SIM_MAX_ETBS            64
+
+// device states an asb script can set
+#define SIM_STATE_ONLINE        'o'
+#define SIM_STATE_COVER_OPEN    'c'
+#define SIM_STATE_PAPER_EMPTY   'p'
+#define SIM_STATE_NEAR_EMPTY    'n'
+#define SIM_STATE_ERROR         'e'
+
+typedef struct
+{
+    long atMillis;                      // time after open
+    char state;                         // SIM_STATE_*
+} SimEvent;
+
+typedef struct
+{
+    unsigned char set;
+    char portName[100];
+    char portSettings[100];
+
+    // model parameters
+    double lineRate;                    // bytes per millisecond accepted from the host
+    double printRate;                   // bytes per millisecond printed
+    long bufferSize;                    // receive buffer, bytes
+    long latencyMillis;                 // added to every status and visual card exchange
+    unsigned char etbAvailable;         // if 0, the device has no ETB counter
+    char cardResponse;                  // visual card reply - 'a'ck, 'n'ak, 'd'le, or 0 for none
+    SimEvent events[SIM_MAX_EVENTS];    // asb script, in time order
+    long numEvents;
+
+    // model state
+    struct timeval openTime;
+    struct timeval lastUpdate;          // when the model was last advanced
+    char state;                         // SIM_STATE_*
+    double bufferLevel;                 // bytes received and not yet printed
+    double receivedTotal;               // bytes received since open or reset
+    double printedTotal;                // bytes printed since open or reset
+    double etbs[SIM_MAX_ETBS];          // receivedTotal at each ETB not yet printed - ring
+    long firstEtb;
+    long numEtbs;
+    unsigned char etbCounter;           // 0 ~ 31
+
+    StarPrinterStatus statusCache;
+    CheckedBlockTiming timing;          // print time estimate pacing endCheckedBlock polls
+} SimPort;
+
+static SimPort simPorts[MAX_NUM_PORTS];
+
+// guards simPorts slots - held by open and close only,
+// port i/o is serialised per port by the caller
+static pthread_mutex_t simPortsLock = PTHREAD_MUTEX_INITIALIZER;
+
+PortImpl getSimPortImpl()
+{
+    memset(simPorts, 0x00, sizeof(simPorts));
+
+    PortImpl impl;
+
+    impl.matchPortName          = simMatchPortName;
+    impl.openPort               = simOpenPort;
+    impl.writePort              = simWritePort;
+    impl.flushPort              = simFlushPort;
+    impl.readPort               = simReadPort;
+    impl.getStarPrinterStatus   = simGetStarPrinterStatus;
+    impl.beginCheckedBlock      = simBeginCheckedBlock;
+    impl.endCheckedBlock        = simEndCheckedBlock;
+    impl.hdwrResetDevice        = simHdwrResetDevice;
+    impl.doVisualCardCmd        = simDoVisualCardCmd;
+    impl.closePort              = simClosePort;
+    impl.releaseImpl            = simReleaseImpl;
+
+    return impl;
+}
+
+static SimPort * simFindPort(char const * portName)
+{
+    int i = 0;
+    for (; i < MAX_NUM_PORTS; i++)
+    {
+        if (simPorts[i].set != 0)
+            if (strcmp(simPorts[i].portName, portName) == 0)
+                break;
+    }
+
+    if (i == MAX_NUM_PORTS)
+    {
+        return NULL;
+    }
+
+    return &simPorts[i];
+}
+
+static long simMatchPortName (char const * portName)
+{
+    if (strncmp(portName, "sim:", 4) == 0)
+    {
+        return STARIO_ERROR_SUCCESS;
+    }
+
+    return STARIO_ERROR_NOT_AVAILABLE;
+}
+
+static void simSleep(double millis)
+{
+    if (millis <= 0)
+    {
+        return;
+    }
+
+    long micros = (long) (millis * 1000);
+
+    struct timeval sleepTime = {micros / 1000000, micros % 1000000};
+
+    select(0, NULL, NULL, NULL, &sleepTime);
+}
+
+static long simParseNumber(char const * value, long minValue)
+{
+    if ((value[0] == 0) || (strspn(value, "0123456789") != strlen(value)))
+    {
+        return -1;
+    }
+
+    long number = atol(value);
+
+    return (number >= minValue)?number:-1;
+}
+
+// "asb=2000:cover/2500:online" - state changes at times after open
+static long simParseScript(SimPort * simPort, char * script)
+{
+    char * savePtr = NULL;
+    char * event = strtok_r(script, "/", &savePtr);
+
+    for (; event != NULL; event = strtok_r(NULL, "/", &savePtr))
+    {
+        char * stateName = strchr(event, ':');
+
+        if ((stateName == NULL) || (simPort->numEvents == SIM_MAX_EVENTS))
+        {
+            return STARIO_ERROR_NOT_AVAILABLE;
+        }
+
+        *stateName++ = 0;
+
+        long atMillis = simParseNumber(event, 0);
+
+        if ((atMillis < 0) ||
+            ((simPort->numEvents > 0) && (atMillis < simPort->events[simPort->numEvents - 1].atMillis)))
+        {
+            return STARIO_ERROR_NOT_AVAILABLE;
+        }
+
+        char state = 0;
+
+        if (strcmp(stateName, "online") == 0)       state = SIM_STATE_ONLINE;
+        else if (strcmp(stateName, "cover") == 0)   state = SIM_STATE_COVER_OPEN;
+        else if (strcmp(stateName, "paper") == 0)   state = SIM_STATE_PAPER_EMPTY;
+        else if (strcmp(stateName, "nearend") == 0) state = SIM_STATE_NEAR_EMPTY;
+        else if (strcmp(stateName, "error") == 0)   state = SIM_STATE_ERROR;
+        else
+        {
+            return STARIO_ERROR_NOT_AVAILABLE;
+        }
+
+        simPort->events[simPort->numEvents].atMillis = atMillis;
+        simPort->events[simPort->numEvents].state = state;
+        simPort->numEvents++;
+    }
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// portSettings - comma separated, each optional:
+//   "rate=n"       line rate, bytes per second
+//   "buffer=n"     receive buffer size, bytes
+//   "speed=n"      print speed, bytes per second
+//   "latency=n"    status and visual card round trip, milliseconds
+//   "etb=0"        device without an ETB counter
+//   "card=x"       visual card reply - ack, nak, dle or none
+//   "asb=script"   status changes, i.e. "2000:cover/2500:online"
+static long simParseSettings(SimPort * simPort, char const * portSettings)
+{
+    simPort->lineRate = SIM_DEFAULT_RATE / 1000.0;
+    simPort->bufferSize = SIM_DEFAULT_BUFFER;
+    simPort->printRate = SIM_DEFAULT_SPEED / 1000.0;
+    simPort->latencyMillis = SIM_DEFAULT_LATENCY;
+    simPort->etbAvailable = 1;
+    simPort->cardResponse = 'a';
+
+    char settings[100];
+
+    strcpy(settings, portSettings);
+
+    char * savePtr = NULL;
+    char * token = strtok_r(settings, ",", &savePtr);
+
+    for (; token != NULL; token = strtok_r(NULL, ",", &savePtr))
+    {
+        char * value = strchr(token, '=');
+
+        if (value == NULL)
+        {
+            return STARIO_ERROR_NOT_AVAILABLE;
+        }
+
+        *value++ = 0;
+
+        long number = 0;
+
+        if (strcmp(token, "rate") == 0)
+        {
+            if ((number = simParseNumber(value, 1)) < 0)
+                return STARIO_ERROR_NOT_AVAILABLE;
+
+            simPort->lineRate = number / 1000.0;
+        }
+        else if (strcmp(token, "buffer") == 0)
+        {
+            if ((number = simParseNumber(value, 1)) < 0)
+                return STARIO_ERROR_NOT_AVAILABLE;
+
+            simPort->bufferSize = number;
+        }
+        else if (strcmp(token, "speed") == 0)
+        {
+            if ((number = simParseNumber(value, 1)) < 0)
+                return STARIO_ERROR_NOT_AVAILABLE;
+
+            simPort->printRate = number / 1000.0;
+        }
+        else if (strcmp(token, "latency") == 0)
+        {
+            if ((number = simParseNumber(value, 0)) < 0)
+                return STARIO_ERROR_NOT_AVAILABLE;
+
+            simPort->latencyMillis = number;
+        }
+        else if (strcmp(token, "etb") == 0)
+        {
+            if ((number = simParseNumber(value, 0)) < 0)
+                return STARIO_ERROR_NOT_AVAILABLE;
+
+            simPort->etbAvailable = (number != 0)?1:0;
+        }
+        else if (strcmp(token, "card") == 0)
+        {
+            if (strcmp(value, "ack") == 0)          simPort->cardResponse = 'a';
+            else if (strcmp(value, "nak") == 0)     simPort->cardResponse = 'n';
+            else if (strcmp(value, "dle") == 0)     simPort->cardResponse = 'd';
+            else if (strcmp(value, "none") == 0)    simPort->cardResponse = 0;
+            else
+                return STARIO_ERROR_NOT_AVAILABLE;
+        }
+        else if (strcmp(token, "asb") == 0)
+        {
+            if (simParseScript(simPort, value) != STARIO_ERROR_SUCCESS)
+                return STARIO_ERROR_NOT_AVAILABLE;
+        }
+        else
+        {
+            return STARIO_ERROR_NOT_AVAILABLE;
+        }
+    }
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// device states in which nothing is printed
+static unsigned char simIsOffline(char state)
+{
+    return ((state == SIM_STATE_COVER_OPEN) || (state == SIM_STATE_PAPER_EMPTY) || (state == SIM_STATE_ERROR))?1:0;
+}
+
+// brings the model up to the current time - applies the asb script, prints
+// from the buffer at the print rate while online, and counts printed ETBs
+static void simAdvance(SimPort * simPort)
+{
+    struct timeval now;
+
+    GET_TIME(now);
+
+    double elapsedMillis = TIME_DIFF(simPort->lastUpdate,now);
+    double sinceOpenMillis = TIME_DIFF(simPort->openTime,now);
+
+    simPort->lastUpdate = now;
+
+    long i = 0;
+    for (; i < simPort->numEvents; i++)
+    {
+        if (simPort->events[i].atMillis <= sinceOpenMillis)
+        {
+            simPort->state = simPort->events[i].state;
+        }
+    }
+
+    if ((simIsOffline(simPort->state)) || (elapsedMillis <= 0))
+    {
+        return;
+    }
+
+    double printLength = simPort->printRate * elapsedMillis;
+
+    if (printLength >= simPort->bufferLevel)
+    {
+        // drained - set exactly, so rounding can not hold back the last ETB
+        simPort->bufferLevel = 0;
+        simPort->printedTotal = simPort->receivedTotal;
+    }
+    else
+    {
+        simPort->bufferLevel -= printLength;
+        simPort->printedTotal += printLength;
+    }
+
+    while ((simPort->numEtbs > 0) && (simPort->etbs[simPort->firstEtb] <= simPort->printedTotal))
+    {
+        simPort->firstEtb = (simPort->firstEtb + 1) % SIM_MAX_ETBS;
+        simPort->numEtbs--;
+
+        simPort->etbCounter = (simPort->etbCounter + 1) % 32;
+    }
+}
+
+static long simOpenPortPrv (char const * portName, char const * portSettings, void ** port)
+{
+    SimPort * oldSimPort = simFindPort(portName);
+    if (oldSimPort != NULL)
+    {
+        *port = oldSimPort;
+
+        return STARIO_ERROR_SUCCESS;
+    }
+
+    int i = 0;
+    for (; i < MAX_NUM_PORTS; i++)
+    {
+        if (simPorts[i].set == 0)
+            break;
+    }
+    if (i == MAX_NUM_PORTS)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    SimPort * simPort = &simPorts[i];
+
+    if ((strlen(portName) >= sizeof(simPort->portName)) || (strlen(portSettings) >= sizeof(simPort->portSettings)))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    memset(simPort, 0x00, sizeof(SimPort));
+
+    if (simParseSettings(simPort, portSettings) != STARIO_ERROR_SUCCESS)
+    {
+        memset(simPort, 0x00, sizeof(SimPort));
+
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    strcpy(simPort->portName, portName);
+    strcpy(simPort->portSettings, portSettings);
+
+    GET_TIME(simPort->openTime);
+    simPort->lastUpdate = simPort->openTime;
+    simPort->state = SIM_STATE_ONLINE;
+
+    simPort->set = 1;
+
+    *port = simPort;
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// the table lock is held across the whole open so that two opens can not claim one slot
+static long simOpenPort (char const * portName, char const * portSettings, void ** port)
+{
+    pthread_mutex_lock(&simPortsLock);
+
+    long result = simOpenPortPrv(portName, portSettings, port);
+
+    pthread_mutex_unlock(&simPortsLock);
+
+    return result;
+}
+
+// data is accepted at the line rate while the receive buffer has room; the
+// simulator does not parse commands, so every 0x17 byte written counts as an
+// ETB, printed once the data before it has been
+static long simWritePort (void * port, char const * writeBuffer, long length)
+{
+    SimPort * simPort = (SimPort *) port;
+    if (simPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    long timeout = SIM_WRITE_TIMEOUT;
+    long totalWriteLength = 0;
+
+    while ((totalWriteLength < length) && (timeout > 0))
+    {
+        simAdvance(simPort);
+
+        long space = simPort->bufferSize - (long) (simPort->bufferLevel + 0.999);
+
+        if (space <= 0)
+        {
+            // buffer full - wait for the printer to make room
+            simSleep(SIM_SLICE_MILLIS);
+            timeout -= SIM_SLICE_MILLIS;
+
+            continue;
+        }
+
+        long sliceLength = (long) (simPort->lineRate * SIM_SLICE_MILLIS);
+
+        if (sliceLength < 1)
+            sliceLength = 1;
+        if (sliceLength > space)
+            sliceLength = space;
+        if (sliceLength > (length - totalWriteLength))
+            sliceLength = length - totalWriteLength;
+
+        simSleep(sliceLength / simPort->lineRate);
+
+        simAdvance(simPort);
+
+        long i = 0;
+        for (; i < sliceLength; i++)
+        {
+            if ((writeBuffer[totalWriteLength + i] == 0x17) &&
+                (simPort->etbAvailable != 0) && (simPort->numEtbs < SIM_MAX_ETBS))
+            {
+                simPort->etbs[(simPort->firstEtb + simPort->numEtbs) % SIM_MAX_ETBS] = simPort->receivedTotal + i + 1;
+                simPort->numEtbs++;
+            }
+        }
+
+        simPort->bufferLevel += sliceLength;
+        simPort->receivedTotal += sliceLength;
+
+        totalWriteLength += sliceLength;
+
+        timeout = SIM_WRITE_TIMEOUT;
+    }
+
+    cbTimingWritten(&simPort->timing, totalWriteLength);
+
+    return totalWriteLength;
+}
+
+// the model has no queue between the host and the receive buffer
+static long simFlushPort (void * port)
+{
+    SimPort * simPort = (SimPort *) port;
+    if (simPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// the simulated device never sends application data
+static long simReadPort (void * port, char * readBuffer, long length)
+{
+    SimPort * simPort = (SimPort *) port;
+    if (simPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    return 0;
+}
+
+static long simGetStarPrinterStatus (void * port, StarPrinterStatus * status)
+{
+    SimPort * simPort = (SimPort *) port;
+    if (simPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    memset(status, 0x00, sizeof(StarPrinterStatus));
+
+    // request and response on the line
+    long statusLength = (simPort->etbAvailable != 0)?9:7;
+
+    simSleep(simPort->latencyMillis + (3 + statusLength) / simPort->lineRate);
+
+    simAdvance(simPort);
+
+    status->raw[0] = (simPort->etbAvailable != 0)?0x23:0x0f;
+    status->raw[1] = 0x86;
+
+    if (simIsOffline(simPort->state))
+    {
+        status->raw[2] |= 0x08;
+    }
+
+    if (simPort->state == SIM_STATE_COVER_OPEN)
+    {
+        status->raw[2] |= 0x20;
+    }
+
+    if (simPort->state == SIM_STATE_ERROR)
+    {
+        status->raw[3] |= 0x20;
+    }
+
+    if (simPort->state == SIM_STATE_PAPER_EMPTY)
+    {
+        status->raw[5] |= 0x08;
+    }
+
+    if (simPort->state == SIM_STATE_NEAR_EMPTY)
+    {
+        status->raw[5] |= 0x04;
+    }
+
+    unsigned char etbCounter = simPort->etbCounter;
+
+    status->raw[7] = ((etbCounter & 0x10) << 2) |
+                     ((etbCounter & 0x08) << 2) |
+                     ((etbCounter & 0x04) << 1) |
+                     ((etbCounter & 0x02) << 1) |
+                     ((etbCounter & 0x01) << 1);
+
+    status->rawLength = (unsigned char) statusLength;
+
+    asbDecode(status);
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+static long simBeginCheckedBlock (void * port)
+{
+    SimPort * simPort = (SimPort *) port;
+    if (simPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    long ioResult = simGetStarPrinterStatus(port, &simPort->statusCache);
+
+    if (ioResult != STARIO_ERROR_SUCCESS)
+    {
+        return ioResult;
+    }
+
+    if (simPort->statusCache.etbAvailable == 0)
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    cbTimingBegin(&simPort->timing);
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+static long simEndCheckedBlock (void * port, StarPrinterStatus * status)
+{
+    SimPort * simPort = (SimPort *) port;
+    if (simPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    if (simPort->statusCache.etbAvailable == 0)
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    memset(status, 0x00, sizeof(StarPrinterStatus));
+    status->offline = 1;
+
+    long ioResult = STARIO_ERROR_SUCCESS;
+
+    do
+    {
+        char etb[1] = {0x17};
+
+        ioResult = simWritePort(port, etb, 1);
+
+        if (ioResult == 1)
+        {
+            unsigned char nextEtbCounter = (simPort->statusCache.etbCounter + 1) % 32;
+
+            cbTimingEtb(&simPort->timing);
+
+            long attempt = 0;
+
+            do
+            {
+                ioResult = simGetStarPrinterStatus(port, status);
+
+                if ((ioResult >= STARIO_ERROR_SUCCESS) &&
+                    (status->offline == 0) &&
+                    (status->etbCounter != nextEtbCounter))
+                {
+                    long pollMillis = cbTimingPollMillis(&simPort->timing, attempt++);
+
+                    simSleep(pollMillis);
+
+                    continue;
+                }
+
+                break;
+            } while (1);
+
+            if ((ioResult >= STARIO_ERROR_SUCCESS) &&
+                (status->offline == 0))
+            {
+                cbTimingCompleted(&simPort->timing);
+            }
+        }
+
+        if (status->offline)
+        {
+            ioResult = simHdwrResetDevice(port);
+
+            if (ioResult != STARIO_ERROR_SUCCESS)
+            {
+                return ioResult;
+            }
+        }
+    } while (0);
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// a reset discards the receive buffer and clears the ETB counter; the
+// asb script's state is left as it is
+static long simHdwrResetDevice (void * port)
+{
+    SimPort * simPort = (SimPort *) port;
+    if (simPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    simSleep(10);
+
+    simAdvance(simPort);
+
+    simPort->bufferLevel = 0;
+    simPort->receivedTotal = 0;
+    simPort->printedTotal = 0;
+    simPort->firstEtb = 0;
+    simPort->numEtbs = 0;
+    simPort->etbCounter = 0;
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// answers as configured by "card=" - an ACK is followed by a response
+// packet with status 0 echoing the command's data
+static long simDoVisualCardCmd (void * port, VisualCardCmd * request, long timeoutMillis)
+{
+    SimPort * simPort = (SimPort *) port;
+    if (simPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    // stx, command, data, etx, bcc
+    simSleep(simPort->latencyMillis + (1 + 1 + request->txDataLength + 1 + 1 + 1) / simPort->lineRate);
+
+    switch (simPort->cardResponse)
+    {
+        case 'a':
+            break;
+
+        case 'd':
+            return STARIO_ERROR_DLE;
+
+        case 'n':
+            // every retransmission is refused until the timeout
+            simSleep(timeoutMillis);
+            return STARIO_ERROR_NAK;
+
+        default:
+            simSleep(timeoutMillis);
+            return STARIO_ERROR_NO_RESPONSE;
+    }
+
+    long rxDataLength = request->txDataLength;
+
+    if (rxDataLength > sizeof(request->rxData))
+    {
+        rxDataLength = sizeof(request->rxData);
+    }
+
+    simSleep(simPort->latencyMillis + (1 + 1 + 1 + rxDataLength + 1 + 1) / simPort->lineRate);
+
+    request->status = 0;
+    memcpy(request->rxData, request->txData, rxDataLength);
+    request->rxDataLength = (char) rxDataLength;
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+static long simClosePort (void * port)
+{
+    SimPort * simPort = (SimPort *) port;
+    if (simPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    pthread_mutex_lock(&simPortsLock);
+    memset(simPort, 0x00, sizeof(SimPort));
+    pthread_mutex_unlock(&simPortsLock);
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+static void simReleaseImpl ()
+{
+    int i = 0;
+    for (; i < MAX_NUM_PORTS; i++)
+    {
+        if (simPorts[i].set != 0)
+        {
+            simClosePort(&simPorts[i]);
+        }
+    }
+}
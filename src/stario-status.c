@@ -0,0 +1,129 @@
+/*
+    libstario.so
+    ------------
+    Library providing USB, serial, and parallel communications support for
+    Star Micronics devices.
+
+    Copyright (C) 2004 Star Micronics Co., Ltd.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stddef.h>
+
+#include "stario-status.h"
+
+// status bytes follow the two header bytes of the ASB response
+// 12 status bytes of 5 bits fill the 64 bit word - a 13th is only in raw
+#define ASB_HEADER_LENGTH       2
+#define ASB_NUM_PACKED_BYTES    12
+
+// one named StarPrinterStatus field - 'width' bits of the status word starting at 'bit'
+typedef struct
+{
+    unsigned char offset;
+    unsigned char bit;
+    unsigned char width;
+} AsbField;
+
+#define ASB_FIELD(name, statusByte, bit, width) \
+    { offsetof(StarPrinterStatus, name), STARIO_STATUS_BIT(statusByte, bit), width }
+
+// the five information bits of a status byte pack in order, so multi bit
+// values spread over bits 1, 2, 3, 5 and 6 come out of the word contiguous
+static AsbField const asbFields[] =
+{
+    // printer status 1
+    ASB_FIELD(coverOpen,                1, 5, 1),
+    ASB_FIELD(offline,                  1, 3, 1),
+    ASB_FIELD(compulsionSwitch,         1, 2, 1),
+
+    // printer status 2
+    ASB_FIELD(overTemp,                 2, 6, 1),
+    ASB_FIELD(unrecoverableError,       2, 5, 1),
+    ASB_FIELD(cutterError,              2, 3, 1),
+    ASB_FIELD(mechError,                2, 2, 1),
+
+    // printer status 3
+    ASB_FIELD(pageModeCmdError,         3, 5, 1),
+    ASB_FIELD(paperSizeError,           3, 3, 1),
+    ASB_FIELD(presenterPaperJamError,   3, 2, 1),
+    ASB_FIELD(headUpError,              3, 1, 1),
+
+    // printer status 4
+    ASB_FIELD(blackMarkDetectStatus,    4, 5, 1),
+    ASB_FIELD(paperEmpty,               4, 3, 1),
+    ASB_FIELD(paperNearEmptyInner,      4, 2, 1),
+    ASB_FIELD(paperNearEmptyOuter,      4, 1, 1),
+
+    // printer status 5
+    ASB_FIELD(stackerFull,              5, 1, 1),
+
+    // printer status 6 - bits 1, 2, 3, 5, 6
+    ASB_FIELD(etbCounter,               6, 1, 5),
+
+    // printer status 7 - bits 1, 2, 3
+    ASB_FIELD(presenterState,           7, 1, 3),
+};
+
+#define ASB_NUM_FIELDS  (sizeof(asbFields) / sizeof(asbFields[0]))
+
+void asbDecode(StarPrinterStatus * status)
+{
+    unsigned long long word = 0;
+    unsigned int length = status->rawLength;
+    unsigned int i;
+
+    // pack bits 1, 2, 3 and 5, 6 of each status byte; bytes past the end of
+    // the response are masked to 0 rather than tested
+    for (i = 0; i < ASB_NUM_PACKED_BYTES; i++)
+    {
+        unsigned int present = (unsigned int) (ASB_HEADER_LENGTH + i < length);
+        unsigned int value = status->raw[ASB_HEADER_LENGTH + i] & (0u - present);
+
+        word |= ((unsigned long long) (((value >> 1) & 0x07) | ((value >> 2) & 0x18))) << (i * 5);
+    }
+
+    status->statusWord = word;
+
+    for (i = 0; i < ASB_NUM_FIELDS; i++)
+    {
+        AsbField const * field = &asbFields[i];
+
+        ((unsigned char *) status)[field->offset] =
+            (unsigned char) ((word >> field->bit) & ((1u << field->width) - 1));
+    }
+
+    // printer status 6 is only sent by devices with an ETB counter
+    status->etbAvailable = (unsigned char) (length >= 9);
+}
+
+long asbFrameLength(unsigned char header)
+{
+    switch (header)
+    {
+        case 0x0f:  return  7;
+        case 0x21:  return  8;
+        case 0x23:  return  9;
+        case 0x25:  return 10;
+        case 0x27:  return 11;
+        case 0x29:  return 12;
+        case 0x2b:  return 13;
+        case 0x2d:  return 14;
+        case 0x2f:  return 15;
+    }
+
+    return 0;
+}
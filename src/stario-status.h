@@ -0,0 +1,38 @@
+/*
+    libstario.so
+    ------------
+    Library providing USB, serial, and parallel communications support for
+    Star Micronics devices.
+
+    Copyright (C) 2004 Star Micronics Co., Ltd.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _included_stario_status
+#define _included_stario_status
+
+#include "stario-structures.h"
+
+// ASB status decoding - shared by all backends
+// the caller fills raw and rawLength (at least 7 bytes), asbDecode fills
+// statusWord and every named field from them
+
+void asbDecode          (StarPrinterStatus * status);
+
+// length of the ASB frame started by header, 0 if header does not start one
+long asbFrameLength     (unsigned char header);
+
+#endif
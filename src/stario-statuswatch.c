@@ -0,0 +1,319 @@
+/*
+    libstario.so
+    ------------
+    Library providing USB, serial, and parallel communications support for
+    Star Micronics devices.
+
+    Copyright (C) 2004 Star Micronics Co., Ltd.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <memory.h>
+#include <pthread.h>
+
+#include "stario-error.h"
+#include "stario-checkedblock.h"
+#include "stario-statuswatch.h"
+
+// intervals between status reads of a subscribed port
+// polling runs at SW_MIN_POLL_MILLIS while the status changes and doubles up
+// to SW_MAX_POLL_MILLIS while it holds steady, so no change goes unreported
+// for more than half a second
+#define SW_MIN_POLL_MILLIS      100
+#define SW_MAX_POLL_MILLIS      400
+
+static long swBackoffMillis(long attempt)
+{
+    long pollMillis = SW_MIN_POLL_MILLIS;
+
+    for (; (attempt > 0) && (pollMillis < SW_MAX_POLL_MILLIS); attempt--)
+    {
+        pollMillis *= 2;
+    }
+
+    return (pollMillis < SW_MAX_POLL_MILLIS)?pollMillis:SW_MAX_POLL_MILLIS;
+}
+
+// guards every handle's status cache, and is broadcast as each read completes
+static pthread_mutex_t swCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t swReadDone = PTHREAD_COND_INITIALIZER;
+
+void swInitCache (StarIOHandle * handle)
+{
+    pthread_mutex_lock(&swCacheLock);
+
+    // the count of reads carries on, so that no caller takes a reset for a read
+    long reads = handle->lastStatus.reads;
+
+    memset(&handle->lastStatus, 0x00, sizeof(StatusCache));
+
+    handle->lastStatus.reads = reads;
+
+    pthread_mutex_unlock(&swCacheLock);
+}
+
+long swReadStatus (StarIOHandle * handle, StarPrinterStatus * status)
+{
+    StatusCache * cache = &handle->lastStatus;
+
+    pthread_mutex_lock(&swCacheLock);
+
+    cache->reading = 1;
+    GET_TIME(cache->started);
+
+    pthread_mutex_unlock(&swCacheLock);
+
+    long result = handle->impl->getStarPrinterStatus(handle->port, status);
+
+    pthread_mutex_lock(&swCacheLock);
+
+    if (result == STARIO_ERROR_SUCCESS)
+    {
+        memcpy(&cache->status, status, sizeof(StarPrinterStatus));
+        GET_TIME(cache->received);
+        cache->valid = 1;
+    }
+
+    cache->reading = 0;
+    cache->lastResult = result;
+    cache->reads++;
+
+    pthread_cond_broadcast(&swReadDone);
+    pthread_mutex_unlock(&swCacheLock);
+
+    return result;
+}
+
+int swShareStatus (StarIOHandle * handle, StarPrinterStatus * status, long maxAgeMillis, long * result, long * reads)
+{
+    StatusCache * cache = &handle->lastStatus;
+
+    pthread_mutex_lock(&swCacheLock);
+
+    *reads = cache->reads;
+
+    // a read in progress is shared, whatever maxAgeMillis - it ends no
+    // earlier than one the caller would start now
+    if (cache->reading != 0)
+    {
+        while (cache->reads == *reads)
+        {
+            pthread_cond_wait(&swReadDone, &swCacheLock);
+        }
+
+        *result = cache->lastResult;
+
+        if (*result == STARIO_ERROR_SUCCESS)
+        {
+            memcpy(status, &cache->status, sizeof(StarPrinterStatus));
+        }
+
+        pthread_mutex_unlock(&swCacheLock);
+
+        return 1;
+    }
+
+    if ((cache->valid != 0) && (maxAgeMillis > 0))
+    {
+        struct timeval now;
+
+        GET_TIME(now);
+
+        if (TIME_DIFF(cache->received,now) <= maxAgeMillis)
+        {
+            memcpy(status, &cache->status, sizeof(StarPrinterStatus));
+
+            *result = STARIO_ERROR_SUCCESS;
+
+            pthread_mutex_unlock(&swCacheLock);
+
+            return 1;
+        }
+    }
+
+    pthread_mutex_unlock(&swCacheLock);
+
+    return 0;
+}
+
+// reads is the count swShareStatus saw, before the caller waited for the handle's lock
+long swGetCachedStatus (StarIOHandle * handle, StarPrinterStatus * status, long reads, long maxAgeMillis)
+{
+    StatusCache * cache = &handle->lastStatus;
+
+    pthread_mutex_lock(&swCacheLock);
+
+    // no read was in progress when the caller asked, so one completed since
+    // began while the caller waited for the port - it is as fresh as one
+    // the caller would make itself
+    if ((reads >= 0) && (cache->reads != reads))
+    {
+        long result = cache->lastResult;
+
+        if (result == STARIO_ERROR_SUCCESS)
+        {
+            memcpy(status, &cache->status, sizeof(StarPrinterStatus));
+        }
+
+        pthread_mutex_unlock(&swCacheLock);
+
+        return result;
+    }
+
+    if (cache->valid != 0)
+    {
+        struct timeval now;
+
+        GET_TIME(now);
+
+        if (TIME_DIFF(cache->received,now) <= maxAgeMillis)
+        {
+            memcpy(status, &cache->status, sizeof(StarPrinterStatus));
+
+            pthread_mutex_unlock(&swCacheLock);
+
+            return STARIO_ERROR_SUCCESS;
+        }
+    }
+
+    pthread_mutex_unlock(&swCacheLock);
+
+    return swReadStatus(handle, status);
+}
+
+void swInitWatch (StarIOHandle * handle)
+{
+    memset(&handle->watch, 0x00, sizeof(StatusWatch));
+}
+
+long swSubscribe (StarIOHandle * handle, StatusChangeCallback callback, void * userData)
+{
+    StatusWatch * watch = &handle->watch;
+
+    if ((callback == NULL) || (handle->impl->getStarPrinterStatus == 0))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    // the first status read after subscribing is reported in full
+    watch->active = 1;
+    watch->callback = callback;
+    watch->userData = userData;
+    watch->haveLast = 0;
+    watch->attempt = 0;
+
+    GET_TIME(watch->nextPoll);
+
+    long result = cbSupervisorAdd(handle);
+
+    if (result != STARIO_ERROR_SUCCESS)
+    {
+        swInitWatch(handle);
+    }
+
+    return result;
+}
+
+long swUnsubscribe (StarIOHandle * handle)
+{
+    swInitWatch(handle);
+
+    cbSupervisorRemove(handle);
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+long swSuperviseHandle (StarIOHandle * handle, StarPrinterStatus * status, unsigned long long * changedMask, StatusChangeCallback * callback, void ** userData)
+{
+    *changedMask = 0;
+
+    // a port busy with application i/o is retried shortly
+    if (pthread_mutex_trylock(&handle->lock) != 0)
+    {
+        return SW_MIN_POLL_MILLIS;
+    }
+
+    StatusWatch * watch = &handle->watch;
+
+    if ((watch->active == 0) || (handle->port == NULL))
+    {
+        pthread_mutex_unlock(&handle->lock);
+
+        return -1;
+    }
+
+    struct timeval now;
+
+    GET_TIME(now);
+
+    long waitMillis = (long) TIME_DIFF(now,watch->nextPoll);
+
+    if (waitMillis > 0)
+    {
+        pthread_mutex_unlock(&handle->lock);
+
+        return waitMillis;
+    }
+
+    long ioResult = swReadStatus(handle, status);
+
+    if (ioResult != STARIO_ERROR_SUCCESS)
+    {
+        // no status (i.e. usb device unplugged) - reported once, as offline
+        memset(status, 0x00, sizeof(StarPrinterStatus));
+
+        status->offline = 1;
+        status->statusWord = (1ULL << STARIO_STATUS_BIT(1, 3)) | STARIO_STATUS_READ_FAILED;
+    }
+
+    if (watch->haveLast == 0)
+    {
+        *changedMask = ~0ULL;
+    }
+    else
+    {
+        *changedMask = watch->last.statusWord ^ status->statusWord;
+    }
+
+    if (*changedMask != 0)
+    {
+        memcpy(&watch->last, status, sizeof(StarPrinterStatus));
+        watch->haveLast = 1;
+        watch->attempt = 0;
+
+        *callback = watch->callback;
+        *userData = watch->userData;
+    }
+    else
+    {
+        watch->attempt++;
+    }
+
+    waitMillis = swBackoffMillis(watch->attempt);
+
+    GET_TIME(watch->nextPoll);
+    watch->nextPoll.tv_sec += waitMillis / 1000;
+    watch->nextPoll.tv_usec += (waitMillis % 1000) * 1000;
+    if (watch->nextPoll.tv_usec >= 1000 * 1000)
+    {
+        watch->nextPoll.tv_sec += 1;
+        watch->nextPoll.tv_usec -= 1000 * 1000;
+    }
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return waitMillis;
+}
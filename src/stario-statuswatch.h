@@ -0,0 +1,54 @@
+/*
+    libstario.so
+    ------------
+    Library providing USB, serial, and parallel communications support for
+    Star Micronics devices.
+
+    Copyright (C) 2004 Star Micronics Co., Ltd.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _included_stario_statuswatch
+#define _included_stario_statuswatch
+
+#include "stario-prvstructures.h"
+
+// status change subscription - the checked block supervisor thread reads the
+// status of every subscribed port and reports statusWord differences
+// all but swSuperviseHandle are called with the handle's lock held
+
+// status cache - every status read made through a handle goes through
+// swReadStatus, so the cache holds the newest status whoever asked for it
+
+void swInitCache        (StarIOHandle * handle);
+long swReadStatus       (StarIOHandle * handle, StarPrinterStatus * status);
+// called without the handle's lock - takes the result of a read in progress,
+// or a status no older than maxAgeMillis, into status and result
+// returns 0 if the caller must lock the handle and call swGetCachedStatus
+// with the count of reads left in reads, or -1 if it locks another handle
+int  swShareStatus      (StarIOHandle * handle, StarPrinterStatus * status, long maxAgeMillis, long * result, long * reads);
+long swGetCachedStatus  (StarIOHandle * handle, StarPrinterStatus * status, long reads, long maxAgeMillis);
+
+void swInitWatch        (StarIOHandle * handle);
+long swSubscribe        (StarIOHandle * handle, StatusChangeCallback callback, void * userData);
+long swUnsubscribe      (StarIOHandle * handle);
+
+// called by the supervisor thread - polls the port if it is due, and returns
+// a change for the callback in changedMask (0 if none) with the port unlocked
+// returns the milliseconds until the port next needs a poll, -1 if not subscribed
+long swSuperviseHandle  (StarIOHandle * handle, StarPrinterStatus * status, unsigned long long * changedMask, StatusChangeCallback * callback, void ** userData);
+
+#endif
@@ -52,8 +52,39 @@ typedef struct
     unsigned char presenterState;           // 0 ~ 7 integer value
     unsigned char rawLength;                // 0 ~ 63 integer value
     unsigned char raw[63];                  // binary status according to Star ASB specification
+    unsigned long long statusWord;          // packed status bytes, see STARIO_STATUS_BIT
 } StarPrinterStatus;
 
+// STARIO_STATUS_BIT - macro
+// -----------------
+//
+// Bit position within StarPrinterStatus.statusWord of bit 'bit' of ASB
+// printer status byte 'statusByte' (1 ~ 12, as numbered by the ASB
+// specification, status byte 1 being raw[2]).
+//
+// Each status byte carries information in bits 1, 2, 3, 5 and 6 only; the
+// word packs these five bits per byte, so status bytes 1 ~ 12 occupy bits
+// 0 ~ 59 and bits absent from the device's response read as 0.  Two status
+// words may be compared directly to detect any change in device state, and
+// model specific extended status bytes (8 and up) can be tested without a
+// dedicated structure field, e.g.
+//
+//     if (status.statusWord & (1ULL << STARIO_STATUS_BIT(8, 2))) ...
+//
+// Its 65 bits do not fit the word, so status byte 13 of the longest (15 byte)
+// response is left out; read it from raw[14] when rawLength is 15.
+#define STARIO_STATUS_BIT(statusByte, bit) \
+    (((statusByte) - 1) * 5 + (((bit) < 4) ? ((bit) - 1) : ((bit) - 2)))
+
+// STARIO_STATUS_READ_FAILED - macro
+// -------------------------
+//
+// statusWord bit never set by a device.  A StatusChangeCallback receives it
+// in a status standing in for one that could not be read; that status is
+// empty but for offline (and its statusWord bit), so the failure shows in
+// changedMask as well as the recovery when a read next succeeds.
+#define STARIO_STATUS_READ_FAILED   (1ULL << 63)
+
 // VisualCardCmd - structure
 // -------------
 //
@@ -73,4 +104,70 @@ typedef struct
     char rxDataLength;      // length of data from response in bytes
 } VisualCardCmd;
 
+// CheckedBlockCompletion - structure
+// ----------------------
+//
+// Outcome of one pipelined checked block, as reported by
+// getCheckedBlockCompletions.  The block is identified by the ETB counter
+// value returned when it was submitted.
+typedef struct
+{
+    unsigned char etbCounter;               // 0 ~ 31 tag returned by submitCheckedBlock
+    unsigned char failed;                   // 1 -> device went offline before the block printed, 0 -> printed
+    StarPrinterStatus status;               // status read when the completion was observed
+} CheckedBlockCompletion;
+
+// StarIODither - enumeration
+// ------------
+//
+// How buildRasterJob reduces gray levels to black and white dots.
+typedef enum
+{
+    STARIO_DITHER_NONE              = 0,    // black below threshold
+    STARIO_DITHER_ORDERED           = 1,    // 8 x 8 Bayer matrix, fast, suits logos and charts
+    STARIO_DITHER_FLOYD_STEINBERG   = 2,    // error diffusion, suits photos
+    STARIO_DITHER_ATKINSON          = 3     // error diffusion of 3/4 of the error, higher contrast
+} StarIODither;
+
+// RasterOptions - structure
+// -------------
+//
+// Controls the conversion of a grayscale image to Star raster graphics
+// commands by buildRasterJob.  Gray values run from 0 (black) to 255
+// (white).
+typedef struct
+{
+    unsigned char threshold;                // pixels with a gray value below this print black, i.e. 128, or 1 for pure black only - not used by ordered dithering
+    unsigned char cut;                      // 1 -> feed and cut after the image (ESC d 3), 0 -> not
+    unsigned char dither;                   // StarIODither value
+    unsigned char compact;                  // 1 -> send each line only up to its last black dot, and blank lines as paper feed (ESC * r Y), 0 -> full lines
+} RasterOptions;
+
+// StarIOHandle - opaque type
+// ------------
+//
+// Handle to an open port as returned by openPortHandle.  The handle binds
+// the port to its supporting implementation once, so calls made through
+// it skip the portName lookup performed by the string based api.
+typedef struct StarIOHandle StarIOHandle;
+
+// CheckedBlockCallback - function type
+// --------------------
+//
+// Receives pipelined checked block completions from the library's
+// supervisor thread, as enabled by enableCheckedBlockNotify.  It must not
+// block for long; it may call back into the library.
+typedef void (* CheckedBlockCallback) (StarIOHandle * handle, CheckedBlockCompletion const * completion, void * userData);
+
+// StatusChangeCallback - function type
+// --------------------
+//
+// Receives device status changes from the library's supervisor thread, as
+// requested by subscribeStatusChanges.  changedMask holds the statusWord
+// bits that differ from the previously reported status (see
+// STARIO_STATUS_BIT); it is all ones for the first report.  A status read
+// failure is reported as a change too (see STARIO_STATUS_READ_FAILED).  It
+// must not block for long; it may call back into the library.
+typedef void (* StatusChangeCallback) (StarIOHandle * handle, unsigned long long changedMask, StarPrinterStatus const * status, void * userData);
+
 #endif
@@ -0,0 +1,1218 @@
+/*
+    libstario.so
+    ------------
+    Library providing USB, serial, and parallel communications support for
+    Star Micronics devices.
+
+    Copyright (C) 2004 Star Micronics Co., Ltd.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <memory.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <linux/sockios.h>
+
+#include "stario-error.h"
+#include "stario-status.h"
+#include "stario-tcp.h"
+#include "stario-checkedblock.h"
+
+static long tcpMatchPortName        (char const * portName);
+static long tcpOpenPort             (char const * portName, char const * portSettings, void ** port);
+static long tcpWritePort            (void * port, char const * writeBuffer, long length);
+static long tcpFlushPort            (void * port);
+static long tcpReadPort             (void * port, char * readBuffer, long length);
+static long tcpGetStarPrinterStatus (void * port, StarPrinterStatus * status);
+static long tcpBeginCheckedBlock    (void * port);
+static long tcpEndCheckedBlock      (void * port, StarPrinterStatus * status);
+static long tcpHdwrResetDevice      (void * port);
+static long tcpClosePort            (void * port);
+static void tcpReleaseImpl          ();
+
+#define MAX_NUM_PORTS 20
+
+// raw printing port, and the port star ethernet printers answer status requests on
+#define TCP_DEFAULT_PORT        "9100"
+#define TCP_DEFAULT_STATUS_PORT "9101"
+
+// maximum time to establish a connection
+#define TCP_CONNECT_TIMEOUT     3000
+
+// maximum time without the device accepting any output data
+#define TCP_WRITE_TIMEOUT       5000
+
+// socket send buffer requested unless portSettings says otherwise - large
+// enough to keep a raster job streaming while the application renders
+#define TCP_DEFAULT_SNDBUF      (1024 * 1024)
+
+// application data received and not yet read - the oldest is dropped beyond this
+#define TCP_RX_BUFFER_SIZE      4096
+
+// a partial ASB frame with no further input for this long was application data
+#define TCP_ASB_GAP_MILLIS      50
+
+// longest ASB frame - header 0x2f
+#define TCP_ASB_MAX_LENGTH      15
+
+typedef struct
+{
+    unsigned char set;
+    char portName[100];
+    char portSettings[100];
+
+    char host[100];
+    char service[16];
+    char statusService[16];             // empty if status is requested on the data connection
+    long noDelay;                       // TCP_NODELAY on the data connection
+    long sendBuffer;                    // SO_SNDBUF requested for the data connection, 0 for the system default
+
+    int sock;                           // data connection
+    int statusSock;                     // status connection, -1 until first used or after a failure
+
+    // receive layer - with status on the data connection, its input is split
+    // into ASB frames and application data
+    unsigned char rxData[TCP_RX_BUFFER_SIZE];   // application data not yet read - ring
+    long rxFirst;                       // index of the oldest byte in rxData
+    long rxLength;                      // count of bytes in rxData
+    struct timeval rxTime;              // when input last arrived
+    unsigned char asbFrame[TCP_ASB_MAX_LENGTH]; // ASB frame being received
+    long asbFrameLength;                // bytes of asbFrame received, 0 if none
+    long asbFrameExpected;              // length given by the frame's header
+    StarPrinterStatus asbStatus;        // last complete ASB frame, decoded
+    unsigned long asbFrames;            // count of complete ASB frames received
+    long asbRequested;                  // status requests still awaiting their response
+
+    StarPrinterStatus statusCache;
+    CheckedBlockTiming timing;          // print time estimate pacing endCheckedBlock polls
+} TcpPort;
+
+static TcpPort tcpPorts[MAX_NUM_PORTS];
+
+// guards tcpPorts slots - held by open and close only,
+// port i/o is serialised per port by the caller
+static pthread_mutex_t tcpPortsLock = PTHREAD_MUTEX_INITIALIZER;
+
+PortImpl getTcpPortImpl()
+{
+    memset(tcpPorts, 0x00, sizeof(tcpPorts));
+
+    PortImpl impl;
+
+    memset(&impl, 0x00, sizeof(PortImpl));
+
+    impl.matchPortName          = tcpMatchPortName;
+    impl.openPort               = tcpOpenPort;
+    impl.writePort              = tcpWritePort;
+    impl.flushPort              = tcpFlushPort;
+    impl.readPort               = tcpReadPort;
+    impl.getStarPrinterStatus   = tcpGetStarPrinterStatus;
+    impl.beginCheckedBlock      = tcpBeginCheckedBlock;
+    impl.endCheckedBlock        = tcpEndCheckedBlock;
+    impl.hdwrResetDevice        = tcpHdwrResetDevice;
+    impl.doVisualCardCmd        = 0;
+    impl.closePort              = tcpClosePort;
+    impl.releaseImpl            = tcpReleaseImpl;
+
+    return impl;
+}
+
+static TcpPort * tcpFindPort(char const * portName)
+{
+    int i = 0;
+    for (; i < MAX_NUM_PORTS; i++)
+    {
+        if (tcpPorts[i].set != 0)
+            if (strcmp(tcpPorts[i].portName, portName) == 0)
+                break;
+    }
+
+    if (i == MAX_NUM_PORTS)
+    {
+        return NULL;
+    }
+
+    return &tcpPorts[i];
+}
+
+static long tcpMatchPortName (char const * portName)
+{
+    if (strncmp(portName, "tcp:", 4) == 0)
+    {
+        return STARIO_ERROR_SUCCESS;
+    }
+
+    return STARIO_ERROR_NOT_AVAILABLE;
+}
+
+// splits "tcp:host", "tcp:host:port" or "tcp:[v6 address]:port" into host and service
+static long tcpParsePortName(TcpPort * tcpPort, char const * portName)
+{
+    char const * host = &portName[4];
+    char const * hostEnd = NULL;
+    char const * service = NULL;
+
+    if (host[0] == '[')
+    {
+        host++;
+
+        hostEnd = strchr(host, ']');
+        if (hostEnd == NULL)
+        {
+            return STARIO_ERROR_NOT_AVAILABLE;
+        }
+
+        if (hostEnd[1] == ':')
+        {
+            service = &hostEnd[2];
+        }
+        else if (hostEnd[1] != 0)
+        {
+            return STARIO_ERROR_NOT_AVAILABLE;
+        }
+    }
+    else
+    {
+        hostEnd = strchr(host, ':');
+
+        if (hostEnd != NULL)
+        {
+            service = &hostEnd[1];
+        }
+        else
+        {
+            hostEnd = &host[strlen(host)];
+        }
+    }
+
+    if ((hostEnd == host) || ((hostEnd - host) >= sizeof(tcpPort->host)))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    memcpy(tcpPort->host, host, hostEnd - host);
+    tcpPort->host[hostEnd - host] = 0;
+
+    if ((service == NULL) || (service[0] == 0))
+    {
+        service = TCP_DEFAULT_PORT;
+    }
+
+    if ((strlen(service) >= sizeof(tcpPort->service)) || (strspn(service, "0123456789") != strlen(service)))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    strcpy(tcpPort->service, service);
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// portSettings - comma separated, each optional:
+//   "nodelay=1" or "nodelay=0"   TCP_NODELAY on the data connection (default 1)
+//   "sndbuf=n"                   socket send buffer in bytes, 0 for the system default
+//   "status=n"                   status port, 0 to request status on the data connection
+static long tcpParseSettings(TcpPort * tcpPort, char const * portSettings)
+{
+    tcpPort->noDelay = 1;
+    tcpPort->sendBuffer = TCP_DEFAULT_SNDBUF;
+    strcpy(tcpPort->statusService, TCP_DEFAULT_STATUS_PORT);
+
+    char settings[100];
+
+    if (strlen(portSettings) >= sizeof(settings))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    strcpy(settings, portSettings);
+
+    char * savePtr = NULL;
+    char * token = strtok_r(settings, ",", &savePtr);
+
+    for (; token != NULL; token = strtok_r(NULL, ",", &savePtr))
+    {
+        char * value = strchr(token, '=');
+
+        if ((value == NULL) || (value[1] == 0) || (strspn(&value[1], "0123456789") != strlen(&value[1])))
+        {
+            return STARIO_ERROR_NOT_AVAILABLE;
+        }
+
+        *value++ = 0;
+
+        if (strcmp(token, "nodelay") == 0)
+        {
+            tcpPort->noDelay = (atol(value) != 0)?1:0;
+        }
+        else if (strcmp(token, "sndbuf") == 0)
+        {
+            tcpPort->sendBuffer = atol(value);
+        }
+        else if (strcmp(token, "status") == 0)
+        {
+            if (strlen(value) >= sizeof(tcpPort->statusService))
+            {
+                return STARIO_ERROR_NOT_AVAILABLE;
+            }
+
+            if (atol(value) == 0)
+            {
+                tcpPort->statusService[0] = 0;
+            }
+            else
+            {
+                strcpy(tcpPort->statusService, value);
+            }
+        }
+        else
+        {
+            return STARIO_ERROR_NOT_AVAILABLE;
+        }
+    }
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// waits for the socket to become ready for events
+// returns 1 when ready, 0 on timeout
+static long tcpWaitPrv(int sock, short events, long timeMillis)
+{
+    struct pollfd sockPoll = {sock, events, 0};
+
+    int pollResult = poll(&sockPoll, 1, timeMillis);
+
+    if (pollResult == -1)
+    {
+        return (errno == EINTR)?0:STARIO_ERROR_IO_FAIL;
+    }
+
+    if ((pollResult == 1) && ((sockPoll.revents & (POLLERR | POLLNVAL)) != 0))
+    {
+        return STARIO_ERROR_IO_FAIL;
+    }
+
+    return pollResult;
+}
+
+// opens a non-blocking connection to host:service
+// returns the socket, or an error
+static long tcpConnectPrv(char const * host, char const * service, long noDelay, long sendBuffer)
+{
+    struct addrinfo hints;
+
+    memset(&hints, 0x00, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo * addresses = NULL;
+
+    if (getaddrinfo(host, service, &hints, &addresses) != 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    long result = STARIO_ERROR_NOT_OPEN;
+
+    struct addrinfo * address = addresses;
+    for (; address != NULL; address = address->ai_next)
+    {
+        int sock = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, address->ai_protocol);
+
+        if (sock == -1)
+        {
+            continue;
+        }
+
+        int option = (int) noDelay;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+
+        // before connecting, so the window scale negotiated allows for it
+        if (sendBuffer > 0)
+        {
+            option = (int) sendBuffer;
+            setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &option, sizeof(option));
+        }
+
+        if ((connect(sock, address->ai_addr, address->ai_addrlen) == 0) ||
+            ((errno == EINPROGRESS) && (tcpWaitPrv(sock, POLLOUT, TCP_CONNECT_TIMEOUT) == 1)))
+        {
+            int sockError = 0;
+            socklen_t sockErrorLength = sizeof(sockError);
+
+            if ((getsockopt(sock, SOL_SOCKET, SO_ERROR, &sockError, &sockErrorLength) == 0) && (sockError == 0))
+            {
+                result = sock;
+
+                break;
+            }
+        }
+
+        close(sock);
+    }
+
+    freeaddrinfo(addresses);
+
+    return result;
+}
+
+static long tcpOpenPortPrv (char const * portName, char const * portSettings, void ** port)
+{
+    TcpPort * oldTcpPort = tcpFindPort(portName);
+    if (oldTcpPort != NULL)
+    {
+        *port = oldTcpPort;
+
+        return STARIO_ERROR_SUCCESS;
+    }
+
+    int i = 0;
+    for (; i < MAX_NUM_PORTS; i++)
+    {
+        if (tcpPorts[i].set == 0)
+            break;
+    }
+    if (i == MAX_NUM_PORTS)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    TcpPort tcpPort;
+
+    memset(&tcpPort, 0x00, sizeof(TcpPort));
+
+    if ((strlen(portName) >= sizeof(tcpPort.portName)) || (strlen(portSettings) >= sizeof(tcpPort.portSettings)))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    strcpy(tcpPort.portName, portName);
+    strcpy(tcpPort.portSettings, portSettings);
+
+    long result = tcpParsePortName(&tcpPort, portName);
+    if (result != STARIO_ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    result = tcpParseSettings(&tcpPort, portSettings);
+    if (result != STARIO_ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    result = tcpConnectPrv(tcpPort.host, tcpPort.service, tcpPort.noDelay, tcpPort.sendBuffer);
+    if (result < STARIO_ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    tcpPort.set = 1;
+    tcpPort.sock = (int) result;
+    tcpPort.statusSock = -1;
+
+    memcpy(&tcpPorts[i], &tcpPort, sizeof(TcpPort));
+
+    *port = &tcpPorts[i];
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// the table lock is held across the whole open so that two opens can not claim one slot
+static long tcpOpenPort (char const * portName, char const * portSettings, void ** port)
+{
+    pthread_mutex_lock(&tcpPortsLock);
+
+    long result = tcpOpenPortPrv(portName, portSettings, port);
+
+    pthread_mutex_unlock(&tcpPortsLock);
+
+    return result;
+}
+
+// queues all of writeBuffer on a socket, waiting while the device is not accepting data
+static long tcpSendPrv(int sock, char const * writeBuffer, long length)
+{
+    long timeout = TCP_WRITE_TIMEOUT;
+    long totalWriteLength = 0;
+
+    while ((totalWriteLength < length) && (timeout > 0))
+    {
+        long partialWriteLength = send(sock, &writeBuffer[totalWriteLength], length - totalWriteLength, MSG_NOSIGNAL);
+
+        if (partialWriteLength > 0)
+        {
+            totalWriteLength += partialWriteLength;
+
+            timeout = TCP_WRITE_TIMEOUT;
+
+            continue;
+        }
+
+        if ((partialWriteLength == -1) && (errno != EAGAIN) && (errno != EINTR))
+        {
+            return STARIO_ERROR_IO_FAIL;
+        }
+
+        // send buffer full - sleep until the device has taken some of it
+        struct timeval timeS;
+        struct timeval timeF;
+
+        GET_TIME(timeS);
+        long waitResult = tcpWaitPrv(sock, POLLOUT, timeout);
+        GET_TIME(timeF);
+
+        if (waitResult < STARIO_ERROR_SUCCESS)
+        {
+            return waitResult;
+        }
+
+        long interval = TIME_DIFF(timeS,timeF);
+
+        if (timeout > interval)
+            timeout -= interval;
+        else
+            timeout = 0;
+    }
+
+    return totalWriteLength;
+}
+
+// reads at least minLength bytes, timeMillis being the maximum time without any data arriving
+static long tcpRecvPrv(int sock, char * readBuffer, long length, long minLength, long timeMillis)
+{
+    long totalReadLength = 0;
+    long timeout = timeMillis;
+
+    while ((totalReadLength < minLength) && (timeout > 0))
+    {
+        long partialReadLength = recv(sock, &readBuffer[totalReadLength], length - totalReadLength, 0);
+
+        if (partialReadLength > 0)
+        {
+            totalReadLength += partialReadLength;
+
+            timeout = timeMillis;
+
+            continue;
+        }
+
+        if (partialReadLength == 0)
+        {
+            // connection closed by the device
+            return STARIO_ERROR_IO_FAIL;
+        }
+
+        if ((errno != EAGAIN) && (errno != EINTR))
+        {
+            return STARIO_ERROR_IO_FAIL;
+        }
+
+        struct timeval timeS;
+        struct timeval timeF;
+
+        GET_TIME(timeS);
+        long waitResult = tcpWaitPrv(sock, POLLIN, timeout);
+        GET_TIME(timeF);
+
+        if (waitResult < STARIO_ERROR_SUCCESS)
+        {
+            return waitResult;
+        }
+
+        long interval = TIME_DIFF(timeS,timeF);
+
+        if (timeout > interval)
+            timeout -= interval;
+        else
+            timeout = 0;
+    }
+
+    if (totalReadLength == 0)
+    {
+        return (minLength > 0)?STARIO_ERROR_IO_FAIL:0;
+    }
+
+    return totalReadLength;
+}
+
+// receive layer
+// with status requested on the data connection, its response arrives among
+// the application data; frames are taken out into asbStatus while a request
+// is outstanding and the rest is queued in rxData for readPort
+
+static void tcpRxPut(TcpPort * tcpPort, unsigned char data)
+{
+    if (tcpPort->rxLength == TCP_RX_BUFFER_SIZE)
+    {
+        tcpPort->rxFirst = (tcpPort->rxFirst + 1) % TCP_RX_BUFFER_SIZE;
+        tcpPort->rxLength--;
+    }
+
+    tcpPort->rxData[(tcpPort->rxFirst + tcpPort->rxLength) % TCP_RX_BUFFER_SIZE] = data;
+    tcpPort->rxLength++;
+}
+
+static long tcpRxTake(TcpPort * tcpPort, char * readBuffer, long length)
+{
+    long takeLength = 0;
+
+    for (; (takeLength < length) && (tcpPort->rxLength > 0); takeLength++)
+    {
+        readBuffer[takeLength] = tcpPort->rxData[tcpPort->rxFirst];
+
+        tcpPort->rxFirst = (tcpPort->rxFirst + 1) % TCP_RX_BUFFER_SIZE;
+        tcpPort->rxLength--;
+    }
+
+    return takeLength;
+}
+
+static void tcpDemuxPrv(TcpPort * tcpPort, unsigned char data);
+
+// the bytes held as a partial ASB frame were application data after all
+// the header goes to rxData and the rest is examined again, as it may hold a real frame
+static void tcpAsbRejectPrv(TcpPort * tcpPort)
+{
+    unsigned char held[TCP_ASB_MAX_LENGTH];
+    long heldLength = tcpPort->asbFrameLength;
+
+    memcpy(held, tcpPort->asbFrame, heldLength);
+
+    tcpPort->asbFrameLength = 0;
+
+    tcpRxPut(tcpPort, held[0]);
+
+    long i = 1;
+    for (; i < heldLength; i++)
+    {
+        tcpDemuxPrv(tcpPort, held[i]);
+    }
+}
+
+static void tcpDemuxPrv(TcpPort * tcpPort, unsigned char data)
+{
+    // ASB frames are only looked for while a response is awaited - otherwise
+    // any byte 0x0f or 0x21 ~ 0x2f of application data could start one
+    if ((tcpPort->asbFrameLength == 0) && (tcpPort->asbRequested == 0))
+    {
+        tcpRxPut(tcpPort, data);
+
+        return;
+    }
+
+    if (tcpPort->asbFrameLength == 0)
+    {
+        long frameLength = asbFrameLength(data);
+
+        if (frameLength == 0)
+        {
+            tcpRxPut(tcpPort, data);
+
+            return;
+        }
+
+        tcpPort->asbFrame[0] = data;
+        tcpPort->asbFrameLength = 1;
+        tcpPort->asbFrameExpected = frameLength;
+
+        return;
+    }
+
+    // bits 0 and 4 of the second header byte and bits 0, 4 and 7 of every
+    // status byte are 0
+    if (((tcpPort->asbFrameLength == 1) && ((data & 0x11) != 0)) ||
+        ((tcpPort->asbFrameLength >= 2) && ((data & 0x91) != 0)))
+    {
+        tcpAsbRejectPrv(tcpPort);
+        tcpDemuxPrv(tcpPort, data);
+
+        return;
+    }
+
+    tcpPort->asbFrame[tcpPort->asbFrameLength++] = data;
+
+    if (tcpPort->asbFrameLength < tcpPort->asbFrameExpected)
+    {
+        return;
+    }
+
+    StarPrinterStatus * status = &tcpPort->asbStatus;
+
+    memset(status, 0x00, sizeof(StarPrinterStatus));
+    memcpy(status->raw, tcpPort->asbFrame, tcpPort->asbFrameLength);
+    status->rawLength = (unsigned char) tcpPort->asbFrameLength;
+
+    asbDecode(status);
+
+    tcpPort->asbFrameLength = 0;
+    tcpPort->asbFrames++;
+
+    if (tcpPort->asbRequested > 0)
+    {
+        tcpPort->asbRequested--;
+    }
+}
+
+// reads what the data connection holds, waiting up to timeMillis for it, and demultiplexes it
+// returns the number of bytes read, 0 if none arrived
+static long tcpReceivePrv(TcpPort * tcpPort, long timeMillis)
+{
+    // a partial frame is given up after a gap, so application data that
+    // merely starts like an ASB header is not held back for long
+    if ((tcpPort->asbFrameLength > 0) && (timeMillis > TCP_ASB_GAP_MILLIS))
+    {
+        timeMillis = TCP_ASB_GAP_MILLIS;
+    }
+
+    char readBuffer[256];
+
+    long readLength = recv(tcpPort->sock, readBuffer, sizeof(readBuffer), 0);
+
+    if (readLength == 0)
+    {
+        // connection closed by the device
+        return STARIO_ERROR_IO_FAIL;
+    }
+
+    if (readLength == -1)
+    {
+        if ((errno != EAGAIN) && (errno != EINTR))
+        {
+            return STARIO_ERROR_IO_FAIL;
+        }
+
+        readLength = 0;
+
+        long waitResult = tcpWaitPrv(tcpPort->sock, POLLIN, timeMillis);
+
+        if (waitResult < STARIO_ERROR_SUCCESS)
+        {
+            return waitResult;
+        }
+
+        if (waitResult == 1)
+        {
+            readLength = recv(tcpPort->sock, readBuffer, sizeof(readBuffer), 0);
+
+            if (readLength == 0)
+            {
+                return STARIO_ERROR_IO_FAIL;
+            }
+
+            if (readLength == -1)
+            {
+                if ((errno != EAGAIN) && (errno != EINTR))
+                {
+                    return STARIO_ERROR_IO_FAIL;
+                }
+
+                readLength = 0;
+            }
+        }
+    }
+
+    if (readLength == 0)
+    {
+        if (tcpPort->asbFrameLength > 0)
+        {
+            struct timeval now;
+
+            GET_TIME(now);
+
+            if (TIME_DIFF(tcpPort->rxTime,now) >= TCP_ASB_GAP_MILLIS)
+            {
+                tcpAsbRejectPrv(tcpPort);
+            }
+        }
+
+        return 0;
+    }
+
+    GET_TIME(tcpPort->rxTime);
+
+    long i = 0;
+    for (; i < readLength; i++)
+    {
+        tcpDemuxPrv(tcpPort, (unsigned char) readBuffer[i]);
+    }
+
+    return readLength;
+}
+
+static long tcpWritePort (void * port, char const * writeBuffer, long length)
+{
+    TcpPort * tcpPort = (TcpPort *) port;
+    if (tcpPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    long writeResult = tcpSendPrv(tcpPort->sock, writeBuffer, length);
+
+    if (writeResult > 0)
+    {
+        cbTimingWritten(&tcpPort->timing, writeResult);
+    }
+
+    return writeResult;
+}
+
+// waits until the device has acknowledged everything written
+static long tcpFlushPort (void * port)
+{
+    TcpPort * tcpPort = (TcpPort *) port;
+    if (tcpPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    long timeout = TCP_WRITE_TIMEOUT;
+    int queuedLength = 0;
+    int lastQueuedLength = -1;
+
+    while (timeout > 0)
+    {
+        // unsent plus unacknowledged bytes
+        if (ioctl(tcpPort->sock, SIOCOUTQ, &queuedLength) != 0)
+        {
+            return STARIO_ERROR_IO_FAIL;
+        }
+
+        if (queuedLength == 0)
+        {
+            return STARIO_ERROR_SUCCESS;
+        }
+
+        if (queuedLength != lastQueuedLength)
+        {
+            timeout = TCP_WRITE_TIMEOUT;
+            lastQueuedLength = queuedLength;
+        }
+
+        struct timeval sleepTime = {0, 5 * 1000};
+
+        select(0, NULL, NULL, NULL, &sleepTime);
+
+        timeout -= 5;
+    }
+
+    return STARIO_ERROR_IO_FAIL;
+}
+
+static long tcpReadPort (void * port, char * readBuffer, long length)
+{
+    TcpPort * tcpPort = (TcpPort *) port;
+    if (tcpPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    // 200 milliseconds is the maximum time without any application data arriving
+    long totalReadLength = 0;
+    long timeout = 200;
+
+    while (1)
+    {
+        long takeLength = tcpRxTake(tcpPort, &readBuffer[totalReadLength], length - totalReadLength);
+
+        if (takeLength > 0)
+        {
+            totalReadLength += takeLength;
+
+            timeout = 200;
+        }
+
+        if ((totalReadLength > 0) || (timeout <= 0))
+        {
+            break;
+        }
+
+        struct timeval timeS;
+        struct timeval timeF;
+
+        GET_TIME(timeS);
+        long receiveResult = tcpReceivePrv(tcpPort, timeout);
+        GET_TIME(timeF);
+
+        if (receiveResult < STARIO_ERROR_SUCCESS)
+        {
+            return receiveResult;
+        }
+
+        long interval = TIME_DIFF(timeS,timeF);
+
+        if (timeout > interval)
+            timeout -= interval;
+        else
+            timeout = 0;
+    }
+
+    if (totalReadLength == 0)
+    {
+        return STARIO_ERROR_IO_FAIL;
+    }
+
+    return totalReadLength;
+}
+
+// status requested on the data connection - the response is picked out of
+// the application data around it, which is kept for readPort
+static long tcpSharedStatusPrv(TcpPort * tcpPort, StarPrinterStatus * status)
+{
+    long ioResult = STARIO_ERROR_SUCCESS;
+
+    // what the device sent before the request is application data
+    do
+    {
+        ioResult = tcpReceivePrv(tcpPort, 0);
+    } while (ioResult > 0);
+
+    if (ioResult < STARIO_ERROR_SUCCESS)
+    {
+        return ioResult;
+    }
+
+    char const statusReqCmd[] = {0x1b, 0x06, 0x01};
+    if (tcpSendPrv(tcpPort->sock, statusReqCmd, 3) != 3)
+    {
+        return STARIO_ERROR_IO_FAIL;
+    }
+
+    tcpPort->asbRequested++;
+
+    unsigned long asbFrames = tcpPort->asbFrames;
+    long timeout = 200;
+
+    struct timeval timeS;
+    struct timeval timeF;
+
+    while ((tcpPort->asbFrames == asbFrames) && (timeout > 0))
+    {
+        GET_TIME(timeS);
+        ioResult = tcpReceivePrv(tcpPort, timeout);
+        GET_TIME(timeF);
+
+        if (ioResult < STARIO_ERROR_SUCCESS)
+        {
+            return ioResult;
+        }
+
+        if (ioResult > 0)
+        {
+            timeout = 200;
+
+            continue;
+        }
+
+        long interval = TIME_DIFF(timeS,timeF);
+
+        if (timeout > interval)
+            timeout -= interval;
+        else
+            timeout = 0;
+    }
+
+    if (tcpPort->asbFrames == asbFrames)
+    {
+        // a response arriving after this is taken as application data
+        tcpPort->asbRequested = 0;
+
+        if (tcpPort->asbFrameLength > 0)
+        {
+            tcpAsbRejectPrv(tcpPort);
+        }
+
+        return STARIO_ERROR_IO_FAIL;
+    }
+
+    memcpy(status, &tcpPort->asbStatus, sizeof(StarPrinterStatus));
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+static long tcpGetStarPrinterStatus (void * port, StarPrinterStatus * status)
+{
+    TcpPort * tcpPort = (TcpPort *) port;
+    if (tcpPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    memset(status, 0x00, sizeof(StarPrinterStatus));
+
+    if (tcpPort->statusService[0] == 0)
+    {
+        return tcpSharedStatusPrv(tcpPort, status);
+    }
+
+    // the status connection is kept open between requests
+    if (tcpPort->statusSock == -1)
+    {
+        long connectResult = tcpConnectPrv(tcpPort->host, tcpPort->statusService, 1, 0);
+
+        if (connectResult < STARIO_ERROR_SUCCESS)
+        {
+            return STARIO_ERROR_IO_FAIL;
+        }
+
+        tcpPort->statusSock = (int) connectResult;
+    }
+
+    int sock = tcpPort->statusSock;
+
+    long ioResult = STARIO_ERROR_SUCCESS;
+
+    do
+    {
+        // the status connection carries nothing else - discard the remains
+        // of a response that arrived after its request timed out
+        char bitBucket[64];
+        while (recv(sock, bitBucket, sizeof(bitBucket), 0) > 0)
+        {
+        }
+
+        char const statusReqCmd[] = {0x1b, 0x06, 0x01};
+        if (tcpSendPrv(sock, statusReqCmd, 3) != 3)
+        {
+            ioResult = STARIO_ERROR_IO_FAIL;
+            break;
+        }
+
+        ioResult = tcpRecvPrv(sock, (char *) status->raw, sizeof(status->raw), 7, 200);
+
+        if (ioResult < STARIO_ERROR_SUCCESS)
+        {
+            break;
+        }
+
+        long statusLength = asbFrameLength(status->raw[0]);
+
+        if ((statusLength == 0) || (ioResult > statusLength))
+        {
+            ioResult = STARIO_ERROR_IO_FAIL;
+            break;
+        }
+
+        if (ioResult < statusLength)
+        {
+            long restResult = tcpRecvPrv(sock, (char *) &status->raw[ioResult], statusLength - ioResult, statusLength - ioResult, 200);
+
+            if (restResult < STARIO_ERROR_SUCCESS)
+            {
+                ioResult = restResult;
+                break;
+            }
+
+            ioResult += restResult;
+        }
+
+        status->rawLength = (unsigned char) ioResult;
+
+        asbDecode(status);
+
+        return STARIO_ERROR_SUCCESS;
+    } while (0);
+
+    // a status connection in an unknown state is re-established on the next request
+    close(tcpPort->statusSock);
+    tcpPort->statusSock = -1;
+
+    return ioResult;
+}
+
+static long tcpBeginCheckedBlock (void * port)
+{
+    TcpPort * tcpPort = (TcpPort *) port;
+    if (tcpPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    long ioResult = tcpGetStarPrinterStatus(port, &tcpPort->statusCache);
+
+    if (ioResult != STARIO_ERROR_SUCCESS)
+    {
+        return ioResult;
+    }
+
+    if (tcpPort->statusCache.etbAvailable == 0)
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    cbTimingBegin(&tcpPort->timing);
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+static long tcpEndCheckedBlock (void * port, StarPrinterStatus * status)
+{
+    TcpPort * tcpPort = (TcpPort *) port;
+    if (tcpPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    if (tcpPort->statusCache.etbAvailable == 0)
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    memset(status, 0x00, sizeof(StarPrinterStatus));
+    status->offline = 1;
+
+    long ioResult = STARIO_ERROR_SUCCESS;
+
+    do
+    {
+        char etb[1] = {0x17};
+
+        ioResult = tcpSendPrv(tcpPort->sock, etb, 1);
+
+        if (ioResult == 1)
+        {
+            // checked block boundary - the device holds everything up to the ETB
+            ioResult = tcpFlushPort(port);
+        }
+
+        if (ioResult == STARIO_ERROR_SUCCESS)
+        {
+            unsigned char nextEtbCounter = (tcpPort->statusCache.etbCounter + 1) % 32;
+
+            cbTimingEtb(&tcpPort->timing);
+
+            long attempt = 0;
+
+            do
+            {
+                ioResult = tcpGetStarPrinterStatus(port, status);
+
+                if ((ioResult >= STARIO_ERROR_SUCCESS) &&
+                    (status->offline == 0) &&
+                    (status->etbCounter != nextEtbCounter))
+                {
+                    long pollMillis = cbTimingPollMillis(&tcpPort->timing, attempt++);
+
+                    struct timeval sleepTime = {pollMillis / 1000, (pollMillis % 1000) * 1000};
+
+                    select(0, NULL, NULL, NULL, &sleepTime);
+
+                    continue;
+                }
+
+                break;
+            } while (1);
+
+            if (ioResult < STARIO_ERROR_SUCCESS)
+            {
+                return ioResult;
+            }
+
+            if (status->offline == 0)
+            {
+                cbTimingCompleted(&tcpPort->timing);
+            }
+        }
+
+        if (status->offline)
+        {
+            ioResult = tcpHdwrResetDevice(port);
+
+            if (ioResult != STARIO_ERROR_SUCCESS)
+            {
+                return ioResult;
+            }
+        }
+    } while (0);
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// there are no control lines on a network connection - the device is sent
+// the real time reset command instead, on the status connection if there is
+// one, since the data connection may be blocked behind the device's full buffer
+static long tcpHdwrResetDevice (void * port)
+{
+    TcpPort * tcpPort = (TcpPort *) port;
+    if (tcpPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    char const resetCmd[] = {0x1b, 0x06, 0x18};
+
+    int sock = (tcpPort->statusSock != -1)?tcpPort->statusSock:tcpPort->sock;
+
+    if (tcpSendPrv(sock, resetCmd, 3) != 3)
+    {
+        return STARIO_ERROR_IO_FAIL;
+    }
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+static long tcpClosePort (void * port)
+{
+    TcpPort * tcpPort = (TcpPort *) port;
+    if (tcpPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    tcpFlushPort(port);
+
+    if (tcpPort->statusSock != -1)
+    {
+        close(tcpPort->statusSock);
+    }
+
+    close(tcpPort->sock);
+
+    pthread_mutex_lock(&tcpPortsLock);
+    memset(tcpPort, 0x00, sizeof(TcpPort));
+    pthread_mutex_unlock(&tcpPortsLock);
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+static void tcpReleaseImpl ()
+{
+    int i = 0;
+    for (; i < MAX_NUM_PORTS; i++)
+    {
+        if (tcpPorts[i].set != 0)
+        {
+            tcpClosePort(&tcpPorts[i]);
+        }
+    }
+}
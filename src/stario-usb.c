@@ -25,7 +25,9 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <memory.h>
-#include <usb.h>
+#include <libusb-1.0/libusb.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/time.h>
 
 #ifdef RPMBUILD
@@ -34,105 +36,131 @@
 
 static void * libusb = NULL;
 
-typedef usb_dev_handle *    (*usb_open_fndef)               (struct usb_device *dev);
-typedef int                 (*usb_close_fndef)              (usb_dev_handle *dev);
-typedef int                 (*usb_bulk_write_fndef)         (usb_dev_handle *dev, int ep, char *bytes, int size, int timeout);
-typedef int                 (*usb_bulk_read_fndef)          (usb_dev_handle *dev, int ep, char *bytes, int size, int timeout);
-typedef int                 (*usb_control_msg_fndef)        (usb_dev_handle *dev, int requesttype, int request, int value, int index, char *bytes, int size, int timeout);
-//typedef int                 (*usb_set_configuration_fndef)  (usb_dev_handle *dev, int configuration);
-typedef int                 (*usb_claim_interface_fndef)    (usb_dev_handle *dev, int interface);
-typedef int                 (*usb_release_interface_fndef)  (usb_dev_handle *dev, int interface);
-//typedef int                 (*usb_set_altinterface_fndef)   (usb_dev_handle *dev, int alternate);
-//typedef int                 (*usb_resetep_fndef)            (usb_dev_handle *dev, unsigned int ep);
-typedef int                 (*usb_clear_halt_fndef)         (usb_dev_handle *dev, unsigned int ep);
-//typedef int                 (*usb_reset_fndef)              (usb_dev_handle *dev);
-//typedef char *              (*usb_strerror_fndef)           (void);
-typedef void                (*usb_init_fndef)               (void);
-//typedef void                (*usb_set_debug_fndef)          (int level);
-typedef int                 (*usb_find_busses_fndef)        (void);
-typedef int                 (*usb_find_devices_fndef)       (void);
-//typedef struct usb_device * (*usb_device_fndef)             (usb_dev_handle *dev);
-typedef struct usb_bus *    (*usb_get_busses_fndef)         (void);
-
-static usb_open_fndef               usb_open_fn;
-static usb_close_fndef              usb_close_fn;
-static usb_bulk_write_fndef         usb_bulk_write_fn;
-static usb_bulk_read_fndef          usb_bulk_read_fn;
-static usb_control_msg_fndef        usb_control_msg_fn;
-//static usb_set_configuration_fndef  usb_set_configuration_fn;
-static usb_claim_interface_fndef    usb_claim_interface_fn;
-static usb_release_interface_fndef  usb_release_interface_fn;
-//static usb_set_altinterface_fndef   usb_set_altinterface_fn;
-//static usb_resetep_fndef            usb_resetep_fn;
-static usb_clear_halt_fndef         usb_clear_halt_fn;
-//static usb_reset_fndef              usb_reset_fn;
-//static usb_strerror_fndef           usb_strerror_fn;
-static usb_init_fndef               usb_init_fn;
-//static usb_set_debug_fndef          usb_set_debug_fn;
-static usb_find_busses_fndef        usb_find_busses_fn;
-static usb_find_devices_fndef       usb_find_devices_fn;
-//static usb_device_fndef             usb_device_fn;
-static usb_get_busses_fndef         usb_get_busses_fn;
-
-#define USB_OPEN                (*usb_open_fn)
-#define USB_CLOSE               (*usb_close_fn)
-#define USB_BULK_WRITE          (*usb_bulk_write_fn)
-#define USB_BULK_READ           (*usb_bulk_read_fn)
-#define USB_CONTROL_MSG         (*usb_control_msg_fn)
-//#define USB_SET_CONFIGURATION   (*usb_set_configuration_fn)
-#define USB_CLAIM_INTERFACE     (*usb_claim_interface_fn)
-#define USB_RELEASE_INTERFACE   (*usb_release_interface_fn)
-//#define USB_SET_ALTINTERFACE    (*usb_set_altinterface_fn)
-//#define USB_RESETEP             (*usb_resetep_fn)
-#define USB_CLEAR_HALT          (*usb_clear_halt_fn)
-//#define USB_RESET               (*usb_reset_fn)
-//#define USB_STRERROR            (*usb_strerror_fn)
-#define USB_INIT                (*usb_init_fn)
-//#define USB_SET_DEBUG           (*usb_set_debug_fn)
-#define USB_FIND_BUSSES         (*usb_find_busses_fn)
-#define USB_FIND_DEVICES        (*usb_find_devices_fn)
-//#define USB_DEVICE              (*usb_device_fn)
-#define USB_GET_BUSSES          (*usb_get_busses_fn)
+typedef int                 (*libusb_init_fndef)                        (libusb_context **ctx);
+typedef void                (*libusb_exit_fndef)                        (libusb_context *ctx);
+typedef ssize_t             (*libusb_get_device_list_fndef)             (libusb_context *ctx, libusb_device ***list);
+typedef void                (*libusb_free_device_list_fndef)            (libusb_device **list, int unref_devices);
+typedef uint8_t             (*libusb_get_bus_number_fndef)              (libusb_device *dev);
+typedef uint8_t             (*libusb_get_device_address_fndef)          (libusb_device *dev);
+typedef int                 (*libusb_get_device_descriptor_fndef)       (libusb_device *dev, struct libusb_device_descriptor *desc);
+typedef int                 (*libusb_get_config_descriptor_fndef)       (libusb_device *dev, uint8_t config_index, struct libusb_config_descriptor **config);
+typedef void                (*libusb_free_config_descriptor_fndef)      (struct libusb_config_descriptor *config);
+typedef int                 (*libusb_open_fndef)                        (libusb_device *dev, libusb_device_handle **dev_handle);
+typedef void                (*libusb_close_fndef)                       (libusb_device_handle *dev_handle);
+typedef int                 (*libusb_claim_interface_fndef)             (libusb_device_handle *dev_handle, int interface_number);
+typedef int                 (*libusb_release_interface_fndef)           (libusb_device_handle *dev_handle, int interface_number);
+typedef int                 (*libusb_set_auto_detach_kernel_driver_fndef)(libusb_device_handle *dev_handle, int enable);
+typedef int                 (*libusb_clear_halt_fndef)                  (libusb_device_handle *dev_handle, unsigned char endpoint);
+typedef int                 (*libusb_control_transfer_fndef)            (libusb_device_handle *dev_handle, uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout);
+typedef int                 (*libusb_bulk_transfer_fndef)               (libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *data, int length, int *actual_length, unsigned int timeout);
+typedef struct libusb_transfer * (*libusb_alloc_transfer_fndef)         (int iso_packets);
+typedef void                (*libusb_free_transfer_fndef)               (struct libusb_transfer *transfer);
+typedef int                 (*libusb_submit_transfer_fndef)             (struct libusb_transfer *transfer);
+typedef int                 (*libusb_cancel_transfer_fndef)             (struct libusb_transfer *transfer);
+typedef int                 (*libusb_handle_events_timeout_completed_fndef)(libusb_context *ctx, struct timeval *tv, int *completed);
+typedef int                 (*libusb_has_capability_fndef)              (uint32_t capability);
+typedef int                 (*libusb_hotplug_register_callback_fndef)   (libusb_context *ctx, int events, int flags, int vendor_id, int product_id, int dev_class, libusb_hotplug_callback_fn cb_fn, void *user_data, libusb_hotplug_callback_handle *callback_handle);
+typedef void                (*libusb_hotplug_deregister_callback_fndef) (libusb_context *ctx, libusb_hotplug_callback_handle callback_handle);
+
+static libusb_init_fndef                            libusb_init_fn;
+static libusb_exit_fndef                            libusb_exit_fn;
+static libusb_get_device_list_fndef                 libusb_get_device_list_fn;
+static libusb_free_device_list_fndef                libusb_free_device_list_fn;
+static libusb_get_bus_number_fndef                  libusb_get_bus_number_fn;
+static libusb_get_device_address_fndef              libusb_get_device_address_fn;
+static libusb_get_device_descriptor_fndef           libusb_get_device_descriptor_fn;
+static libusb_get_config_descriptor_fndef           libusb_get_config_descriptor_fn;
+static libusb_free_config_descriptor_fndef          libusb_free_config_descriptor_fn;
+static libusb_open_fndef                            libusb_open_fn;
+static libusb_close_fndef                           libusb_close_fn;
+static libusb_claim_interface_fndef                 libusb_claim_interface_fn;
+static libusb_release_interface_fndef               libusb_release_interface_fn;
+static libusb_set_auto_detach_kernel_driver_fndef   libusb_set_auto_detach_kernel_driver_fn;
+static libusb_clear_halt_fndef                      libusb_clear_halt_fn;
+static libusb_control_transfer_fndef                libusb_control_transfer_fn;
+static libusb_bulk_transfer_fndef                   libusb_bulk_transfer_fn;
+static libusb_alloc_transfer_fndef                  libusb_alloc_transfer_fn;
+static libusb_free_transfer_fndef                   libusb_free_transfer_fn;
+static libusb_submit_transfer_fndef                 libusb_submit_transfer_fn;
+static libusb_cancel_transfer_fndef                 libusb_cancel_transfer_fn;
+static libusb_handle_events_timeout_completed_fndef libusb_handle_events_timeout_completed_fn;
+static libusb_has_capability_fndef                  libusb_has_capability_fn;
+static libusb_hotplug_register_callback_fndef       libusb_hotplug_register_callback_fn;
+static libusb_hotplug_deregister_callback_fndef     libusb_hotplug_deregister_callback_fn;
+
+#define USB_INIT                        (*libusb_init_fn)
+#define USB_EXIT                        (*libusb_exit_fn)
+#define USB_GET_DEVICE_LIST             (*libusb_get_device_list_fn)
+#define USB_FREE_DEVICE_LIST            (*libusb_free_device_list_fn)
+#define USB_GET_BUS_NUMBER              (*libusb_get_bus_number_fn)
+#define USB_GET_DEVICE_ADDRESS          (*libusb_get_device_address_fn)
+#define USB_GET_DEVICE_DESCRIPTOR       (*libusb_get_device_descriptor_fn)
+#define USB_GET_CONFIG_DESCRIPTOR       (*libusb_get_config_descriptor_fn)
+#define USB_FREE_CONFIG_DESCRIPTOR      (*libusb_free_config_descriptor_fn)
+#define USB_OPEN                        (*libusb_open_fn)
+#define USB_CLOSE                       (*libusb_close_fn)
+#define USB_CLAIM_INTERFACE             (*libusb_claim_interface_fn)
+#define USB_RELEASE_INTERFACE           (*libusb_release_interface_fn)
+#define USB_SET_AUTO_DETACH             (*libusb_set_auto_detach_kernel_driver_fn)
+#define USB_CLEAR_HALT                  (*libusb_clear_halt_fn)
+#define USB_CONTROL_TRANSFER            (*libusb_control_transfer_fn)
+#define USB_BULK_TRANSFER               (*libusb_bulk_transfer_fn)
+#define USB_ALLOC_TRANSFER              (*libusb_alloc_transfer_fn)
+#define USB_FREE_TRANSFER               (*libusb_free_transfer_fn)
+#define USB_SUBMIT_TRANSFER             (*libusb_submit_transfer_fn)
+#define USB_CANCEL_TRANSFER             (*libusb_cancel_transfer_fn)
+#define USB_HANDLE_EVENTS_COMPLETED     (*libusb_handle_events_timeout_completed_fn)
+#define USB_HAS_CAPABILITY              (*libusb_has_capability_fn)
+#define USB_HOTPLUG_REGISTER            (*libusb_hotplug_register_callback_fn)
+#define USB_HOTPLUG_DEREGISTER          (*libusb_hotplug_deregister_callback_fn)
 
 #else
 
-#define USB_OPEN                usb_open
-#define USB_CLOSE               usb_close
-#define USB_BULK_WRITE          usb_bulk_write
-#define USB_BULK_READ           usb_bulk_read
-#define USB_CONTROL_MSG         usb_control_msg
-//#define USB_SET_CONFIGURATION   usb_set_configuration
-#define USB_CLAIM_INTERFACE     usb_claim_interface
-#define USB_RELEASE_INTERFACE   usb_release_interface
-//#define USB_SET_ALTINTERFACE    usb_set_altinterface
-//#define USB_RESETEP             usb_resetep
-#define USB_CLEAR_HALT          usb_clear_halt
-//#define USB_RESET               usb_reset
-//#define USB_STRERROR            usb_strerror
-#define USB_INIT                usb_init
-//#define USB_SET_DEBUG           usb_set_debug
-#define USB_FIND_BUSSES         usb_find_busses
-#define USB_FIND_DEVICES        usb_find_devices
-//#define USB_DEVICE              usb_device
-#define USB_GET_BUSSES          usb_get_busses
+#define USB_INIT                        libusb_init
+#define USB_EXIT                        libusb_exit
+#define USB_GET_DEVICE_LIST             libusb_get_device_list
+#define USB_FREE_DEVICE_LIST            libusb_free_device_list
+#define USB_GET_BUS_NUMBER              libusb_get_bus_number
+#define USB_GET_DEVICE_ADDRESS          libusb_get_device_address
+#define USB_GET_DEVICE_DESCRIPTOR       libusb_get_device_descriptor
+#define USB_GET_CONFIG_DESCRIPTOR       libusb_get_config_descriptor
+#define USB_FREE_CONFIG_DESCRIPTOR      libusb_free_config_descriptor
+#define USB_OPEN                        libusb_open
+#define USB_CLOSE                       libusb_close
+#define USB_CLAIM_INTERFACE             libusb_claim_interface
+#define USB_RELEASE_INTERFACE           libusb_release_interface
+#define USB_SET_AUTO_DETACH             libusb_set_auto_detach_kernel_driver
+#define USB_CLEAR_HALT                  libusb_clear_halt
+#define USB_CONTROL_TRANSFER            libusb_control_transfer
+#define USB_BULK_TRANSFER               libusb_bulk_transfer
+#define USB_ALLOC_TRANSFER              libusb_alloc_transfer
+#define USB_FREE_TRANSFER               libusb_free_transfer
+#define USB_SUBMIT_TRANSFER             libusb_submit_transfer
+#define USB_CANCEL_TRANSFER             libusb_cancel_transfer
+#define USB_HANDLE_EVENTS_COMPLETED     libusb_handle_events_timeout_completed
+#define USB_HAS_CAPABILITY              libusb_has_capability
+#define USB_HOTPLUG_REGISTER            libusb_hotplug_register_callback
+#define USB_HOTPLUG_DEREGISTER          libusb_hotplug_deregister_callback
 
 #endif
 
 // project headers
 #include "stario-error.h"
+#include "stario-status.h"
 #include "stario-usb.h"
+#include "stario-checkedblock.h"
 
 // forward declarations
 static long usbMatchPortName        (char const * portName);
-static long usbOpenPort             (char const * portName, char const * portSettings);
-static long usbWritePort            (char const * portName, char const * writeBuffer, long length);
-static long usbReadPort             (char const * portName, char * readBuffer, long length);
-static long usbGetStarPrinterStatus (char const * portName, StarPrinterStatus * status);
-static long usbBeginCheckedBlock    (char const * portName);
-static long usbEndCheckedBlock      (char const * portName, StarPrinterStatus * status);
-static long usbHdwrResetDevice      (char const * portName);
-static long usbDoVisualCardCmd      (char const * portName, VisualCardCmd * request, long timeoutMillis);
-static long usbClosePort            (char const * portName);
+static long usbOpenPort             (char const * portName, char const * portSettings, void ** port);
+static long usbWritePort            (void * port, char const * writeBuffer, long length);
+static long usbReadPort             (void * port, char * readBuffer, long length);
+static long usbGetStarPrinterStatus (void * port, StarPrinterStatus * status);
+static long usbBeginCheckedBlock    (void * port);
+static long usbEndCheckedBlock      (void * port, StarPrinterStatus * status);
+static long usbHdwrResetDevice      (void * port);
+static long usbDoVisualCardCmd      (void * port, VisualCardCmd * request, long timeoutMillis);
+static long usbClosePort            (void * port);
 static void usbReleaseImpl          ();
 
 // Star's USB vendor and product ID numbers
@@ -147,14 +175,28 @@ static void usbReleaseImpl          ();
 #define USB_BULK_WRITE_TIMEOUT      10000
 #define USB_BULK_READ_TIMEOUT       200
 
+// bulk-out transfers kept in flight by usbWritePort
+#define USB_MAX_TRANSFERS           4
+
+// bulk transfer size limits, in bytes
+// the size is set by the portSettings string and must be a multiple of the
+// full-speed packet size
+#define USB_DEFAULT_TRANSFER_SIZE   4096
+#define USB_MIN_TRANSFER_SIZE       64
+#define USB_MAX_TRANSFER_SIZE       65536
+
+// time usbWritePort waits for an unplugged device to come back before giving up
+#define USB_REBIND_TIMEOUT          2000
+
+// without hotplug support, how often a detached port rescans the bus while waiting
+#define USB_REBIND_POLL_MILLIS      100
+
 typedef struct
 {
     unsigned char set;                  // if 0, not set
     char portName[100];                 // string port name - i.e. "usb:TSP700" or "usb:TCP300"
 
-    struct usb_bus *bus;                // pointer to USB bus
-    struct usb_device *dev;             // pointer to the device
-    struct usb_dev_handle *udev;        // handle to use the device
+    libusb_device_handle *udev;         // handle to use the device
 
     int config;                         // configuration index
     int interface;                      // interface index
@@ -163,14 +205,156 @@ typedef struct
     int inep;                           // bulk-in endpoint index
     int outep;                          // bulk-out endpoint index
 
+    struct libusb_transfer *transfers[USB_MAX_TRANSFERS];   // bulk-out transfers, used round robin
+    int transferDone[USB_MAX_TRANSFERS];                    // set by usbTransferCallback; 1 while the transfer is idle
+
+    long transferSize;                  // bulk transfer size in bytes
+    unsigned char autoTransferSize;     // if 1, transferSize is tuned by usbTuneTransferSize
+    long autoCeiling;                   // largest transfer size not seen to stall the device
+    long autoThroughput;                // bytes per second measured at the previous transfer size
+
     StarPrinterStatus statusCache;      // status cache populated during beginCheckedBlock fn
+    CheckedBlockTiming timing;          // print time estimate pacing endCheckedBlock polls
+
+    char model[100];                    // model sub-string of the port name
+    char serial[100];                   // serial number sub-string of the port name, if hasSerial
+    unsigned char hasSerial;            // if 0, any serial number matches
+
+    int bus;                            // bus number of the bound device
+    int address;                        // device address of the bound device
+
+    unsigned char detached;             // if 1, the device was unplugged and udev is NULL
+    long arrivalsSeen;                  // usbArrivals when the port last looked for its device
+
+    unsigned char stuck;                // if 1, closed with a cancelled transfer libusb never gave back;
+                                        // the slot, udev and that transfer are kept until it does
 } USBPort;
 
+// enumeration cache entry - a device's parsed identity and endpoint layout
+// keyed by bus number and device address, which are not reused while the device stays attached
+typedef struct
+{
+    unsigned char set;                  // if 0, not set
+    unsigned char seen;                 // set while scanning the device list; unseen entries are dropped
+    unsigned char isStar;               // if 0, not a Star vendor class device
+
+    int bus;                            // bus number
+    int address;                        // device address on the bus
+
+    char deviceID[257];                 // device ID string, as returned by vendor request 0
+    char serial[256];                   // serial number string
+    unsigned char serialValid;          // if 0, the device reported no usable serial number
+
+    int config;                         // configuration value
+    int interface;                      // interface number
+    int altsetting;                     // altsetting number
+
+    int inep;                           // bulk-in endpoint address
+    int outep;                          // bulk-out endpoint address
+} USBDeviceEntry;
+
+#define USB_DEVICE_CACHE_SIZE       64
+
+static libusb_context * usbContext = NULL;  // libusb context for this library
+
+static USBDeviceEntry usbDevices[USB_DEVICE_CACHE_SIZE];    // enumeration cache
+
+// hotplug state - the callback runs on whichever thread handles libusb events,
+// so the enumeration cache and arrival count are guarded by usbHotplugLock
+static pthread_mutex_t usbHotplugLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t usbHotplugArrived;                // signalled on every device arrival
+static long usbArrivals = 0;                            // count of device arrivals
+
+static unsigned char usbHotplugRunning = 0;             // if 1, callback registered and event thread running
+static libusb_hotplug_callback_handle usbHotplugHandle;
+static pthread_t usbEventThread;
+static volatile int usbEventThreadStop = 0;
+
 static USBPort usbPorts[MAX_NUM_PORTS]; // array storing USBPort structures
 
+// guards usbPorts slots - held by open and close only, port i/o is serialised per port by the caller
+static pthread_mutex_t usbPortsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int LIBUSB_CALL usbHotplugCallback(libusb_context *ctx, libusb_device *dev, libusb_hotplug_event event, void *userData);
+
+static void * usbEventThreadMain(void * arg)
+{
+    // hotplug callbacks are delivered from here while no port is doing I/O
+    while (usbEventThreadStop == 0)
+    {
+        struct timeval eventTimeout = {1, 0};
+
+        USB_HANDLE_EVENTS_COMPLETED(usbContext, &eventTimeout, NULL);
+    }
+
+    return NULL;
+}
+
+// registers for Star device arrival and removal; without hotplug support,
+// detached ports fall back to rescanning the bus
+static void usbStartHotplug(void)
+{
+    pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+
+    pthread_cond_init(&usbHotplugArrived, &condAttr);
+
+    pthread_condattr_destroy(&condAttr);
+
+    usbArrivals = 0;
+
+    if (! USB_HAS_CAPABILITY(LIBUSB_CAP_HAS_HOTPLUG))
+    {
+        return;
+    }
+
+    if (USB_HOTPLUG_REGISTER(usbContext,
+                             LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                             LIBUSB_HOTPLUG_NO_FLAGS,
+                             STAR_VENDOR_ID,
+                             VENDORCLASS_PRODUCT_ID,
+                             LIBUSB_HOTPLUG_MATCH_ANY,
+                             usbHotplugCallback,
+                             NULL,
+                             &usbHotplugHandle) != LIBUSB_SUCCESS)
+    {
+        return;
+    }
+
+    usbEventThreadStop = 0;
+
+    if (pthread_create(&usbEventThread, NULL, usbEventThreadMain, NULL) != 0)
+    {
+        USB_HOTPLUG_DEREGISTER(usbContext, usbHotplugHandle);
+
+        return;
+    }
+
+    usbHotplugRunning = 1;
+}
+
+static void usbStopHotplug(void)
+{
+    if (usbHotplugRunning != 0)
+    {
+        usbEventThreadStop = 1;
+
+        // deregistering wakes the event thread out of libusb
+        USB_HOTPLUG_DEREGISTER(usbContext, usbHotplugHandle);
+
+        pthread_join(usbEventThread, NULL);
+
+        usbHotplugRunning = 0;
+    }
+
+    pthread_cond_destroy(&usbHotplugArrived);
+}
+
 PortImpl getUsbPortImpl(void)
 {
     memset(usbPorts, 0x00, sizeof(usbPorts));
+    memset(usbDevices, 0x00, sizeof(usbDevices));
 
     PortImpl impl;
 
@@ -178,7 +362,7 @@ PortImpl getUsbPortImpl(void)
 
 #ifdef RPMBUILD
 
-    libusb = dlopen("libusb.so", RTLD_NOW | RTLD_GLOBAL);
+    libusb = dlopen("libusb-1.0.so.0", RTLD_NOW | RTLD_GLOBAL);
     if (! libusb)
     {
         return impl;
@@ -188,25 +372,31 @@ PortImpl getUsbPortImpl(void)
 
     do
     {
-        if (! (usb_open_fn              = dlsym(libusb, "usb_open"              ))) break;
-        if (! (usb_close_fn             = dlsym(libusb, "usb_close"             ))) break;
-        if (! (usb_bulk_write_fn        = dlsym(libusb, "usb_bulk_write"        ))) break;
-        if (! (usb_bulk_read_fn         = dlsym(libusb, "usb_bulk_read"         ))) break;
-        if (! (usb_control_msg_fn       = dlsym(libusb, "usb_control_msg"       ))) break;
-        //if (! (usb_set_configuration_fn = dlsym(libusb, "usb_set_configuration" ))) break;
-        if (! (usb_claim_interface_fn   = dlsym(libusb, "usb_claim_interface"   ))) break;
-        if (! (usb_release_interface_fn = dlsym(libusb, "usb_release_interface" ))) break;
-        //if (! (usb_set_altinterface_fn  = dlsym(libusb, "usb_set_altinterface"  ))) break;
-        //if (! (usb_resetep_fn           = dlsym(libusb, "usb_resetep"           ))) break;
-        if (! (usb_clear_halt_fn        = dlsym(libusb, "usb_clear_halt"        ))) break;
-        //if (! (usb_reset_fn             = dlsym(libusb, "usb_reset"             ))) break;
-        //if (! (usb_strerror_fn          = dlsym(libusb, "usb_strerror"          ))) break;
-        if (! (usb_init_fn              = dlsym(libusb, "usb_init"              ))) break;
-        //if (! (usb_set_debug_fn         = dlsym(libusb, "usb_set_debug"         ))) break;
-        if (! (usb_find_busses_fn       = dlsym(libusb, "usb_find_busses"       ))) break;
-        if (! (usb_find_devices_fn      = dlsym(libusb, "usb_find_devices"      ))) break;
-        //if (! (usb_device_fn            = dlsym(libusb, "usb_device"            ))) break;
-        if (! (usb_get_busses_fn        = dlsym(libusb, "usb_get_busses"        ))) break;
+        if (! (libusb_init_fn                           = dlsym(libusb, "libusb_init"                           ))) break;
+        if (! (libusb_exit_fn                           = dlsym(libusb, "libusb_exit"                           ))) break;
+        if (! (libusb_get_device_list_fn                = dlsym(libusb, "libusb_get_device_list"                ))) break;
+        if (! (libusb_free_device_list_fn               = dlsym(libusb, "libusb_free_device_list"               ))) break;
+        if (! (libusb_get_bus_number_fn                 = dlsym(libusb, "libusb_get_bus_number"                 ))) break;
+        if (! (libusb_get_device_address_fn             = dlsym(libusb, "libusb_get_device_address"             ))) break;
+        if (! (libusb_get_device_descriptor_fn          = dlsym(libusb, "libusb_get_device_descriptor"          ))) break;
+        if (! (libusb_get_config_descriptor_fn          = dlsym(libusb, "libusb_get_config_descriptor"          ))) break;
+        if (! (libusb_free_config_descriptor_fn         = dlsym(libusb, "libusb_free_config_descriptor"         ))) break;
+        if (! (libusb_open_fn                           = dlsym(libusb, "libusb_open"                           ))) break;
+        if (! (libusb_close_fn                          = dlsym(libusb, "libusb_close"                          ))) break;
+        if (! (libusb_claim_interface_fn                = dlsym(libusb, "libusb_claim_interface"                ))) break;
+        if (! (libusb_release_interface_fn              = dlsym(libusb, "libusb_release_interface"              ))) break;
+        if (! (libusb_set_auto_detach_kernel_driver_fn  = dlsym(libusb, "libusb_set_auto_detach_kernel_driver"  ))) break;
+        if (! (libusb_clear_halt_fn                     = dlsym(libusb, "libusb_clear_halt"                     ))) break;
+        if (! (libusb_control_transfer_fn               = dlsym(libusb, "libusb_control_transfer"               ))) break;
+        if (! (libusb_bulk_transfer_fn                  = dlsym(libusb, "libusb_bulk_transfer"                  ))) break;
+        if (! (libusb_alloc_transfer_fn                 = dlsym(libusb, "libusb_alloc_transfer"                 ))) break;
+        if (! (libusb_free_transfer_fn                  = dlsym(libusb, "libusb_free_transfer"                  ))) break;
+        if (! (libusb_submit_transfer_fn                = dlsym(libusb, "libusb_submit_transfer"                ))) break;
+        if (! (libusb_cancel_transfer_fn                = dlsym(libusb, "libusb_cancel_transfer"                ))) break;
+        if (! (libusb_handle_events_timeout_completed_fn = dlsym(libusb, "libusb_handle_events_timeout_completed"))) break;
+        if (! (libusb_has_capability_fn                 = dlsym(libusb, "libusb_has_capability"                 ))) break;
+        if (! (libusb_hotplug_register_callback_fn      = dlsym(libusb, "libusb_hotplug_register_callback"      ))) break;
+        if (! (libusb_hotplug_deregister_callback_fn    = dlsym(libusb, "libusb_hotplug_deregister_callback"    ))) break;
 
         allSymbolsFound = 1;
     } while (0);
@@ -220,9 +410,22 @@ PortImpl getUsbPortImpl(void)
     }
 #endif
 
+    if (USB_INIT(&usbContext) != LIBUSB_SUCCESS)
+    {
+#ifdef RPMBUILD
+        dlclose(libusb);
+        libusb = NULL;
+#endif
+
+        return impl;
+    }
+
+    usbStartHotplug();
+
     impl.matchPortName          = usbMatchPortName;
     impl.openPort               = usbOpenPort;
     impl.writePort              = usbWritePort;
+    impl.flushPort              = NULL;
     impl.readPort               = usbReadPort;
     impl.getStarPrinterStatus   = usbGetStarPrinterStatus;
     impl.beginCheckedBlock      = usbBeginCheckedBlock;
@@ -253,106 +456,678 @@ static USBPort * usbFindPort(char const * portName)
     return &usbPorts[i];
 }
 
-static int find_ep(struct usb_device *dev, int config, int interface, int altsetting, int direction, int type)
+static int find_ep(struct libusb_config_descriptor *config, int interface, int altsetting, int direction, int type)
 {
-    struct usb_interface_descriptor *intf;
+    const struct libusb_interface_descriptor *intf;
     int i;
 
-    if (dev->config == NULL)
-    {
-        return -1;
-    }
-
-    intf = &dev->config[config].interface[interface].altsetting[altsetting];
+    intf = &config->interface[interface].altsetting[altsetting];
 
     for (i = 0; i < intf->bNumEndpoints; i++)
     {
-        if (((intf->endpoint[i].bEndpointAddress & USB_ENDPOINT_DIR_MASK) == direction) && ((intf->endpoint[i].bmAttributes & USB_ENDPOINT_TYPE_MASK) == type))
+        if (((intf->endpoint[i].bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == direction) && ((intf->endpoint[i].bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) == type))
             return intf->endpoint[i].bEndpointAddress;
     }
 
     return -1;
 }
 
-static int find_first_altsetting(struct usb_device *dev, int * config, int * interface, int * altsetting)
+static int find_first_altsetting(struct libusb_config_descriptor *config, int * interface, int * altsetting)
 {
-    int i;
     int i1;
     int i2;
 
-    if (dev->config == NULL)
+    for (i1 = 0; i1 < config->bNumInterfaces; i1++)
+    {
+        for (i2 = 0; i2 < config->interface[i1].num_altsetting; i2++)
+        {
+            if (config->interface[i1].altsetting[i2].bNumEndpoints)
+            {
+                *interface = i1;
+                *altsetting = i2;
+
+                return 0;
+            }
+        }
+    }
+
+    return -1;
+}
+
+static long usbMatchPortName (char const * portName)
+{
+    if (strncmp(portName, "usb:", 4) == 0)
+    {
+        return STARIO_ERROR_SUCCESS;
+    }
+
+    return STARIO_ERROR_NOT_AVAILABLE;
+}
+
+// reads a Star device's descriptors, device ID and serial number into entry
+// the device is opened but no interface is claimed, so a device in use elsewhere is not disturbed
+// returns 1 if the device is a Star vendor class device, 0 if it is not,
+// -1 if it is but could not be read (and should be probed again)
+static int usbProbeDevice(libusb_device *dev, USBDeviceEntry * entry)
+{
+    struct libusb_device_descriptor descriptor;
+
+    if (USB_GET_DEVICE_DESCRIPTOR(dev, &descriptor) != LIBUSB_SUCCESS)
     {
+        return 0;
+    }
+
+    if (descriptor.idVendor != STAR_VENDOR_ID)
+    {
+        return 0;
+    }
+
+    if (descriptor.idProduct != VENDORCLASS_PRODUCT_ID)
+    {
+        return 0;
+    }
+
+    memset(entry, 0x00, sizeof(USBDeviceEntry));
+
+    entry->isStar = 1;
+
+    int config;
+    int interface = 0;
+    int altsetting = 0;
+    unsigned char layoutFound = 0;
+
+    for (config = 0; config < descriptor.bNumConfigurations; config++)
+    {
+        struct libusb_config_descriptor *configDescriptor = NULL;
+
+        if (USB_GET_CONFIG_DESCRIPTOR(dev, config, &configDescriptor) != LIBUSB_SUCCESS)
+        {
+            continue;
+        }
+
+        if (find_first_altsetting(configDescriptor, &interface, &altsetting) == 0)
+        {
+            entry->config = configDescriptor->bConfigurationValue;
+            entry->interface = configDescriptor->interface[interface].altsetting[altsetting].bInterfaceNumber;
+            entry->altsetting = configDescriptor->interface[interface].altsetting[altsetting].bAlternateSetting;
+
+            entry->inep = find_ep(configDescriptor, interface, altsetting, LIBUSB_ENDPOINT_IN, LIBUSB_TRANSFER_TYPE_BULK);
+            entry->outep = find_ep(configDescriptor, interface, altsetting, LIBUSB_ENDPOINT_OUT, LIBUSB_TRANSFER_TYPE_BULK);
+
+            layoutFound = 1;
+        }
+
+        USB_FREE_CONFIG_DESCRIPTOR(configDescriptor);
+
+        if (layoutFound != 0)
+        {
+            break;
+        }
+    }
+
+    if (layoutFound == 0)
+    {
+        return -1;
+    }
+
+    if ((entry->inep == -1) || (entry->outep == -1))
+    {
+        return -1;
+    }
+
+    libusb_device_handle *udev = NULL;
+
+    if (USB_OPEN(dev, &udev) != LIBUSB_SUCCESS)
+    {
+        return -1;
+    }
+
+    if (USB_CONTROL_TRANSFER(udev, 0xc0, 0, 0, 0, (unsigned char *) entry->deviceID, 256, USB_CONTROL_MSG_TIMEOUT) < 0)
+    {
+        USB_CLOSE(udev);
+
         return -1;
     }
 
-    for (i = 0; i < dev->descriptor.bNumConfigurations; i++)
+    do
+    {
+        if (! descriptor.iSerialNumber)
+        {
+            break;
+        }
+
+        unsigned char rawSN[256];
+
+        if (USB_CONTROL_TRANSFER(udev,
+                                 LIBUSB_ENDPOINT_IN,
+                                 LIBUSB_REQUEST_GET_DESCRIPTOR,
+                                 (LIBUSB_DT_STRING << 8) + descriptor.iSerialNumber,
+                                 0,
+                                 rawSN,
+                                 sizeof(rawSN),
+                                 USB_CONTROL_MSG_TIMEOUT) < (2 + 8 * 2))
+        {
+            break;
+        }
+
+        if (rawSN[0] != (2 + 8 * 2))
+        {
+            break;
+        }
+
+        if (rawSN[1] != LIBUSB_DT_STRING)
+        {
+            break;
+        }
+
+        int snIdx = 0;
+        int rawSNIdx = 2;
+        for (; rawSNIdx < rawSN[0]; rawSNIdx += 2)
+        {
+            if (snIdx >= (256 - 1))
+                break;
+
+            if (rawSN[rawSNIdx + 1])
+                entry->serial[snIdx++] = '?';
+            else
+                entry->serial[snIdx++] = rawSN[rawSNIdx];
+        }
+        entry->serial[snIdx] = 0;
+
+        entry->serialValid = 1;
+    } while (0);
+
+    USB_CLOSE(udev);
+
+    return 1;
+}
+
+static USBDeviceEntry * usbFindDeviceEntry(int bus, int address)
+{
+    int i = 0;
+    for (; i < USB_DEVICE_CACHE_SIZE; i++)
+    {
+        if (usbDevices[i].set != 0)
+            if ((usbDevices[i].bus == bus) && (usbDevices[i].address == address))
+                return &usbDevices[i];
+    }
+
+    return NULL;
+}
+
+// copies the cache entry for dev into entry, probing the device the first time it is seen
+// returns 1 if dev is a Star device, 0 otherwise
+static int usbLookupDevice(libusb_device *dev, USBDeviceEntry * entry)
+{
+    int bus = USB_GET_BUS_NUMBER(dev);
+    int address = USB_GET_DEVICE_ADDRESS(dev);
+
+    pthread_mutex_lock(&usbHotplugLock);
+
+    USBDeviceEntry * cached = usbFindDeviceEntry(bus, address);
+    if (cached != NULL)
+    {
+        cached->seen = 1;
+
+        memcpy(entry, cached, sizeof(USBDeviceEntry));
+
+        pthread_mutex_unlock(&usbHotplugLock);
+
+        return (entry->isStar != 0)?1:0;
+    }
+
+    pthread_mutex_unlock(&usbHotplugLock);
+
+    // probing does device I/O, which can run the hotplug callback - not done under the lock
+    int isStar = usbProbeDevice(dev, entry);
+    if (isStar < 0)
+    {
+        return 0;
+    }
+
+    // non-Star devices are cached too so that their descriptors are not parsed again
+    if (isStar == 0)
     {
-        for (i1 = 0; i1 < dev->config[i].bNumInterfaces; i1++)
+        memset(entry, 0x00, sizeof(USBDeviceEntry));
+    }
+
+    entry->set = 1;
+    entry->seen = 1;
+    entry->isStar = isStar;
+    entry->bus = bus;
+    entry->address = address;
+
+    pthread_mutex_lock(&usbHotplugLock);
+
+    // if the cache is full the device is simply probed again next time
+    int i = 0;
+    for (; i < USB_DEVICE_CACHE_SIZE; i++)
+    {
+        if (usbDevices[i].set == 0)
         {
-            for (i2 = 0; i2 < dev->config[i].interface[i1].num_altsetting; i2++)
+            memcpy(&usbDevices[i], entry, sizeof(USBDeviceEntry));
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&usbHotplugLock);
+
+    return isStar;
+}
+
+// keeps a cached device from being dropped as stale, without any device I/O
+static void usbMarkDeviceSeen(libusb_device *dev)
+{
+    pthread_mutex_lock(&usbHotplugLock);
+
+    USBDeviceEntry * cached = usbFindDeviceEntry(USB_GET_BUS_NUMBER(dev), USB_GET_DEVICE_ADDRESS(dev));
+    if (cached != NULL)
+    {
+        cached->seen = 1;
+    }
+
+    pthread_mutex_unlock(&usbHotplugLock);
+}
+
+// drops a device from the cache, i.e. on removal - called with usbHotplugLock held
+static void usbInvalidateDevice(int bus, int address)
+{
+    USBDeviceEntry * entry = usbFindDeviceEntry(bus, address);
+    if (entry != NULL)
+    {
+        memset(entry, 0x00, sizeof(USBDeviceEntry));
+    }
+}
+
+// opens dev and claims the interface recorded in entry
+static int usbClaimDevice(libusb_device *dev, USBDeviceEntry * entry, USBPort * usbPort)
+{
+    libusb_device_handle *udev = NULL;
+
+    if (USB_OPEN(dev, &udev) != LIBUSB_SUCCESS)
+    {
+        return 0;
+    }
+
+    USB_SET_AUTO_DETACH(udev, 1);
+
+    if (USB_CLAIM_INTERFACE(udev, entry->interface) != LIBUSB_SUCCESS)
+    {
+        USB_CLOSE(udev);
+
+        return 0;
+    }
+
+    // the configuration and altsetting are left as found, as with libusb-0.1
+
+    usbPort->udev = udev;
+
+    usbPort->config = entry->config;
+    usbPort->interface = entry->interface;
+    usbPort->altsetting = entry->altsetting;
+
+    usbPort->inep = entry->inep;
+    usbPort->outep = entry->outep;
+
+    usbPort->bus = entry->bus;
+    usbPort->address = entry->address;
+
+    return 1;
+}
+
+// finds the device matching the port's model and serial, and claims it
+// only devices not yet in the enumeration cache are probed
+// returns 1 if bound, 0 otherwise
+static int usbBindPort(USBPort * usbPort)
+{
+    libusb_device **devices = NULL;
+
+    ssize_t deviceCount = USB_GET_DEVICE_LIST(usbContext, &devices);
+    if (deviceCount < 0)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&usbHotplugLock);
+
+    // arrivals from here on may be the device coming back after an unplug
+    usbPort->arrivalsSeen = usbArrivals;
+
+    int entryIdx = 0;
+    for (; entryIdx < USB_DEVICE_CACHE_SIZE; entryIdx++)
+    {
+        usbDevices[entryIdx].seen = 0;
+    }
+
+    pthread_mutex_unlock(&usbHotplugLock);
+
+    unsigned char found = 0;
+
+    // matching runs against the cache; only the chosen device is opened
+    ssize_t deviceIdx = 0;
+    for (; deviceIdx < deviceCount; deviceIdx++)
+    {
+        USBDeviceEntry entry;
+
+        // once the target is claimed, the rest are only kept in the cache - never probed
+        if (found != 0)
+        {
+            usbMarkDeviceSeen(devices[deviceIdx]);
+            continue;
+        }
+
+        if (usbLookupDevice(devices[deviceIdx], &entry) == 0)
+        {
+            continue;
+        }
+
+        if (strstr(&entry.deviceID[2], usbPort->model) == 0)
+        {
+            continue;
+        }
+
+        if ((usbPort->hasSerial != 0) && ((entry.serialValid == 0) || (strcmp(entry.serial, usbPort->serial) != 0)))
+        {
+            continue;
+        }
+
+        if (usbClaimDevice(devices[deviceIdx], &entry, usbPort) != 0)
+        {
+            found = 1;
+        }
+    }
+
+    pthread_mutex_lock(&usbHotplugLock);
+
+    // entries for devices no longer on the bus are stale
+    for (entryIdx = 0; entryIdx < USB_DEVICE_CACHE_SIZE; entryIdx++)
+    {
+        if ((usbDevices[entryIdx].set != 0) && (usbDevices[entryIdx].seen == 0))
+        {
+            usbInvalidateDevice(usbDevices[entryIdx].bus, usbDevices[entryIdx].address);
+        }
+    }
+
+    pthread_mutex_unlock(&usbHotplugLock);
+
+    USB_FREE_DEVICE_LIST(devices, 1);
+
+    return found;
+}
+
+// drops the handle to an unplugged device but keeps the port, so that it can
+// be rebound when the device comes back
+static void usbDetachPort(USBPort * usbPort)
+{
+    if (usbPort->detached != 0)
+    {
+        return;
+    }
+
+    USB_RELEASE_INTERFACE(usbPort->udev, usbPort->interface);
+    USB_CLOSE(usbPort->udev);
+
+    usbPort->udev = NULL;
+    usbPort->detached = 1;
+}
+
+// rebinds a detached port if its device has come back
+// returns 1 if the port is bound, 0 otherwise
+static int usbRebindPort(USBPort * usbPort)
+{
+    if (usbPort->detached == 0)
+    {
+        return 1;
+    }
+
+    pthread_mutex_lock(&usbHotplugLock);
+
+    long arrivals = usbArrivals;
+
+    pthread_mutex_unlock(&usbHotplugLock);
+
+    // with hotplug, nothing can have come back unless something arrived since the last bind
+    if ((usbHotplugRunning != 0) && (arrivals == usbPort->arrivalsSeen))
+    {
+        return 0;
+    }
+
+    if (usbBindPort(usbPort) == 0)
+    {
+        return 0;
+    }
+
+    usbPort->detached = 0;
+
+    return 1;
+}
+
+// waits up to timeoutMillis for a detached port's device to come back
+// returns 1 if the port is bound, 0 otherwise
+static int usbWaitRebind(USBPort * usbPort, long timeoutMillis)
+{
+    struct timeval timeS;
+    struct timeval timeF;
+
+    GET_TIME(timeS);
+
+    while (usbRebindPort(usbPort) == 0)
+    {
+        GET_TIME(timeF);
+
+        long remaining = timeoutMillis - (long) TIME_DIFF(timeS,timeF);
+        if (remaining <= 0)
+        {
+            return 0;
+        }
+
+        if (usbHotplugRunning != 0)
+        {
+            // woken by the hotplug callback the instant a Star device arrives
+            struct timespec waitUntil;
+            clock_gettime(CLOCK_MONOTONIC, &waitUntil);
+            waitUntil.tv_sec += remaining / 1000;
+            waitUntil.tv_nsec += (remaining % 1000) * 1000 * 1000;
+            if (waitUntil.tv_nsec >= 1000 * 1000 * 1000)
             {
-                if (dev->config[i].interface[i1].altsetting[i2].bNumEndpoints)
-                {
-                    *config = i;
-                    *interface = i1;
-                    *altsetting = i2;
+                waitUntil.tv_sec += 1;
+                waitUntil.tv_nsec -= 1000 * 1000 * 1000;
+            }
 
-                    return 0;
-                }
+            pthread_mutex_lock(&usbHotplugLock);
+            if (usbArrivals == usbPort->arrivalsSeen)
+            {
+                pthread_cond_timedwait(&usbHotplugArrived, &usbHotplugLock, &waitUntil);
             }
+            pthread_mutex_unlock(&usbHotplugLock);
+        }
+        else
+        {
+            long sleepMillis = (remaining < USB_REBIND_POLL_MILLIS)?remaining:USB_REBIND_POLL_MILLIS;
+
+            struct timeval sleepTime = {0, sleepMillis * 1000};
+
+            select(0, NULL, NULL, NULL, &sleepTime);
+        }
+    }
+
+    return 1;
+}
+
+static int LIBUSB_CALL usbHotplugCallback(libusb_context *ctx, libusb_device *dev, libusb_hotplug_event event, void *userData)
+{
+    int bus = USB_GET_BUS_NUMBER(dev);
+    int address = USB_GET_DEVICE_ADDRESS(dev);
+
+    pthread_mutex_lock(&usbHotplugLock);
+
+    // either way, whatever was cached at this address no longer describes the device there
+    usbInvalidateDevice(bus, address);
+
+    if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)
+    {
+        usbArrivals++;
+
+        pthread_cond_broadcast(&usbHotplugArrived);
+    }
+
+    pthread_mutex_unlock(&usbHotplugLock);
+
+    return 0;
+}
+
+// parses the portSettings string - "" (default size), "auto", or a transfer size in bytes
+static long usbParsePortSettings(char const * portSettings, USBPort * usbPort)
+{
+    usbPort->transferSize = USB_DEFAULT_TRANSFER_SIZE;
+    usbPort->autoTransferSize = 0;
+    usbPort->autoCeiling = USB_MAX_TRANSFER_SIZE;
+    usbPort->autoThroughput = 0;
+
+    if ((portSettings == NULL) || (portSettings[0] == 0))
+    {
+        return STARIO_ERROR_SUCCESS;
+    }
+
+    if (strcmp(portSettings, "auto") == 0)
+    {
+        usbPort->autoTransferSize = 1;
+
+        return STARIO_ERROR_SUCCESS;
+    }
+
+    char * end = NULL;
+
+    long transferSize = strtol(portSettings, &end, 10);
+    if ((end == portSettings) || (*end != 0))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    if ((transferSize < USB_MIN_TRANSFER_SIZE) ||
+        (transferSize > USB_MAX_TRANSFER_SIZE) ||
+        ((transferSize % USB_MIN_TRANSFER_SIZE) != 0))
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    usbPort->transferSize = transferSize;
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// auto mode - double the transfer size while throughput improves by more than
+// 5%, step back once it does not, and halve it when the device stalls or times out
+static void usbTuneTransferSize(USBPort * usbPort, long lengthSent, double elapsedMillis, unsigned char failed)
+{
+    if (usbPort->autoTransferSize == 0)
+    {
+        return;
+    }
+
+    if (failed != 0)
+    {
+        usbPort->autoCeiling = usbPort->transferSize / 2;
+        if (usbPort->autoCeiling < USB_MIN_TRANSFER_SIZE)
+        {
+            usbPort->autoCeiling = USB_MIN_TRANSFER_SIZE;
+        }
+
+        usbPort->transferSize = usbPort->autoCeiling;
+        usbPort->autoThroughput = 0;
+
+        return;
+    }
+
+    // too little data to measure against this transfer size
+    if ((lengthSent < usbPort->transferSize * USB_MAX_TRANSFERS) || (elapsedMillis <= 0))
+    {
+        return;
+    }
+
+    long throughput = (long) (lengthSent * 1000.0 / elapsedMillis);
+
+    if ((usbPort->autoThroughput == 0) || (throughput > usbPort->autoThroughput + usbPort->autoThroughput / 20))
+    {
+        usbPort->autoThroughput = throughput;
+
+        if (usbPort->transferSize * 2 <= usbPort->autoCeiling)
+        {
+            usbPort->transferSize *= 2;
         }
     }
+    else
+    {
+        // the larger size bought nothing - settle on the previous one
+        if (usbPort->transferSize / 2 >= USB_MIN_TRANSFER_SIZE)
+        {
+            usbPort->transferSize /= 2;
+        }
 
-    return -1;
+        usbPort->autoCeiling = usbPort->transferSize;
+    }
 }
 
-static long usbGetPortSignals(char const * portName)
+// frees the port's idle transfers and, once libusb holds none of them, closes the device and clears the slot
+// a transfer whose cancellation was never acknowledged still points into the port, so while one is left
+// the slot stays reserved as stuck; the caller holds usbPortsLock
+// returns the number of transfers still held by libusb
+static int usbReapPort(USBPort * usbPort)
 {
-    USBPort * usbPort = usbFindPort(portName);
-    if (usbPort == NULL)
-    {
-        return STARIO_ERROR_NOT_OPEN;
-    }
-
-    unsigned char portSignals = 0;
+    int held = 0;
 
-    if (USB_CONTROL_MSG(usbPort->udev, (char) 0xc0, (char) 1, (short) 0, (short) 0, &portSignals, (short) 1, USB_CONTROL_MSG_TIMEOUT) < 0)
+    int transferIdx = 0;
+    for (; transferIdx < USB_MAX_TRANSFERS; transferIdx++)
     {
-        if (errno == ENODEV)
+        if (usbPort->transfers[transferIdx] == NULL)
         {
-            usbClosePort(portName);
+            continue;
+        }
 
-            return STARIO_ERROR_NOT_OPEN;
+        if (usbPort->transferDone[transferIdx] == 0)
+        {
+            held++;
+            continue;
         }
 
-        return STARIO_ERROR_IO_FAIL;
+        USB_FREE_TRANSFER(usbPort->transfers[transferIdx]);
+        usbPort->transfers[transferIdx] = NULL;
     }
 
-    return portSignals;
-}
+    if (held != 0)
+    {
+        usbPort->set = 0;
+        usbPort->portName[0] = 0;
+        usbPort->stuck = 1;
 
-static long usbMatchPortName (char const * portName)
-{
-    if (strncmp(portName, "usb:", 4) == 0)
+        return held;
+    }
+
+    if (usbPort->detached == 0)
     {
-        return STARIO_ERROR_SUCCESS;
+        USB_RELEASE_INTERFACE(usbPort->udev, usbPort->interface);
+        USB_CLOSE(usbPort->udev);
     }
 
-    return STARIO_ERROR_NOT_AVAILABLE;
+    memset(usbPort, 0x00, sizeof(USBPort));
+
+    return 0;
 }
 
-static long usbOpenPort (char const * portName, char const * portSettings)
+static long usbOpenPortPrv (char const * portName, char const * portSettings, void ** port)
 {
     USBPort * oldUsbPort = usbFindPort(portName);
     if (oldUsbPort != NULL)
     {
+        *port = oldUsbPort;
+
         return STARIO_ERROR_SUCCESS;
     }
 
     int i = 0;
     for (; i < MAX_NUM_PORTS; i++)
     {
-        if (usbPorts[i].set == 0)
+        if ((usbPorts[i].set == 0) && ((usbPorts[i].stuck == 0) || (usbReapPort(&usbPorts[i]) == 0)))
             break;
     }
     if ( i == MAX_NUM_PORTS)
@@ -368,266 +1143,357 @@ static long usbOpenPort (char const * portName, char const * portSettings)
 
     strcpy(usbPort.portName, portName);
 
-    char * model = &usbPort.portName[4];
-    char * serial = strstr(usbPort.portName, ";sn:");
+    if (usbParsePortSettings(portSettings, &usbPort) != STARIO_ERROR_SUCCESS)
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    // model and serial sub-strings of the port name
+    strcpy(usbPort.model, &portName[4]);
 
-    int modelLen = 0;
-    int serialLen = 0;
+    char * serial = strstr(usbPort.model, ";sn:");
 
     if (serial != NULL)
     {
-        modelLen = serial - model;
-        model[modelLen] = 0;    // temporarily NULL terminate the model string, restore ';' later on
+        *serial = 0;
 
-        serial += 4;
+        strcpy(usbPort.serial, serial + 4);
+        usbPort.hasSerial = 1;
+    }
 
-        serialLen = strlen(serial);
+    if (usbBindPort(&usbPort) == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
     }
-    else
+
+    int transferIdx = 0;
+    for (; transferIdx < USB_MAX_TRANSFERS; transferIdx++)
     {
-        modelLen = strlen(model);
+        usbPort.transfers[transferIdx] = USB_ALLOC_TRANSFER(0);
+
+        if (usbPort.transfers[transferIdx] == NULL)
+        {
+            while (transferIdx-- > 0)
+            {
+                USB_FREE_TRANSFER(usbPort.transfers[transferIdx]);
+            }
+
+            USB_RELEASE_INTERFACE(usbPort.udev, usbPort.interface);
+            USB_CLOSE(usbPort.udev);
+
+            return STARIO_ERROR_RUNTIME;
+        }
+
+        usbPort.transferDone[transferIdx] = 1;
     }
 
-    short productID = 0;
+    memcpy(&usbPorts[i], &usbPort, sizeof(USBPort));
+
+    *port = &usbPorts[i];
+
+    return STARIO_ERROR_SUCCESS;
+}
 
-    productID = VENDORCLASS_PRODUCT_ID;
+// the table lock is held across the whole open so that two opens can not claim one slot
+static long usbOpenPort (char const * portName, char const * portSettings, void ** port)
+{
+    pthread_mutex_lock(&usbPortsLock);
 
-    struct usb_bus *bus;
-    struct usb_device *dev;
-    struct usb_dev_handle *udev;
+    long result = usbOpenPortPrv(portName, portSettings, port);
 
-    USB_INIT();
+    pthread_mutex_unlock(&usbPortsLock);
 
-    USB_FIND_BUSSES();
-    USB_FIND_DEVICES();
+    return result;
+}
 
-    unsigned char found = 0;
+static long usbGetPortSignals(void * port)
+{
+    USBPort * usbPort = (USBPort *) port;
+    if (usbPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    if (usbRebindPort(usbPort) == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    unsigned char portSignals = 0;
 
-    for (bus = USB_GET_BUSSES(); bus; bus = bus->next)
+    int result = USB_CONTROL_TRANSFER(usbPort->udev, 0xc0, 1, 0, 0, &portSignals, 1, USB_CONTROL_MSG_TIMEOUT);
+    if (result < 0)
     {
-        for (dev = bus->devices; dev; dev = dev->next)
+        if (result == LIBUSB_ERROR_NO_DEVICE)
         {
-            if (dev->descriptor.idVendor != STAR_VENDOR_ID)
-            {
-                continue;
-            }
+            usbDetachPort(usbPort);
 
-            if (dev->descriptor.idProduct != productID)
-            {
-                continue;
-            }
+            return STARIO_ERROR_NOT_OPEN;
+        }
 
-            int config;
-            int interface;
-            int altsetting;
+        return STARIO_ERROR_IO_FAIL;
+    }
 
-            if (find_first_altsetting(dev, &config, &interface, &altsetting) == -1)
-            {
-                continue;
-            }
+    return portSignals;
+}
 
-            usbPort.config = dev->config[config].bConfigurationValue;
-            usbPort.interface = dev->config[config].interface[interface].altsetting[altsetting].bInterfaceNumber;
-            usbPort.altsetting = dev->config[config].interface[interface].altsetting[altsetting].bAlternateSetting;
+static void LIBUSB_CALL usbTransferCallback(struct libusb_transfer * transfer)
+{
+    *((int *) transfer->user_data) = 1;
+}
 
-            usbPort.inep = find_ep(dev, config, interface, altsetting, USB_ENDPOINT_IN, USB_ENDPOINT_TYPE_BULK);
-            usbPort.outep = find_ep(dev, config, interface, altsetting, USB_ENDPOINT_OUT, USB_ENDPOINT_TYPE_BULK);
+// run libusb event handling until the transfer in slot transferIdx completes
+// returns 0 if timeMillis passed without completion
+static int usbWaitTransfer(USBPort * usbPort, int transferIdx, long timeMillis)
+{
+    struct timeval timeS;
+    struct timeval timeF;
 
-            if ((usbPort.inep == -1) || (usbPort.outep == -1))
-            {
-                continue;
-            }
+    GET_TIME(timeS);
 
-            udev = USB_OPEN(dev);
-            if (udev == NULL)
-            {
-                continue;
-            }
+    while (usbPort->transferDone[transferIdx] == 0)
+    {
+        GET_TIME(timeF);
 
-            USB_CLAIM_INTERFACE(udev, usbPort.interface);
+        long remaining = timeMillis - (long) TIME_DIFF(timeS,timeF);
+        if (remaining <= 0)
+        {
+            return 0;
+        }
 
-            // the following two calls do not need to be made, and libusb docs state that not calling them is better
-            //usb_set_configuration(udev, usbPort.config);
-            //usb_set_altinterface(udev, usbPort.altsetting);
+        struct timeval eventTimeout = {remaining / 1000, (remaining % 1000) * 1000};
 
-            usbPort.bus = bus;
-            usbPort.dev = dev;
-            usbPort.udev = udev;
+        USB_HANDLE_EVENTS_COMPLETED(usbContext, &eventTimeout, &usbPort->transferDone[transferIdx]);
+    }
 
-            char deviceID[257];
-            memset(deviceID, 0x00, sizeof(deviceID));
+    return 1;
+}
 
-            int deviceIDLen = 0;
-            if ((deviceIDLen = USB_CONTROL_MSG(usbPort.udev, (char) 0xc0, (char) 0, (short) 0, (short) 0, deviceID, (short) 256, USB_CONTROL_MSG_TIMEOUT)) < 0)
-            {
-                USB_RELEASE_INTERFACE(usbPort.udev, usbPort.interface);
-                USB_CLOSE(usbPort.udev);
+// run libusb event handling until the count cancelled transfers from slot firstIdx on are given back
+// returns 0 if timeMillis passed with any of them still held by libusb
+static int usbWaitCancelled(USBPort * usbPort, int firstIdx, int count, long timeMillis)
+{
+    struct timeval timeS;
+    struct timeval timeF;
 
-                continue;
-            }
+    GET_TIME(timeS);
 
-            if (strstr(&deviceID[2], model) == 0)
-            {
-                USB_RELEASE_INTERFACE(usbPort.udev, usbPort.interface);
-                USB_CLOSE(usbPort.udev);
+    int cancelIdx = 0;
+    for (; cancelIdx < count; cancelIdx++)
+    {
+        GET_TIME(timeF);
 
-                continue;
-            }
+        long remaining = timeMillis - (long) TIME_DIFF(timeS,timeF);
 
-            if (serial != NULL)
-            {
-                unsigned char snMatch = 0;
+        if (usbWaitTransfer(usbPort, (firstIdx + cancelIdx) % USB_MAX_TRANSFERS, (remaining > 0)?remaining:0) == 0)
+        {
+            return 0;
+        }
+    }
 
-                do
-                {
-                    if (! usbPort.dev->descriptor.iSerialNumber)
-                    {
-                        break;
-                    }
+    return 1;
+}
 
-                    char rawSN[256];
+// several bulk-out transfers are kept in flight so that the device's endpoint
+// never waits on a host round trip between transfers; they complete in order
+// sets *noDevice if the device was unplugged, returning the bytes sent before that
+static long usbWritePortPrv (void * port, char const * writeBuffer, long length, unsigned char * noDevice)
+{
+    USBPort * usbPort = (USBPort *) port;
 
-                    if (USB_CONTROL_MSG(usbPort.udev,
-                                        USB_ENDPOINT_IN,
-                                        USB_REQ_GET_DESCRIPTOR,
-                                        (USB_DT_STRING << 8) + usbPort.dev->descriptor.iSerialNumber,
-                                        0,
-                                        rawSN,
-                                        sizeof(rawSN),
-                                        USB_CONTROL_MSG_TIMEOUT) < (2 + 8 * 2))
-                    {
-                        break;
-                    }
+    long lengthSubmitted = 0;
+    long lengthSent = 0;
 
-                    if (rawSN[0] != (2 + 8 * 2))
-                    {
-                        break;
-                    }
+    long transferSize = usbPort->transferSize;
 
-                    if (rawSN[1] != USB_DT_STRING)
-                    {
-                        break;
-                    }
+    struct timeval timeS;
+    struct timeval timeF;
 
-                    char sn[256];
+    GET_TIME(timeS);
 
-                    int snIdx = 0;
-                    int rawSNIdx = 2;
-                    for (; rawSNIdx < rawSN[0]; rawSNIdx += 2)
-                    {
-                        if (snIdx >= (256 - 1))
-                            break;
+    int oldestIdx = 0;
+    int inFlight = 0;
 
-                        if (rawSN[rawSNIdx + 1])
-                            sn[snIdx++] = '?';
-                        else
-                            sn[snIdx++] = rawSN[rawSNIdx];
-                    }
-                    sn[snIdx] = 0;
+    unsigned char failed = 0;
+    unsigned char stuck = 0;
 
-                    if (strcmp(sn, serial) != 0)
-                    {
-                        break;
-                    }
+    *noDevice = 0;
+
+    while (1)
+    {
+        while ((failed == 0) && (inFlight < USB_MAX_TRANSFERS) && (lengthSubmitted < length))
+        {
+            int transferIdx = (oldestIdx + inFlight) % USB_MAX_TRANSFERS;
+            int writeAttemptLength = ((length - lengthSubmitted) > transferSize)?transferSize:(length - lengthSubmitted);
+
+            // no libusb timeout - usbWaitTransfer applies USB_BULK_WRITE_TIMEOUT
+            // to the oldest transfer so queued transfers do not expire early
+            libusb_fill_bulk_transfer(usbPort->transfers[transferIdx],
+                                      usbPort->udev,
+                                      usbPort->outep,
+                                      (unsigned char *) &writeBuffer[lengthSubmitted],
+                                      writeAttemptLength,
+                                      usbTransferCallback,
+                                      &usbPort->transferDone[transferIdx],
+                                      0);
+
+            usbPort->transferDone[transferIdx] = 0;
+
+            int submitResult = USB_SUBMIT_TRANSFER(usbPort->transfers[transferIdx]);
+            if (submitResult != LIBUSB_SUCCESS)
+            {
+                usbPort->transferDone[transferIdx] = 1;
+                *noDevice = (submitResult == LIBUSB_ERROR_NO_DEVICE)?1:0;
+                failed = 1;
+                break;
+            }
+
+            lengthSubmitted += writeAttemptLength;
+            inFlight++;
+        }
+
+        if (inFlight == 0)
+        {
+            break;
+        }
 
-                    model[modelLen]=';';    // restore ';' for future string comapares
+        struct libusb_transfer * oldest = usbPort->transfers[oldestIdx];
 
-                    snMatch = 1;
-                } while (0);
+        if (usbWaitTransfer(usbPort, oldestIdx, USB_BULK_WRITE_TIMEOUT) == 0)
+        {
+            // i.e. device not accepting data - stop and collect what went out
+            failed = 1;
 
-                if (snMatch == 0)
-                {
-                    USB_RELEASE_INTERFACE(usbPort.udev, usbPort.interface);
-                    USB_CLOSE(usbPort.udev);
+            int cancelIdx = 0;
+            for (; cancelIdx < inFlight; cancelIdx++)
+            {
+                USB_CANCEL_TRANSFER(usbPort->transfers[(oldestIdx + cancelIdx) % USB_MAX_TRANSFERS]);
+            }
 
-                    continue;
+            // every cancelled transfer must be given back before its slot, or the port, can be reused
+            if (usbWaitCancelled(usbPort, oldestIdx, inFlight, USB_CONTROL_MSG_TIMEOUT) == 0)
+            {
+                stuck = 1;
+                break;
+            }
+        }
+        else if (failed != 0)
+        {
+            // draining transfers after a failure - data past a gap is not counted
+        }
+        else
+        {
+            if (oldest->status == LIBUSB_TRANSFER_NO_DEVICE)
+            {
+                *noDevice = 1;
+            }
+
+            if ((oldest->status != LIBUSB_TRANSFER_COMPLETED) || (oldest->actual_length != oldest->length))
+            {
+                failed = 1;
+
+                int cancelIdx = 1;
+                for (; cancelIdx < inFlight; cancelIdx++)
+                {
+                    USB_CANCEL_TRANSFER(usbPort->transfers[(oldestIdx + cancelIdx) % USB_MAX_TRANSFERS]);
                 }
             }
 
-            found = 1;
-            break;
+            lengthSent += oldest->actual_length;
         }
-        if (found == 1)
-            break;
+
+        oldestIdx = (oldestIdx + 1) % USB_MAX_TRANSFERS;
+        inFlight--;
     }
 
-    if (found == 0)
+    if (stuck != 0)
     {
+        // usbClosePort keeps the transfers libusb still holds, and the port they point into
+        usbClosePort(port);
+
         return STARIO_ERROR_NOT_OPEN;
     }
 
-    memcpy(&usbPorts[i], &usbPort, sizeof(USBPort));
+    if (*noDevice != 0)
+    {
+        return lengthSent;
+    }
 
-    return STARIO_ERROR_SUCCESS;
+    GET_TIME(timeF);
+
+    usbTuneTransferSize(usbPort, lengthSent, TIME_DIFF(timeS,timeF), failed);
+
+    if (failed != 0)
+    {
+        if (USB_CLEAR_HALT(usbPort->udev, usbPort->outep) == LIBUSB_ERROR_NO_DEVICE)
+        {
+            *noDevice = 1;
+        }
+    }
+
+    return lengthSent;
 }
 
-static long usbWritePort (char const * portName, char const * writeBuffer, long length)
+// an unplug mid-write detaches the port and waits for the device to come back;
+// once it is rebound, the write resumes with the bytes not yet accepted
+static long usbWritePort (void * port, char const * writeBuffer, long length)
 {
-    USBPort * usbPort = usbFindPort(portName);
-    if (usbPort == NULL)
+    USBPort * usbPort = (USBPort *) port;
+    if (usbPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    if (usbRebindPort(usbPort) == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
 
     long lengthSent = 0;
 
-    while (lengthSent < length)
+    while (1)
     {
-        int writeAttemptLength = ((length - lengthSent)>4096)?4096:(length - lengthSent);
-
-        int partialWriteLength = USB_BULK_WRITE(usbPort->udev, usbPort->outep, (char *) &writeBuffer[lengthSent], writeAttemptLength, USB_BULK_WRITE_TIMEOUT);
+        unsigned char noDevice = 0;
 
-        if (partialWriteLength < 0)
+        long writeResult = usbWritePortPrv(port, &writeBuffer[lengthSent], length - lengthSent, &noDevice);
+        if (writeResult < STARIO_ERROR_SUCCESS)
         {
-            if (errno == ENODEV)
-            {
-                usbClosePort(portName);
-
-                return STARIO_ERROR_NOT_OPEN;
-            }
-            else
-            {
-                // i.e.  ETIMEDOUT
-                partialWriteLength = 0;
-            }
+            return writeResult;
         }
 
-        lengthSent += partialWriteLength;
+        lengthSent += writeResult;
 
-        if (partialWriteLength != writeAttemptLength)
+        if (noDevice == 0)
         {
-            if (USB_CLEAR_HALT(usbPort->udev, usbPort->outep) < 0)
-            {
-                if (errno == ENODEV)
-                {
-                    usbClosePort(portName);
+            break;
+        }
 
-                    return STARIO_ERROR_NOT_OPEN;
-                }
-            }
+        usbDetachPort(usbPort);
 
-            return lengthSent;
+        if (usbWaitRebind(usbPort, USB_REBIND_TIMEOUT) == 0)
+        {
+            return (lengthSent > 0)?lengthSent:STARIO_ERROR_NOT_OPEN;
         }
     }
 
+    cbTimingWritten(&usbPort->timing, lengthSent);
+
     return lengthSent;
 }
 
-static long usbReadPort (char const * portName, char * readBuffer, long length)
+// one vendor-request / bulk-in round
+static long usbReadPortPrv (void * port, char * readBuffer, long length)
 {
-    USBPort * usbPort = usbFindPort(portName);
-    if (usbPort == NULL)
-    {
-        return STARIO_ERROR_NOT_OPEN;
-    }
+    USBPort * usbPort = (USBPort *) port;
 
     short availableReadLength = 0;
 
-    if (USB_CONTROL_MSG(usbPort->udev, (char) 0xc0, (char) 3, (short) length, (short) 0, (char *) &availableReadLength, (short) 2, USB_CONTROL_MSG_TIMEOUT) < 0)
+    int result = USB_CONTROL_TRANSFER(usbPort->udev, 0xc0, 3, (short) length, 0, (unsigned char *) &availableReadLength, 2, USB_CONTROL_MSG_TIMEOUT);
+    if (result < 0)
     {
-        if (errno == ENODEV)
+        if (result == LIBUSB_ERROR_NO_DEVICE)
         {
-            usbClosePort(portName);
+            usbDetachPort(usbPort);
 
             return STARIO_ERROR_NOT_OPEN;
         }
@@ -645,14 +1511,14 @@ static long usbReadPort (char const * portName, char * readBuffer, long length)
         length = (int) availableReadLength;
     }
 
-    int lengthReceived = USB_BULK_READ(usbPort->udev, usbPort->inep, readBuffer, length, USB_BULK_READ_TIMEOUT);
-    if (lengthReceived <= 0)
-    {
-        lengthReceived = 0;
+    int lengthReceived = 0;
 
-        if (errno == ENODEV)
+    result = USB_BULK_TRANSFER(usbPort->udev, usbPort->inep, (unsigned char *) readBuffer, length, &lengthReceived, USB_BULK_READ_TIMEOUT);
+    if ((result != LIBUSB_SUCCESS) || (lengthReceived <= 0))
+    {
+        if (result == LIBUSB_ERROR_NO_DEVICE)
         {
-            usbClosePort(portName);
+            usbDetachPort(usbPort);
 
             return STARIO_ERROR_NOT_OPEN;
         }
@@ -663,11 +1529,68 @@ static long usbReadPort (char const * portName, char * readBuffer, long length)
     return lengthReceived;
 }
 
-static long usbGetStarPrinterStatus (char const * portName, StarPrinterStatus * status)
+// reads in transfer size rounds until length is met or the device has no more data
+static long usbReadPort (void * port, char * readBuffer, long length)
+{
+    USBPort * usbPort = (USBPort *) port;
+    if (usbPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    if (usbRebindPort(usbPort) == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    long lengthReceived = 0;
+
+    while (lengthReceived < length)
+    {
+        // the vendor request carries the length as a signed short
+        long roundLength = length - lengthReceived;
+        if (roundLength > usbPort->transferSize)
+        {
+            roundLength = usbPort->transferSize;
+        }
+        if (roundLength > 0x7fff)
+        {
+            roundLength = 0x7fff;
+        }
+
+        long readResult = usbReadPortPrv(port, &readBuffer[lengthReceived], roundLength);
+        if (readResult < STARIO_ERROR_SUCCESS)
+        {
+            if ((lengthReceived > 0) && (readResult != STARIO_ERROR_NOT_OPEN))
+            {
+                break;
+            }
+
+            return readResult;
+        }
+
+        if (readResult == 0)
+        {
+            break;
+        }
+
+        lengthReceived += readResult;
+
+        if (readResult < roundLength)
+        {
+            // i.e. the device had less than a full transfer waiting
+            break;
+        }
+    }
+
+    return lengthReceived;
+}
+
+static long usbGetStarPrinterStatus (void * port, StarPrinterStatus * status)
 {
     memset(status, 0x00, sizeof(StarPrinterStatus));
 
-    long readResult = usbReadPort(portName, status->raw, sizeof(status->raw));
+    long readResult = usbReadPort(port, status->raw, sizeof(status->raw));
 
     if (readResult < STARIO_ERROR_SUCCESS)
     {
@@ -681,57 +1604,20 @@ static long usbGetStarPrinterStatus (char const * portName, StarPrinterStatus *
 
     status->rawLength = (unsigned char) readResult;
 
-    // printer status 1
-    status->coverOpen           = ((status->raw[2] & 0x20)!=0)?1:0;
-    status->offline             = ((status->raw[2] & 0x08)!=0)?1:0;
-    status->compulsionSwitch    = ((status->raw[2] & 0x04)!=0)?1:0;
-
-    // printer status 2
-    status->overTemp            = ((status->raw[3] & 0x40)!=0)?1:0;
-    status->unrecoverableError  = ((status->raw[3] & 0x20)!=0)?1:0;
-    status->cutterError         = ((status->raw[3] & 0x08)!=0)?1:0;
-    status->mechError           = ((status->raw[3] & 0x04)!=0)?1:0;
-
-    // printer status 3
-    status->pageModeCmdError        = ((status->raw[4] & 0x20)!=0)?1:0;
-    status->paperSizeError          = ((status->raw[4] & 0x08)!=0)?1:0;
-    status->presenterPaperJamError  = ((status->raw[4] & 0x04)!=0)?1:0;
-    status->headUpError             = ((status->raw[4] & 0x02)!=0)?1:0;
-
-    // printer status 4
-    status->blackMarkDetectStatus   = ((status->raw[5] & 0x20)!=0)?1:0;
-    status->paperEmpty              = ((status->raw[5] & 0x08)!=0)?1:0;
-    status->paperNearEmptyInner     = ((status->raw[5] & 0x04)!=0)?1:0;
-    status->paperNearEmptyOuter     = ((status->raw[5] & 0x02)!=0)?1:0;
-
-    // printer status 5
-    status->stackerFull             = ((status->raw[6] & 0x02)!=0)?1:0;
-
-    // printer status 6
-    status->etbAvailable            = (status->rawLength >= 9)?1:0;
-    status->etbCounter              = (((status->raw[7] & 0x40) >> 2) |
-                                       ((status->raw[7] & 0x20) >> 2) |
-                                       ((status->raw[7] & 0x08) >> 1) |
-                                       ((status->raw[7] & 0x04) >> 1) |
-                                       ((status->raw[7] & 0x02) >> 1));
-
-    // printer status 7
-    status->presenterState          = (((status->raw[8] & 0x08) >> 1) |
-                                       ((status->raw[8] & 0x04) >> 1) |
-                                       ((status->raw[8] & 0x02) >> 1));
+    asbDecode(status);
 
     return STARIO_ERROR_SUCCESS;
 }
 
-static long usbBeginCheckedBlock (char const * portName)
+static long usbBeginCheckedBlock (void * port)
 {
-    USBPort * usbPort = usbFindPort(portName);
-    if (usbPort == NULL)
+    USBPort * usbPort = (USBPort *) port;
+    if (usbPort->set == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
 
-    long ioResult = usbGetStarPrinterStatus(portName, &usbPort->statusCache);
+    long ioResult = usbGetStarPrinterStatus(port, &usbPort->statusCache);
 
     if (ioResult != STARIO_ERROR_SUCCESS)
     {
@@ -743,13 +1629,15 @@ static long usbBeginCheckedBlock (char const * portName)
         return STARIO_ERROR_NOT_AVAILABLE;
     }
 
+    cbTimingBegin(&usbPort->timing);
+
     return STARIO_ERROR_SUCCESS;
 }
 
-static long usbEndCheckedBlock (char const * portName, StarPrinterStatus * status)
+static long usbEndCheckedBlock (void * port, StarPrinterStatus * status)
 {
-    USBPort * usbPort = usbFindPort(portName);
-    if (usbPort == NULL)
+    USBPort * usbPort = (USBPort *) port;
+    if (usbPort->set == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
@@ -768,19 +1656,23 @@ static long usbEndCheckedBlock (char const * portName, StarPrinterStatus * statu
     {
         char etb[1] = {0x17};
 
-        ioResult = usbWritePort(portName, etb, 1);
+        ioResult = usbWritePort(port, etb, 1);
 
         if (ioResult == 1)
         {
             unsigned char nextEtbCounter = (usbPort->statusCache.etbCounter + 1) % 32;
 
+            cbTimingEtb(&usbPort->timing);
+
+            long attempt = 0;
+
             do
             {
-                ioResult = usbGetStarPrinterStatus(portName, status);
+                ioResult = usbGetStarPrinterStatus(port, status);
 
                 if (ioResult == STARIO_ERROR_IO_FAIL)
                 {
-                    ioResult = usbGetPortSignals(portName);
+                    ioResult = usbGetPortSignals(port);
 
                     if (ioResult >= STARIO_ERROR_SUCCESS)
                     {
@@ -804,7 +1696,9 @@ static long usbEndCheckedBlock (char const * portName, StarPrinterStatus * statu
                     (status->offline == 0) &&
                     (status->etbCounter != nextEtbCounter))
                 {
-                    struct timeval sleepTime = {0, 200 * 1000};
+                    long pollMillis = cbTimingPollMillis(&usbPort->timing, attempt++);
+
+                    struct timeval sleepTime = {pollMillis / 1000, (pollMillis % 1000) * 1000};
 
                     select(0, NULL, NULL, NULL, &sleepTime);
 
@@ -813,6 +1707,12 @@ static long usbEndCheckedBlock (char const * portName, StarPrinterStatus * statu
 
                 break;
             } while (1);
+
+            if ((ioResult >= STARIO_ERROR_SUCCESS) &&
+                (status->offline == 0))
+            {
+                cbTimingCompleted(&usbPort->timing);
+            }
         }
 
         if (ioResult == STARIO_ERROR_NOT_OPEN)
@@ -822,7 +1722,7 @@ static long usbEndCheckedBlock (char const * portName, StarPrinterStatus * statu
 
         if (status->offline)
         {
-            ioResult = usbHdwrResetDevice(portName);
+            ioResult = usbHdwrResetDevice(port);
 
             if (ioResult != STARIO_ERROR_SUCCESS)
             {
@@ -834,19 +1734,25 @@ static long usbEndCheckedBlock (char const * portName, StarPrinterStatus * statu
     return STARIO_ERROR_SUCCESS;
 }
 
-static long usbHdwrResetDevice (char const * portName)
+static long usbHdwrResetDevice (void * port)
 {
-    USBPort * usbPort = usbFindPort(portName);
-    if (usbPort == NULL)
+    USBPort * usbPort = (USBPort *) port;
+    if (usbPort->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    if (usbRebindPort(usbPort) == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
 
-    if (USB_CONTROL_MSG(usbPort->udev, (char) 0x40, (char) 2, (short) 0, (short) 0, NULL, (short) 0, USB_CONTROL_MSG_TIMEOUT) < 0)
+    int result = USB_CONTROL_TRANSFER(usbPort->udev, 0x40, 2, 0, 0, NULL, 0, USB_CONTROL_MSG_TIMEOUT);
+    if (result < 0)
     {
-        if (errno == ENODEV)
+        if (result == LIBUSB_ERROR_NO_DEVICE)
         {
-            usbClosePort(portName);
+            usbDetachPort(usbPort);
 
             return STARIO_ERROR_NOT_OPEN;
         }
@@ -857,7 +1763,7 @@ static long usbHdwrResetDevice (char const * portName)
     return STARIO_ERROR_SUCCESS;
 }
 
-static long usbDoVisualCardCmd (char const * portName, VisualCardCmd * request, long timeoutMillis)
+static long usbDoVisualCardCmd (void * port, VisualCardCmd * request, long timeoutMillis)
 {
     long ioResult       = STARIO_ERROR_SUCCESS;
     long timeRemaining  = timeoutMillis;
@@ -875,7 +1781,7 @@ static long usbDoVisualCardCmd (char const * portName, VisualCardCmd * request,
 
     // send ACK to confirm any packets received after previous timeout
     //printf("tx leading ack\n");
-    ioResult = usbWritePort(portName, &ack, 1);
+    ioResult = usbWritePort(port, &ack, 1);
     if (ioResult == STARIO_ERROR_NOT_OPEN)
     {
         //printf("no dev\n");
@@ -892,7 +1798,7 @@ static long usbDoVisualCardCmd (char const * portName, VisualCardCmd * request,
     do
     {
         char bitBucket[1 + 1 + 1 + 128 + 1 + 1];
-        ioResult = usbReadPort(portName, bitBucket, sizeof(bitBucket));
+        ioResult = usbReadPort(port, bitBucket, sizeof(bitBucket));
         if (ioResult == STARIO_ERROR_NOT_OPEN)
         {
             //printf("no dev\n");
@@ -928,7 +1834,7 @@ static long usbDoVisualCardCmd (char const * portName, VisualCardCmd * request,
         //printf("timeRemaining = %d\n", (int) timeRemaining);
 
         //printf("tx cmd\n");
-        ioResult = usbWritePort(portName, txCmd, txCmdLength);
+        ioResult = usbWritePort(port, txCmd, txCmdLength);
         if (ioResult == STARIO_ERROR_NOT_OPEN)
         {
             //printf("no dev\n");
@@ -953,7 +1859,7 @@ static long usbDoVisualCardCmd (char const * portName, VisualCardCmd * request,
 
             //printf("rx resp\n");
             GET_TIME(timeS);
-            ioResult = usbReadPort(portName, response, 1);
+            ioResult = usbReadPort(port, response, 1);
             GET_TIME(timeF);
             interval = TIME_DIFF(timeS,timeF);
             //printf("rx took %d millisec\n", (int) interval);
@@ -1061,7 +1967,7 @@ static long usbDoVisualCardCmd (char const * portName, VisualCardCmd * request,
             //printf("rx resp\n");
 
             GET_TIME(timeS);
-            ioResult = usbReadPort(portName, &rxCmd[rxCmdLength], sizeof(rxCmd) - rxCmdLength);
+            ioResult = usbReadPort(port, &rxCmd[rxCmdLength], sizeof(rxCmd) - rxCmdLength);
             GET_TIME(timeF);
             interval = TIME_DIFF(timeS,timeF);
             //printf("rx took %d millisec\n", (int) interval);
@@ -1129,7 +2035,7 @@ static long usbDoVisualCardCmd (char const * portName, VisualCardCmd * request,
         {
             //printf("resp OK - tx ack\n");
 
-            ioResult = usbWritePort(portName, &ack, 1);
+            ioResult = usbWritePort(port, &ack, 1);
             if (ioResult == STARIO_ERROR_NOT_OPEN)
             {
                 return STARIO_ERROR_NOT_OPEN;
@@ -1149,7 +2055,7 @@ static long usbDoVisualCardCmd (char const * portName, VisualCardCmd * request,
 
         //printf("resp malformed - tx nak\n");
 
-        ioResult = usbWritePort(portName, &nak, 1);
+        ioResult = usbWritePort(port, &nak, 1);
         if (ioResult == STARIO_ERROR_NOT_OPEN)
         {
             return STARIO_ERROR_NOT_OPEN;
@@ -1185,18 +2091,17 @@ static long usbDoVisualCardCmd (char const * portName, VisualCardCmd * request,
     return STARIO_ERROR_SUCCESS;
 }
 
-static long usbClosePort (char const * portName)
+static long usbClosePort (void * port)
 {
-    USBPort * usbPort = usbFindPort(portName);
-    if (usbPort == NULL)
+    USBPort * usbPort = (USBPort *) port;
+    if (usbPort->set == 0)
     {
         return STARIO_ERROR_NOT_OPEN;
     }
 
-    USB_RELEASE_INTERFACE(usbPort->udev, usbPort->interface);
-    USB_CLOSE(usbPort->udev);
-
-    memset(usbPort, 0x00, sizeof(USBPort));
+    pthread_mutex_lock(&usbPortsLock);
+    usbReapPort(usbPort);
+    pthread_mutex_unlock(&usbPortsLock);
 
     return STARIO_ERROR_SUCCESS;
 }
@@ -1208,10 +2113,22 @@ static void usbReleaseImpl ()
     {
         if (usbPorts[i].set != 0)
         {
-            usbClosePort(usbPorts[i].portName);
+            usbClosePort(&usbPorts[i]);
+        }
+
+        if (usbPorts[i].stuck != 0)
+        {
+            // last chance for libusb to give back a stuck transfer; if it does not, it is leaked
+            usbWaitCancelled(&usbPorts[i], 0, USB_MAX_TRANSFERS, USB_CONTROL_MSG_TIMEOUT);
+            usbReapPort(&usbPorts[i]);
         }
     }
 
+    usbStopHotplug();
+
+    USB_EXIT(usbContext);
+    usbContext = NULL;
+
 #ifdef RPMBUILD
     dlclose(libusb);
     libusb = NULL;
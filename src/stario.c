@@ -21,179 +21,1007 @@
     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+#include <string.h>
+
 #include "stario.h"
 #include "stario-error.h"
 #include "stario-prvstructures.h"
-#include "stario-usb.h"
-#include "stario-parallel.h"
-#include "stario-serial.h"
+#include "stario-registry.h"
+#include "stario-checkedblock.h"
+#include "stario-statuswatch.h"
+#include "stario-raster.h"
+
+static StarIOHandle handles[MAX_NUM_HANDLES];
 
-static PortImpl impls[NUM_IMPLS];
+// guards the handle table - lookups share it, open and close take it exclusively
+static pthread_rwlock_t handlesLock = PTHREAD_RWLOCK_INITIALIZER;
 
 void __attribute__ ((constructor)) libConstructor(void)
 {
-    impls[USB_IMPL_IDX] = getUsbPortImpl();
-    impls[PAR_IMPL_IDX] = getParPortImpl();
-    impls[SER_IMPL_IDX] = getSerPortImpl();
+    memset(handles, 0x00, sizeof(handles));
+
+    // recursive, so the portName api can hold the lock across the handle call
+    pthread_mutexattr_t lockAttr;
+    pthread_mutexattr_init(&lockAttr);
+    pthread_mutexattr_settype(&lockAttr, PTHREAD_MUTEX_RECURSIVE);
+
+    int i = 0;
+    for (; i < MAX_NUM_HANDLES; i++)
+    {
+        pthread_mutex_init(&handles[i].lock, &lockAttr);
+
+        cbInitPipeline(&handles[i]);
+        swInitWatch(&handles[i]);
+        swInitCache(&handles[i]);
+    }
+
+    pthread_mutexattr_destroy(&lockAttr);
+
+    regInit();
 }
 
 void __attribute__ ((destructor)) libDestructor(void)
 {
-    impls[USB_IMPL_IDX].releaseImpl();
-    impls[PAR_IMPL_IDX].releaseImpl();
-    impls[SER_IMPL_IDX].releaseImpl();
+    cbStopSupervisor();
+
+    regRelease();
+
+    int i = 0;
+    for (; i < MAX_NUM_HANDLES; i++)
+    {
+        pthread_mutex_destroy(&handles[i].lock);
+    }
+
+    memset(handles, 0x00, sizeof(handles));
 }
 
-static long getSupportingImplIdx(char const * portName)
+// called with handlesLock held
+static StarIOHandle * findHandleLocked(char const * portName)
 {
-    if (impls[USB_IMPL_IDX].matchPortName(portName) == STARIO_ERROR_SUCCESS) return USB_IMPL_IDX;
-    if (impls[PAR_IMPL_IDX].matchPortName(portName) == STARIO_ERROR_SUCCESS) return PAR_IMPL_IDX;
-    if (impls[SER_IMPL_IDX].matchPortName(portName) == STARIO_ERROR_SUCCESS) return SER_IMPL_IDX;
+    int i = 0;
+    for (; i < MAX_NUM_HANDLES; i++)
+    {
+        if (handles[i].set != 0)
+            if (strcmp(handles[i].portName, portName) == 0)
+                break;
+    }
 
-    return STARIO_ERROR_NOT_AVAILABLE;
+    if (i == MAX_NUM_HANDLES)
+    {
+        return NULL;
+    }
+
+    return &handles[i];
 }
 
-long openPort (char const * portName, char const * portSettings)
+static StarIOHandle * findHandle(char const * portName)
 {
-    long supportingImplIdx = getSupportingImplIdx(portName);
-    if (supportingImplIdx == STARIO_ERROR_NOT_AVAILABLE)
+    pthread_rwlock_rdlock(&handlesLock);
+
+    StarIOHandle * handle = findHandleLocked(portName);
+
+    pthread_rwlock_unlock(&handlesLock);
+
+    return handle;
+}
+
+// takes the handle's port lock
+// returns STARIO_ERROR_NOT_OPEN, without the lock, if the handle is not bound to a port
+static long lockHandle(StarIOHandle * handle)
+{
+    if (handle == NULL)
     {
-        return STARIO_ERROR_NOT_AVAILABLE;
+        return STARIO_ERROR_NOT_OPEN;
     }
 
-    if (impls[supportingImplIdx].openPort == 0)
+    pthread_mutex_lock(&handle->lock);
+
+    if (handle->port == NULL)
+    {
+        pthread_mutex_unlock(&handle->lock);
+
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    return STARIO_ERROR_SUCCESS;
+}
+
+// error returned by the string api for a portName without an open handle
+static long getNoHandleError(char const * portName)
+{
+    if (regFindImpl(portName) == NULL)
     {
         return STARIO_ERROR_NOT_AVAILABLE;
     }
 
-    return impls[supportingImplIdx].openPort(portName, portSettings);
+    return STARIO_ERROR_NOT_OPEN;
 }
 
-long writePort (char const * portName, char const * writeBuffer, long length)
+// takes the port lock of the handle open under portName
+// the slot is checked again once locked - a concurrent close and open may have
+// handed it to another port since findHandle returned it
+static long lockNamedHandle(char const * portName, StarIOHandle ** handle)
+{
+    *handle = NULL;
+
+    int attempt = 0;
+    for (; attempt < MAX_NUM_HANDLES; attempt++)
+    {
+        StarIOHandle * found = findHandle(portName);
+        if (found == NULL)
+        {
+            return getNoHandleError(portName);
+        }
+
+        pthread_mutex_lock(&found->lock);
+        pthread_rwlock_rdlock(&handlesLock);
+
+        unsigned char same = ((found->set != 0) && (strcmp(found->portName, portName) == 0))?1:0;
+
+        pthread_rwlock_unlock(&handlesLock);
+
+        if (same != 0)
+        {
+            *handle = found;
+
+            return STARIO_ERROR_SUCCESS;
+        }
+
+        pthread_mutex_unlock(&found->lock);
+    }
+
+    return STARIO_ERROR_NOT_OPEN;
+}
+
+// handle api
+
+long openPortHandle (char const * portName, char const * portSettings, StarIOHandle ** handle)
 {
-    long supportingImplIdx = getSupportingImplIdx(portName);
-    if (supportingImplIdx == STARIO_ERROR_NOT_AVAILABLE)
+    *handle = NULL;
+
+    PortImpl * supportingImpl = regFindImpl(portName);
+    if (supportingImpl == NULL)
+    {
+        return STARIO_ERROR_NOT_AVAILABLE;
+    }
+
+    if (supportingImpl->openPort == 0)
     {
         return STARIO_ERROR_NOT_AVAILABLE;
     }
 
-    if (impls[supportingImplIdx].writePort == 0)
+    if (strlen(portName) >= sizeof(handles[0].portName))
     {
         return STARIO_ERROR_NOT_AVAILABLE;
     }
 
-    return impls[supportingImplIdx].writePort(portName, writeBuffer, length);
+    void * port = NULL;
+
+    long result = supportingImpl->openPort(portName, portSettings, &port);
+    if (result != STARIO_ERROR_SUCCESS)
+    {
+        return result;
+    }
+
+    pthread_rwlock_wrlock(&handlesLock);
+
+    StarIOHandle * portHandle = findHandleLocked(portName);
+    if (portHandle == NULL)
+    {
+        int i = 0;
+        for (; i < MAX_NUM_HANDLES; i++)
+        {
+            if (handles[i].set == 0)
+                break;
+        }
+        if (i == MAX_NUM_HANDLES)
+        {
+            pthread_rwlock_unlock(&handlesLock);
+
+            supportingImpl->closePort(port);
+
+            return STARIO_ERROR_NOT_OPEN;
+        }
+
+        portHandle = &handles[i];
+
+        portHandle->set = 1;
+        portHandle->impl = NULL;
+        portHandle->port = NULL;
+
+        cbInitPipeline(portHandle);
+        swInitWatch(portHandle);
+        swInitCache(portHandle);
+
+        strcpy(portHandle->portName, portName);
+    }
+
+    pthread_rwlock_unlock(&handlesLock);
+
+    // a backend may have re-used the port structure of a port it closed
+    // itself (i.e. stuck usb transfers) - handles still bound to it are stale
+    int i = 0;
+    for (; i < MAX_NUM_HANDLES; i++)
+    {
+        if (&handles[i] == portHandle)
+        {
+            continue;
+        }
+
+        pthread_rwlock_rdlock(&handlesLock);
+        unsigned char stale = (handles[i].port == port)?1:0;
+        pthread_rwlock_unlock(&handlesLock);
+
+        if (stale == 0)
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&handles[i].lock);
+        pthread_rwlock_wrlock(&handlesLock);
+
+        if (handles[i].port == port)
+        {
+            handles[i].port = NULL;
+        }
+
+        pthread_rwlock_unlock(&handlesLock);
+        pthread_mutex_unlock(&handles[i].lock);
+    }
+
+    pthread_mutex_lock(&portHandle->lock);
+    pthread_rwlock_wrlock(&handlesLock);
+
+    // a concurrent closePortHandle may have released the slot in the meantime
+    portHandle->set = 1;
+    strcpy(portHandle->portName, portName);
+
+    portHandle->impl = supportingImpl;
+    portHandle->port = port;
+
+    pthread_rwlock_unlock(&handlesLock);
+    pthread_mutex_unlock(&portHandle->lock);
+
+    *handle = portHandle;
+
+    return STARIO_ERROR_SUCCESS;
 }
 
-long readPort (char const * portName, char * readBuffer, long length)
+long writePortHandle (StarIOHandle * handle, char const * writeBuffer, long length)
 {
-    long supportingImplIdx = getSupportingImplIdx(portName);
-    if (supportingImplIdx == STARIO_ERROR_NOT_AVAILABLE)
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
     {
-        return STARIO_ERROR_NOT_AVAILABLE;
+        return lockResult;
+    }
+
+    long result = STARIO_ERROR_NOT_AVAILABLE;
+
+    if (handle->impl->writePort != 0)
+    {
+        result = handle->impl->writePort(handle->port, writeBuffer, length);
+    }
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long flushPortHandle (StarIOHandle * handle)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = STARIO_ERROR_SUCCESS;
+
+    // implementations without output buffering complete writes synchronously
+    if (handle->impl->flushPort != 0)
+    {
+        result = handle->impl->flushPort(handle->port);
+    }
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long readPortHandle (StarIOHandle * handle, char * readBuffer, long length)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = STARIO_ERROR_NOT_AVAILABLE;
+
+    if (handle->impl->readPort != 0)
+    {
+        result = handle->impl->readPort(handle->port, readBuffer, length);
+    }
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long getStarPrinterStatusHandle (StarIOHandle * handle, StarPrinterStatus * status)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
     }
 
-    if (impls[supportingImplIdx].readPort == 0)
+    long result = STARIO_ERROR_NOT_AVAILABLE;
+
+    if (handle->impl->getStarPrinterStatus != 0)
+    {
+        result = swReadStatus(handle, status);
+    }
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+// called with the handle's lock held
+static long getCachedStatusLocked(StarIOHandle * handle, StarPrinterStatus * status, long reads, long maxAgeMillis)
+{
+    if (handle->impl->getStarPrinterStatus == 0)
     {
         return STARIO_ERROR_NOT_AVAILABLE;
     }
 
-    return impls[supportingImplIdx].readPort(portName, readBuffer, length);
+    return swGetCachedStatus(handle, status, reads, maxAgeMillis);
+}
+
+long getStarPrinterStatusCachedHandle (StarIOHandle * handle, StarPrinterStatus * status, long maxAgeMillis)
+{
+    long result = STARIO_ERROR_SUCCESS;
+    long reads = 0;
+
+    // a read in progress is shared without waiting for the port
+    if ((handle != NULL) && (swShareStatus(handle, status, maxAgeMillis, &result, &reads) != 0))
+    {
+        return result;
+    }
+
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    result = getCachedStatusLocked(handle, status, reads, maxAgeMillis);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long beginCheckedBlockHandle (StarIOHandle * handle)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = STARIO_ERROR_NOT_AVAILABLE;
+
+    if (handle->impl->beginCheckedBlock != 0)
+    {
+        result = handle->impl->beginCheckedBlock(handle->port);
+    }
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long endCheckedBlockHandle (StarIOHandle * handle, StarPrinterStatus * status)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = STARIO_ERROR_NOT_AVAILABLE;
+
+    if (handle->impl->endCheckedBlock != 0)
+    {
+        result = handle->impl->endCheckedBlock(handle->port, status);
+    }
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long hdwrResetDeviceHandle (StarIOHandle * handle)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = STARIO_ERROR_NOT_AVAILABLE;
+
+    if (handle->impl->hdwrResetDevice != 0)
+    {
+        result = handle->impl->hdwrResetDevice(handle->port);
+    }
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long doVisualCardCmdHandle (StarIOHandle * handle, VisualCardCmd * request, long timeoutMillis)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = STARIO_ERROR_NOT_AVAILABLE;
+
+    if (handle->impl->doVisualCardCmd != 0)
+    {
+        result = handle->impl->doVisualCardCmd(handle->port, request, timeoutMillis);
+    }
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long beginPipelinedCheckedBlocksHandle (StarIOHandle * handle, long maxOutstanding)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = cbBeginPipelined(handle, maxOutstanding);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long submitCheckedBlockHandle (StarIOHandle * handle, unsigned char * etbCounter)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = cbSubmit(handle, etbCounter);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long getCheckedBlockCompletionsHandle (StarIOHandle * handle, CheckedBlockCompletion * completions, long maxCompletions, long timeoutMillis)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = cbGetCompletions(handle, completions, maxCompletions, timeoutMillis);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long enableCheckedBlockNotifyHandle (StarIOHandle * handle, CheckedBlockCallback callback, void * userData)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = cbEnableNotify(handle, callback, userData);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long disableCheckedBlockNotifyHandle (StarIOHandle * handle)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = cbDisableNotify(handle);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    cbSupervisorSync(handle);
+
+    return result;
+}
+
+long getCheckedBlockEventFdHandle (StarIOHandle * handle)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = cbGetEventFd(handle);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long subscribeStatusChangesHandle (StarIOHandle * handle, StatusChangeCallback callback, void * userData)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = swSubscribe(handle, callback, userData);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long unsubscribeStatusChangesHandle (StarIOHandle * handle)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = swUnsubscribe(handle);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    cbSupervisorSync(handle);
+
+    return result;
+}
+
+// the handle stays locked for the whole image, so other writes can not
+// land in the middle of the raster job
+long writeRasterImageHandle (StarIOHandle * handle, unsigned char const * gray, long width, long height, long stride,
+                             RasterOptions const * options)
+{
+    long lockResult = lockHandle(handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = STARIO_ERROR_NOT_AVAILABLE;
+
+    if (handle->impl->writePort != 0)
+    {
+        result = rasterWriteImage(gray, width, height, stride, options, handle->impl->writePort, handle->port);
+    }
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+// called with the handle's lock held
+static long closePortLocked(StarIOHandle * handle)
+{
+    if (handle->set == 0)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    long result = STARIO_ERROR_NOT_OPEN;
+
+    if ((handle->port != NULL) && (handle->impl->closePort != 0))
+    {
+        result = handle->impl->closePort(handle->port);
+    }
+
+    pthread_rwlock_wrlock(&handlesLock);
+
+    handle->set = 0;
+    handle->portName[0] = 0;
+    handle->impl = NULL;
+    handle->port = NULL;
+
+    pthread_rwlock_unlock(&handlesLock);
+
+    cbDisableNotify(handle);
+    cbInitPipeline(handle);
+    swUnsubscribe(handle);
+    swInitCache(handle);
+
+    return result;
+}
+
+long closePortHandle (StarIOHandle * handle)
+{
+    if (handle == NULL)
+    {
+        return STARIO_ERROR_NOT_OPEN;
+    }
+
+    pthread_mutex_lock(&handle->lock);
+
+    long result = closePortLocked(handle);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    cbSupervisorSync(handle);
+
+    return result;
+}
+
+// portName api - resolves the port's handle and dispatches through it
+
+long openPort (char const * portName, char const * portSettings)
+{
+    StarIOHandle * handle = NULL;
+
+    return openPortHandle(portName, portSettings, &handle);
+}
+
+long writePort (char const * portName, char const * writeBuffer, long length)
+{
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = writePortHandle(handle, writeBuffer, length);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long flushPort (char const * portName)
+{
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = flushPortHandle(handle);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long readPort (char const * portName, char * readBuffer, long length)
+{
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = readPortHandle(handle, readBuffer, length);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
 }
 
 long getStarPrinterStatus (const char * portName, StarPrinterStatus * status)
 {
-    long supportingImplIdx = getSupportingImplIdx(portName);
-    if (supportingImplIdx == STARIO_ERROR_NOT_AVAILABLE)
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
     {
-        return STARIO_ERROR_NOT_AVAILABLE;
+        return lockResult;
+    }
+
+    long result = getStarPrinterStatusHandle(handle, status);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long getStarPrinterStatusCached (const char * portName, StarPrinterStatus * status, long maxAgeMillis)
+{
+    long result = STARIO_ERROR_SUCCESS;
+    long reads = 0;
+
+    // a read in progress is shared without waiting for the port; the table
+    // lock keeps the handle open under portName meanwhile
+    pthread_rwlock_rdlock(&handlesLock);
+
+    StarIOHandle * handle = findHandleLocked(portName);
+
+    int shared = ((handle != NULL) && (swShareStatus(handle, status, maxAgeMillis, &result, &reads) != 0));
+
+    pthread_rwlock_unlock(&handlesLock);
+
+    if (shared != 0)
+    {
+        return result;
     }
 
-    if (impls[supportingImplIdx].getStarPrinterStatus == 0)
+    StarIOHandle * seenHandle = handle;
+
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
     {
-        return STARIO_ERROR_NOT_AVAILABLE;
+        return lockResult;
     }
 
-    return impls[supportingImplIdx].getStarPrinterStatus(portName, status);
+    // the port was reopened under another handle meanwhile
+    if (handle != seenHandle)
+    {
+        reads = -1;
+    }
+
+    result = getCachedStatusLocked(handle, status, reads, maxAgeMillis);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
 }
 
 long beginCheckedBlock (char const * portName)
 {
-    long supportingImplIdx = getSupportingImplIdx(portName);
-    if (supportingImplIdx == STARIO_ERROR_NOT_AVAILABLE)
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
     {
-        return STARIO_ERROR_NOT_AVAILABLE;
+        return lockResult;
     }
 
-    if (impls[supportingImplIdx].beginCheckedBlock == 0)
+    long result = beginCheckedBlockHandle(handle);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long endCheckedBlock (char const * portName, StarPrinterStatus * status)
+{
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
     {
-        return STARIO_ERROR_NOT_AVAILABLE;
+        return lockResult;
     }
 
-    return impls[supportingImplIdx].beginCheckedBlock(portName);
+    long result = endCheckedBlockHandle(handle, status);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
 }
 
-long endCheckedBlock (char const * portName, StarPrinterStatus * status)
+long hdwrResetDevice (char const * portName)
 {
-    long supportingImplIdx = getSupportingImplIdx(portName);
-    if (supportingImplIdx == STARIO_ERROR_NOT_AVAILABLE)
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
     {
-        return STARIO_ERROR_NOT_AVAILABLE;
+        return lockResult;
     }
 
-    if (impls[supportingImplIdx].endCheckedBlock == 0)
+    long result = hdwrResetDeviceHandle(handle);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long doVisualCardCmd (char const * portName, VisualCardCmd * request, long timeoutMillis)
+{
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
     {
-        return STARIO_ERROR_NOT_AVAILABLE;
+        return lockResult;
     }
 
-    return impls[supportingImplIdx].endCheckedBlock(portName, status);
+    long result = doVisualCardCmdHandle(handle, request, timeoutMillis);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
 }
 
-long hdwrResetDevice (char const * portName)
+long beginPipelinedCheckedBlocks (char const * portName, long maxOutstanding)
 {
-    long supportingImplIdx = getSupportingImplIdx(portName);
-    if (supportingImplIdx == STARIO_ERROR_NOT_AVAILABLE)
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
     {
-        return STARIO_ERROR_NOT_AVAILABLE;
+        return lockResult;
     }
 
-    if (impls[supportingImplIdx].hdwrResetDevice == 0)
+    long result = beginPipelinedCheckedBlocksHandle(handle, maxOutstanding);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long submitCheckedBlock (char const * portName, unsigned char * etbCounter)
+{
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
     {
-        return STARIO_ERROR_NOT_AVAILABLE;
+        return lockResult;
     }
 
-    return impls[supportingImplIdx].hdwrResetDevice(portName);
+    long result = submitCheckedBlockHandle(handle, etbCounter);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
 }
 
-long doVisualCardCmd (char const * portName, VisualCardCmd * request, long timeoutMillis)
+long getCheckedBlockCompletions (char const * portName, CheckedBlockCompletion * completions, long maxCompletions, long timeoutMillis)
 {
-    long supportingImplIdx = getSupportingImplIdx(portName);
-    if (supportingImplIdx == STARIO_ERROR_NOT_AVAILABLE)
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
     {
-        return STARIO_ERROR_NOT_AVAILABLE;
+        return lockResult;
+    }
+
+    long result = getCheckedBlockCompletionsHandle(handle, completions, maxCompletions, timeoutMillis);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long enableCheckedBlockNotify (char const * portName, CheckedBlockCallback callback, void * userData)
+{
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
     }
 
-    if (impls[supportingImplIdx].doVisualCardCmd == 0)
+    long result = enableCheckedBlockNotifyHandle(handle, callback, userData);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long disableCheckedBlockNotify (char const * portName)
+{
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
     {
-        return STARIO_ERROR_NOT_AVAILABLE;
+        return lockResult;
     }
 
-    return impls[supportingImplIdx].doVisualCardCmd(portName, request, timeoutMillis);
+    long result = cbDisableNotify(handle);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    cbSupervisorSync(handle);
+
+    return result;
 }
 
-long closePort (char const * portName)
+long getCheckedBlockEventFd (char const * portName)
 {
-    long supportingImplIdx = getSupportingImplIdx(portName);
-    if (supportingImplIdx == STARIO_ERROR_NOT_AVAILABLE)
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
     {
-        return STARIO_ERROR_NOT_AVAILABLE;
+        return lockResult;
     }
 
-    if (impls[supportingImplIdx].closePort == 0)
+    long result = getCheckedBlockEventFdHandle(handle);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long subscribeStatusChanges (char const * portName, StatusChangeCallback callback, void * userData)
+{
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
     {
-        return STARIO_ERROR_NOT_AVAILABLE;
+        return lockResult;
     }
 
-    return impls[supportingImplIdx].closePort(portName);
+    long result = subscribeStatusChangesHandle(handle, callback, userData);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long unsubscribeStatusChanges (char const * portName)
+{
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = swUnsubscribe(handle);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    cbSupervisorSync(handle);
+
+    return result;
+}
+
+long writeRasterImage (char const * portName, unsigned char const * gray, long width, long height, long stride,
+                       RasterOptions const * options)
+{
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = writeRasterImageHandle(handle, gray, width, height, stride, options);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    return result;
+}
+
+long closePort (char const * portName)
+{
+    StarIOHandle * handle = NULL;
+    long lockResult = lockNamedHandle(portName, &handle);
+    if (lockResult != STARIO_ERROR_SUCCESS)
+    {
+        return lockResult;
+    }
+
+    long result = closePortLocked(handle);
+
+    pthread_mutex_unlock(&handle->lock);
+
+    cbSupervisorSync(handle);
+
+    return result;
 }
 
@@ -39,6 +39,12 @@
 extern "C" {
 #endif
 
+// threading
+//
+// All functions may be called from any thread.  Calls on one port are
+// serialised - a second call waits for the first to return - while calls on
+// different ports run in parallel.
+
 // general api - both printers and Visual Card
 
 /*
@@ -46,8 +52,8 @@ extern "C" {
     --------
     This function opens a connection to the port specified.
 
-    Parameters: portName - string of the form "usb:TSP700;sn:12345678", or "/dev/ttyS0", or "/dev/parport0" (usb, serial, and parallel respectively)
-                portSettings - string of the form "", or "9600,none,8,1,hdwr", or "" (respective to portName parameter)
+    Parameters: portName - string of the form "usb:TSP700;sn:12345678", or "/dev/ttyS0", or "/dev/parport0", or "tcp:192.168.1.50:9100" (usb, serial, parallel, and network respectively)
+                portSettings - string of the form "" or "auto" or "16384", or "9600,none,8,1,hdwr", or "", or "" or "nodelay=0,sndbuf=262144,status=9101" (respective to portName parameter)
     Returns:    STARIO_ERROR_SUCCESS
                     or
     Errors:     STARIO_ERROR_NOT_OPEN - device not present, wrong serial number, libusb failure
@@ -56,13 +62,53 @@ extern "C" {
                 will succeed only when the specified device type configured
                 with the specified serial number is present on a USB bus.
 
+                Also in the case of USB, the portSettings string selects the
+                bulk transfer size: "" for the default of 4096 bytes, a size
+                in bytes (64 ~ 65536, a multiple of 64), or "auto" to let the
+                library grow the size while throughput improves and shrink it
+                when the device stalls.
+
+                A USB port stays open when its device is unplugged.  Calls
+                return STARIO_ERROR_NOT_OPEN while the device is absent, and
+                the port rebinds to it as soon as it is plugged back in; a
+                write interrupted by the unplug waits up to 2 seconds for the
+                device and then resumes.  closePort is still required.
+
                 In the case of serial, the portSettings string contains the
                 following fields:
-                    baud: 38400, 19200, 9600, 4800, 2400
+                    baud: 300 ~ 4000000 (i.e. 230400, 115200, 57600, 38400, 19200, 9600)
+                          rates without a standard termios constant are
+                          programmed directly where the driver supports it
                     parity: none, even, odd
                     data-bits: 8, 7
                     stop-bits: 1
                     flow-ctrl: none, hdwr
+                    asb: optional - present ("9600,none,8,1,hdwr,asb") if the
+                         device is set up to send ASB on every change of state
+
+                In the case of network, the portName is "tcp:" followed by a
+                host name or address (IPv6 addresses in brackets) and
+                optionally ":port", 9100 by default.  The portSettings string
+                holds any of the following, comma separated:
+                    nodelay=1 or 0: TCP_NODELAY on the data connection (default 1)
+                    sndbuf=bytes: socket send buffer, 0 for the system default (default 1048576)
+                    status=port: port status is requested on, 0 for the data connection (default 9101),
+                        where the response is picked out of the data readPort returns
+
+                A portName of "sim:" followed by any name opens an in-process
+                printer simulator, for benchmarking and testing without a
+                device.  Its portSettings string holds any of the following,
+                comma separated:
+                    rate=bytes: line rate per second (default 1000000)
+                    buffer=bytes: receive buffer size (default 16384)
+                    speed=bytes: print speed per second (default 144000)
+                    latency=millis: status and visual card round trip (default 1)
+                    etb=0: simulate a device without an ETB counter; otherwise
+                        every 0x17 byte written counts as an ETB, as the
+                        simulator does not parse commands or raster data
+                    card=ack, nak, dle or none: visual card response (default ack)
+                    asb=millis:state/...: status changes after open, the states
+                        being online, cover, paper, nearend and error
 */
 long openPort (char const * portName, char const * portSettings);
 
@@ -71,7 +117,8 @@ long openPort (char const * portName, char const * portSettings);
     ---------
     This function closes the device connection - no further communications
     are possible via this connection.  Call openPort to re-establish a
-    connection
+    connection.  As with disableCheckedBlockNotify and
+    unsubscribeStatusChanges, no callback for the port runs once it returns.
 
     Parameters: portName - string of the form "usb:TSP700", or ...
     Returns:    STARIO_ERROR_SUCCESS
@@ -99,6 +146,23 @@ long closePort (char const * portName);
 */
 long writePort (char const * portName, char const * writeBuffer, long length);
 
+/*
+    flushPort
+    ---------
+    This function waits until all data passed to writePort has been
+    transmitted to the device.  In the case of serial, writePort returns
+    as soon as its data is queued for transmission so that consecutive
+    writes stream without gaps; call flushPort where the data must have
+    left the host (checked blocks and status reads do this internally).
+
+    Parameters: portName - string of the form "usb:TSP700", or ...
+    Returns:    STARIO_ERROR_SUCCESS
+                    or
+    Errors:     STARIO_ERROR_NOT_OPEN - device not opened or no longer present
+                STARIO_ERROR_IO_FAIL - data could not be transmitted before timing out
+*/
+long flushPort (char const * portName);
+
 /*
     readPort
     --------
@@ -127,9 +191,39 @@ long readPort (char const * portName, char * readBuffer, long length);
                     or
     Errors:     STARIO_ERROR_NOT_OPEN - device not opened or no longer present
                 STARIO_ERROR_IO_FAIL - communications problem
+    Notes:      On serial ports opened with "asb" in portSettings, ASB the
+                device sends unsolicited (i.e. on a change of state) is
+                separated from the data returned by readPort, though not from
+                a Visual Card response.  This function then returns the last
+                ASB received without a request, costing no round trip; it
+                sends a status request only until the first ASB arrives.
 */
 long getStarPrinterStatus (const char * portName, StarPrinterStatus * status);
 
+/*
+    getStarPrinterStatusCached
+    --------------------------
+    This function returns the port's most recently read status if it is no
+    older than maxAgeMillis, and reads the status as getStarPrinterStatus
+    does otherwise.  Every status read made by the library on the port
+    refreshes the cache, including those of getStarPrinterStatus, pipelined
+    checked blocks and status change subscriptions.
+
+    Callers that ask while another thread's read of the same port is in
+    progress share its result, failure included, whatever their
+    maxAgeMillis, and do not wait for the port's other i/o to do so; a
+    burst of requests costs one read.
+
+    Parameters: portName - string of the form "usb:TSP700", or ...
+                status - pointer to a StarPrinterStatus structure
+                maxAgeMillis - oldest cached status acceptable, 0 to share in-progress reads only
+    Returns:    STARIO_ERROR_SUCCESS
+                    or
+    Errors:     STARIO_ERROR_NOT_OPEN - device not opened or no longer present
+                STARIO_ERROR_IO_FAIL - communications problem
+*/
+long getStarPrinterStatusCached (const char * portName, StarPrinterStatus * status, long maxAgeMillis);
+
 /*
     beginCheckedBlock
     -----------------
@@ -184,6 +278,183 @@ long hdwrResetDevice (char const * portName);
 
 
 
+// pipelined checked block api
+
+/*
+    beginPipelinedCheckedBlocks
+    ---------------------------
+    This function starts pipelined checked block mode.  Unlike endCheckedBlock,
+    which waits for each block to print before the next can be written, up to
+    maxOutstanding blocks may be in the device at once; each is tagged with the
+    ETB counter value the device will report once it has printed.
+
+    Usage: call beginPipelinedCheckedBlocks once, then for each job write its
+    data and call submitCheckedBlock; collect results with
+    getCheckedBlockCompletions.
+
+    Parameters: portName - string of the form "usb:TSP700", or ...
+                maxOutstanding - 1 ~ 31 blocks submitted and not yet printed
+    Returns:    STARIO_ERROR_SUCCESS
+                    or
+    Errors:     STARIO_ERROR_NOT_OPEN - device not opened or no longer present
+                STARIO_ERROR_IO_FAIL - communications problem
+                STARIO_ERROR_NOT_AVAILABLE - printer unable to support checked
+                                             block functionality (no ETB counter),
+                                             or maxOutstanding out of range
+    Notes:      Calling this function again discards outstanding blocks and
+                unreported completions.
+*/
+long beginPipelinedCheckedBlocks (char const * portName, long maxOutstanding);
+
+/*
+    submitCheckedBlock
+    ------------------
+    This function ends the block written since the previous submission by
+    outputting a single ETB byte, without waiting for it to print.  When
+    maxOutstanding blocks are already outstanding, it first waits for the
+    oldest one to complete.
+
+    Parameters: portName - string of the form "usb:TSP700", or ...
+                etbCounter - receives the 0 ~ 31 tag of the submitted block
+    Returns:    STARIO_ERROR_SUCCESS
+                    or
+    Errors:     STARIO_ERROR_NOT_OPEN - device not opened or no longer present
+                STARIO_ERROR_IO_FAIL - communications problem, or the oldest
+                                       block did not complete in several times
+                                       the recent print time per block (10
+                                       seconds at least); nothing is submitted
+                STARIO_ERROR_NOT_AVAILABLE - beginPipelinedCheckedBlocks not called
+*/
+long submitCheckedBlock (char const * portName, unsigned char * etbCounter);
+
+/*
+    getCheckedBlockCompletions
+    --------------------------
+    This function reports blocks completed since the last call, oldest first.
+    If none are pending and blocks are outstanding, it reads device status
+    until one completes or timeoutMillis passes (0 checks once).  If the device
+    goes offline, every outstanding block is reported failed and the device
+    is hardware reset, as with endCheckedBlock.
+
+    Parameters: portName - string of the form "usb:TSP700", or ...
+                completions - array receiving the completions
+                maxCompletions - size of the completions array
+                timeoutMillis - longest time to wait for a completion
+    Returns:    number of completions reported (0 or more)
+                    or
+    Errors:     STARIO_ERROR_NOT_OPEN - device not opened or no longer present
+                STARIO_ERROR_IO_FAIL - communications problem
+                STARIO_ERROR_NOT_AVAILABLE - beginPipelinedCheckedBlocks not called
+    Notes:      At most 31 completions are held; if more go unreported the
+                oldest are dropped.
+*/
+long getCheckedBlockCompletions (char const * portName, CheckedBlockCompletion * completions, long maxCompletions, long timeoutMillis);
+
+/*
+    enableCheckedBlockNotify
+    ------------------------
+    This function makes pipelined checked block completion asynchronous.  A
+    library thread reads the status of every port with notification enabled,
+    so submitCheckedBlock becomes a non-blocking endCheckedBlock and no
+    application thread has to wait per printer.
+
+    Completions are delivered one of two ways:
+    1. callback set - the callback is invoked from the library thread for
+       each completion, oldest first
+    2. callback NULL - completions are queued as usual and the descriptor
+       returned by getCheckedBlockEventFd becomes readable; read it (8 bytes)
+       and collect them with getCheckedBlockCompletions and a timeout of 0
+
+    Parameters: portName - string of the form "usb:TSP700", or ...
+                callback - function receiving completions, or NULL
+                userData - passed to callback unchanged
+    Returns:    STARIO_ERROR_SUCCESS
+                    or
+    Errors:     STARIO_ERROR_NOT_OPEN - device not opened or no longer present
+                STARIO_ERROR_RUNTIME - thread or eventfd could not be created
+    Notes:      Notification stays enabled across beginPipelinedCheckedBlocks
+                and ends with disableCheckedBlockNotify or closePort.
+*/
+long enableCheckedBlockNotify (char const * portName, CheckedBlockCallback callback, void * userData);
+
+/*
+    disableCheckedBlockNotify
+    -------------------------
+    This function stops asynchronous completion for the port and closes its
+    event descriptor.  Later completions are reported by
+    getCheckedBlockCompletions only.  Once it returns, the callback is not
+    running and is not called again, so its userData may be freed; called
+    from within the callback itself, it does not wait for the callback.
+
+    Parameters: portName - string of the form "usb:TSP700", or ...
+    Returns:    STARIO_ERROR_SUCCESS
+                    or
+    Errors:     STARIO_ERROR_NOT_OPEN - device not opened or no longer present
+*/
+long disableCheckedBlockNotify (char const * portName);
+
+/*
+    getCheckedBlockEventFd
+    ----------------------
+    This function returns the eventfd descriptor signalled for each queued
+    completion, suitable for poll, select or epoll.  The descriptor belongs
+    to the library and must not be closed by the application.
+
+    Parameters: portName - string of the form "usb:TSP700", or ...
+    Returns:    descriptor (0 or more)
+                    or
+    Errors:     STARIO_ERROR_NOT_OPEN - device not opened or no longer present
+                STARIO_ERROR_NOT_AVAILABLE - notification not enabled
+*/
+long getCheckedBlockEventFd (char const * portName);
+
+/*
+    subscribeStatusChanges
+    ----------------------
+    This function asks the library to watch the device status and report
+    only changes, in place of the application polling getStarPrinterStatus
+    and comparing every field.  A library thread reads the status of each
+    subscribed port every 100 milliseconds while it is changing, backing off
+    to every 400 milliseconds while it holds steady, and invokes the callback
+    when the statusWord differs from the last one reported.  When the status
+    can not be read, the callback receives an offline status with the
+    STARIO_STATUS_READ_FAILED bit set, once until a read succeeds again.
+
+    The callback receives a mask of the statusWord bits that changed (test
+    them with STARIO_STATUS_BIT) and the new status.  The first report after
+    subscribing carries the full status with every mask bit set.  Status
+    byte 13, which is not part of the statusWord, does not trigger a report.
+
+    Parameters: portName - string of the form "usb:TSP700", or ...
+                callback - function receiving status changes
+                userData - passed to callback unchanged
+    Returns:    STARIO_ERROR_SUCCESS
+                    or
+    Errors:     STARIO_ERROR_NOT_OPEN - device not opened or no longer present
+                STARIO_ERROR_NOT_AVAILABLE - callback NULL, or the device has no status
+                STARIO_ERROR_RUNTIME - thread could not be created
+    Notes:      A new subscription replaces the previous one.  The subscription
+                ends with unsubscribeStatusChanges or closePort.
+*/
+long subscribeStatusChanges (char const * portName, StatusChangeCallback callback, void * userData);
+
+/*
+    unsubscribeStatusChanges
+    ------------------------
+    This function stops status change reporting for the port.  Once it
+    returns, the callback is not running and is not called again, so its
+    userData may be freed; called from within the callback itself, it does
+    not wait for the callback.
+
+    Parameters: portName - string of the form "usb:TSP700", or ...
+    Returns:    STARIO_ERROR_SUCCESS
+                    or
+    Errors:     STARIO_ERROR_NOT_OPEN - device not opened or no longer present
+*/
+long unsubscribeStatusChanges (char const * portName);
+
+
+
 
 // visual card api
 
@@ -207,6 +478,147 @@ long hdwrResetDevice (char const * portName);
 */
 long doVisualCardCmd (char const * portName, VisualCardCmd * request, long timeoutMillis);
 
+
+
+// handle api
+
+/*
+    openPortHandle
+    --------------
+    This function opens a connection to the port specified, as openPort does,
+    and returns a handle bound to that port.  The supporting implementation and
+    port are resolved once here, so functions taking the handle dispatch
+    directly without looking up the portName string on every call.
+
+    Parameters: portName - string of the form "usb:TSP700;sn:12345678", or "/dev/ttyS0", or "/dev/parport0", or "tcp:192.168.1.50:9100" (usb, serial, parallel, and network respectively)
+                portSettings - string of the form "" or "auto" or "16384", or "9600,none,8,1,hdwr", or "", or "" or "nodelay=0,sndbuf=262144,status=9101" (respective to portName parameter)
+                handle - pointer receiving the port handle (NULL on failure)
+    Returns:    STARIO_ERROR_SUCCESS
+                    or
+    Errors:     STARIO_ERROR_NOT_OPEN - device not present, wrong serial number, libusb failure
+                STARIO_ERROR_NOT_AVAILABLE - portName or portSettings not supported
+    Notes:      Opening an already open portName returns the existing handle.
+                The string based api and the handle api may be mixed freely;
+                closePort closes the handle of that portName as well.
+*/
+long openPortHandle (char const * portName, char const * portSettings, StarIOHandle ** handle);
+
+/*
+    closePortHandle
+    ---------------
+    This function closes the port bound to the handle.  The handle must
+    not be used after this call.
+
+    Parameters: handle - handle returned by openPortHandle
+    Returns:    STARIO_ERROR_SUCCESS
+                    or
+    Errors:     STARIO_ERROR_NOT_OPEN - handle not open or device no longer present
+*/
+long closePortHandle (StarIOHandle * handle);
+
+/*
+    Handle variants of the printer and visual card api
+    --------------------------------------------------
+    These functions behave exactly as the functions of the same name without
+    the "Handle" suffix, taking the handle returned by openPortHandle in place
+    of the portName string.  When the device has been closed by the library
+    (i.e. usb device removed) they return STARIO_ERROR_NOT_OPEN until the port
+    is opened again.
+*/
+long writePortHandle (StarIOHandle * handle, char const * writeBuffer, long length);
+long flushPortHandle (StarIOHandle * handle);
+long readPortHandle (StarIOHandle * handle, char * readBuffer, long length);
+long getStarPrinterStatusHandle (StarIOHandle * handle, StarPrinterStatus * status);
+long getStarPrinterStatusCachedHandle (StarIOHandle * handle, StarPrinterStatus * status, long maxAgeMillis);
+long beginCheckedBlockHandle (StarIOHandle * handle);
+long endCheckedBlockHandle (StarIOHandle * handle, StarPrinterStatus * status);
+long hdwrResetDeviceHandle (StarIOHandle * handle);
+long doVisualCardCmdHandle (StarIOHandle * handle, VisualCardCmd * request, long timeoutMillis);
+long beginPipelinedCheckedBlocksHandle (StarIOHandle * handle, long maxOutstanding);
+long submitCheckedBlockHandle (StarIOHandle * handle, unsigned char * etbCounter);
+long getCheckedBlockCompletionsHandle (StarIOHandle * handle, CheckedBlockCompletion * completions, long maxCompletions, long timeoutMillis);
+long enableCheckedBlockNotifyHandle (StarIOHandle * handle, CheckedBlockCallback callback, void * userData);
+long disableCheckedBlockNotifyHandle (StarIOHandle * handle);
+long getCheckedBlockEventFdHandle (StarIOHandle * handle);
+long subscribeStatusChangesHandle (StarIOHandle * handle, StatusChangeCallback callback, void * userData);
+long unsubscribeStatusChangesHandle (StarIOHandle * handle);
+
+
+
+// raster api
+
+/*
+    buildRasterJob
+    --------------
+    This function converts a grayscale image into a complete Star raster
+    graphics job - raster mode entry, one 'b' data command per image line,
+    raster mode exit and, optionally, a feed and cut - ready to be sent with
+    writePort.  Each line is packed to 1 bit per pixel with the SSE2, AVX2 or
+    NEON compare instructions where the library was built for them.  Gray
+    images may be dithered on the way (see StarIODither); dithering works a
+    line at a time straight into the job, keeping only the error of the
+    next two lines.
+
+    Parameters: gray - image pixels, 1 byte per pixel, 0 (black) ~ 255 (white)
+                width - image width in pixels (dots)
+                height - image height in pixels (lines)
+                stride - bytes from the start of one image line to the next, at least width
+                options - pointer to a RasterOptions structure, or NULL for a threshold of 128, no dithering, compact, with a cut
+                job - buffer receiving the commands, or NULL to query the length required
+                jobLength - size of the job buffer in bytes
+    Returns:    length of the job in bytes
+                    or
+    Errors:     STARIO_ERROR_NOT_AVAILABLE - invalid image dimensions or dither, or the job buffer is too small
+                STARIO_ERROR_RUNTIME - out of memory for error diffusion
+    Notes:      Lines wider than the device's printable area are clipped by
+                the device.  Pixels past width in the last byte of a line
+                print white.
+
+                With RasterOptions.compact, the length returned for a NULL
+                job is an upper bound; the length returned once the job is
+                built is exact.  Receipts are mostly white, so compact jobs
+                are typically several times smaller, and print sooner over
+                slow links.
+*/
+long buildRasterJob (unsigned char const * gray, long width, long height, long stride,
+                     RasterOptions const * options, unsigned char * job, long jobLength);
+
+/*
+    writeRasterImage
+    ----------------
+    This function converts a grayscale image into a Star raster graphics job,
+    as buildRasterJob does, and writes it to the device while it is being
+    converted.  The job is produced in bands of about 16 kilobytes into a ring
+    of 4 bands; a library thread converts the bands ahead while earlier
+    bands are written, so the device starts printing after the first band
+    and memory use does not depend on the image height.
+
+    Parameters: portName - string of the form "usb:TSP700", or ...
+                gray, width, height, stride, options - the image and conversion, as for buildRasterJob
+    Returns:    STARIO_ERROR_SUCCESS - the whole job was written
+                    or
+    Errors:     STARIO_ERROR_NOT_OPEN - device not opened or no longer present
+                STARIO_ERROR_IO_FAIL - communications problem, the job was not written completely
+                STARIO_ERROR_NOT_AVAILABLE - invalid image dimensions or dither
+                STARIO_ERROR_RUNTIME - out of memory, or the conversion thread could not be started
+    Notes:      No other call can write to the port until this function
+                returns.  Within a checked block, a failure leaves part of
+                the job in the device - reset it with hdwrResetDevice.
+
+                On machines with more than one processor, images taller than
+                about 64 kilobytes of job are split into horizontal stripes
+                converted by up to 4 library threads and written in order.
+                Error diffused images taller than 64 lines are not striped, as
+                each line depends on the one above it; instead up to 4 library
+                threads diffuse a line each, every line kept just behind the
+                one above it.  The job written is the same as buildRasterJob
+                produces, whatever the number of processors.
+*/
+long writeRasterImage (char const * portName, unsigned char const * gray, long width, long height, long stride,
+                       RasterOptions const * options);
+long writeRasterImageHandle (StarIOHandle * handle, unsigned char const * gray, long width, long height, long stride,
+                             RasterOptions const * options);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,146 @@
+// testraster.c
+
+// this program checks that writeRasterImage writes the same raster job as
+// buildRasterJob, for every dither and however many stripe or error
+// diffusion workers encode it
+
+// usage: testraster
+
+// to compile this file, execute the following command (see make check)
+// gcc -Wall -o testraster testraster.c stario-raster.o -lpthread
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stario.h"
+#include "stario-raster.h"
+
+typedef struct
+{
+    unsigned char * job;
+    long length;
+    long capacity;
+} Capture;
+
+// a RasterWriteFn appending to a Capture
+long captureWrite(void * port, char const * writeBuffer, long length)
+{
+    Capture * capture = (Capture *) port;
+
+    if (capture->length + length > capture->capacity)
+    {
+        return STARIO_ERROR_IO_FAIL;
+    }
+
+    memcpy(capture->job + capture->length, writeBuffer, length);
+    capture->length += length;
+
+    return length;
+}
+
+// gradients and noise, with blank bands so compact jobs skip lines
+void makeImage(unsigned char * gray, long width, long height, long stride)
+{
+    unsigned int seed = 1;
+
+    long y = 0;
+    for (; y < height; y++)
+    {
+        long x = 0;
+        for (; x < width; x++)
+        {
+            seed = seed * 1103515245 + 12345;
+
+            int value = (int) ((x * 255) / width + (y % 97) - 48 + (int) ((seed >> 16) % 33) - 16);
+
+            if (((y / 150) % 5 == 4) || ((y >= 5000) && (y < 7000)))
+            {
+                value = 255;
+            }
+
+            gray[y * stride + x] = (unsigned char) ((value < 0)?0:(value > 255)?255:value);
+        }
+    }
+}
+
+long checkImage(long width, long height)
+{
+    static char const * const ditherNames[] = {"none", "ordered", "floyd-steinberg", "atkinson"};
+
+    long stride = width + 3;
+    long failures = 0;
+
+    unsigned char * gray = (unsigned char *) malloc(stride * height);
+
+    makeImage(gray, width, height, stride);
+
+    int dither = STARIO_DITHER_NONE;
+    for (; dither <= STARIO_DITHER_ATKINSON; dither++)
+    {
+        int compact = 0;
+        for (; compact < 2; compact++)
+        {
+            RasterOptions options = {128, 1, (StarIODither) dither, (unsigned char) compact};
+
+            long jobLength = buildRasterJob(gray, width, height, stride, &options, NULL, 0);
+
+            Capture single = {(unsigned char *) malloc(jobLength), 0, jobLength};
+
+            single.length = buildRasterJob(gray, width, height, stride, &options, single.job, jobLength);
+
+            long numWorkers = 1;
+            for (; numWorkers <= 4; numWorkers++)
+            {
+                Capture striped = {(unsigned char *) malloc(jobLength), 0, jobLength};
+
+                long result = rasterWriteImageWorkers(gray, width, height, stride, &options, numWorkers, captureWrite, &striped);
+
+                if ((result != STARIO_ERROR_SUCCESS) ||
+                    (striped.length != single.length) ||
+                    (memcmp(striped.job, single.job, single.length) != 0))
+                {
+                    printf("FAILED %ldx%ld %s%s with %ld workers: result %ld, %ld bytes against %ld\n",
+                           width, height, ditherNames[dither], (compact)?" compact":"", numWorkers,
+                           result, striped.length, single.length);
+
+                    failures++;
+                }
+
+                free(striped.job);
+            }
+
+            free(single.job);
+        }
+    }
+
+    free(gray);
+
+    return failures;
+}
+
+int main(int argc, char * argv[])
+{
+    long failures = 0;
+
+    // several stripes of wide lines, and of narrow ones
+    failures += checkImage(576, 3000);
+    failures += checkImage(60, 20000);
+
+    // lines ending part way through a diffusion span and a byte
+    failures += checkImage(1001, 400);
+
+    // a single stripe
+    failures += checkImage(200, 10);
+
+    if (failures != 0)
+    {
+        printf("%ld raster checks failed\n", failures);
+
+        return 1;
+    }
+
+    printf("raster checks passed\n");
+
+    return 0;
+}
@@ -0,0 +1,219 @@
+// testsim.c
+
+// this program checks checked blocks, pipelined checked blocks, status
+// changes and visual card commands against the "sim:" printer simulator
+
+// usage: testsim
+
+// to compile this file, execute the following command (see make check)
+// gcc -Wall -o testsim testsim.c -Lbin -lstario
+
+#include <stdio.h>
+#include <string.h>
+
+#include "stario.h"
+
+long failures = 0;
+
+void check(char const * what, long ok)
+{
+    if (!ok)
+    {
+        printf("FAILED %s\n", what);
+
+        failures++;
+    }
+}
+
+// a block of data holding no 0x17 bytes
+long writeBlock(char const * portName, long length)
+{
+    char block[1000];
+
+    memset(block, 'x', sizeof(block));
+
+    long totalWriteLength = 0;
+
+    while (totalWriteLength < length)
+    {
+        long writeLength = length - totalWriteLength;
+
+        if (writeLength > sizeof(block))
+        {
+            writeLength = sizeof(block);
+        }
+
+        long result = writePort(portName, block, writeLength);
+
+        if (result <= 0)
+        {
+            return result;
+        }
+
+        totalWriteLength += result;
+    }
+
+    return totalWriteLength;
+}
+
+// endCheckedBlock returns once the ETB counter has advanced past the block,
+// and an ETB inside a longer write is counted too
+void checkEndCheckedBlock()
+{
+    char const * portName = "sim:checkedblock";
+    StarPrinterStatus status;
+
+    check("checked block open", openPort(portName, "") == STARIO_ERROR_SUCCESS);
+    check("checked block begin", beginCheckedBlock(portName) == STARIO_ERROR_SUCCESS);
+    check("checked block status", getStarPrinterStatus(portName, &status) == STARIO_ERROR_SUCCESS);
+
+    unsigned char etbCounter = status.etbCounter;
+
+    check("checked block write", writeBlock(portName, 5000) == 5000);
+    check("checked block end", endCheckedBlock(portName, &status) == STARIO_ERROR_SUCCESS);
+    check("checked block online", status.offline == 0);
+    check("checked block etb advance", status.etbCounter == (etbCounter + 1) % 32);
+
+    char const etbWithin[] = {'a', 0x17, 'b', 0x17, 'c'};
+
+    check("etb within a write", writePort(portName, etbWithin, sizeof(etbWithin)) == sizeof(etbWithin));
+    check("checked block begin again", beginCheckedBlock(portName) == STARIO_ERROR_SUCCESS);
+    check("checked block end again", endCheckedBlock(portName, &status) == STARIO_ERROR_SUCCESS);
+    check("etbs within a write counted", status.etbCounter == (etbCounter + 4) % 32);
+
+    closePort(portName);
+}
+
+// blocks submitted back to back complete in order, each with its own tag
+void checkPipelined()
+{
+    char const * portName = "sim:pipelined";
+    unsigned char tags[3];
+
+    check("pipelined open", openPort(portName, "speed=200000") == STARIO_ERROR_SUCCESS);
+    check("pipelined begin", beginPipelinedCheckedBlocks(portName, 2) == STARIO_ERROR_SUCCESS);
+
+    long i = 0;
+    for (; i < 3; i++)
+    {
+        check("pipelined write", writeBlock(portName, 20000) == 20000);
+        check("pipelined submit", submitCheckedBlock(portName, &tags[i]) == STARIO_ERROR_SUCCESS);
+    }
+
+    check("pipelined tags", (tags[1] == (tags[0] + 1) % 32) && (tags[2] == (tags[1] + 1) % 32));
+
+    long numCompletions = 0;
+    long attempt = 0;
+
+    for (; (numCompletions < 3) && (attempt < 20); attempt++)
+    {
+        CheckedBlockCompletion completions[3];
+
+        long result = getCheckedBlockCompletions(portName, completions, 3 - numCompletions, 500);
+
+        if (result < 0)
+        {
+            check("pipelined completions", 0);
+
+            break;
+        }
+
+        long j = 0;
+        for (; j < result; j++, numCompletions++)
+        {
+            check("pipelined completion order", completions[j].etbCounter == tags[numCompletions]);
+            check("pipelined completion printed", completions[j].failed == 0);
+        }
+    }
+
+    check("pipelined all completed", numCompletions == 3);
+
+    closePort(portName);
+}
+
+// the cover opening part way through a block takes the device offline, which
+// endCheckedBlock and a pipelined completion both report
+void checkOffline()
+{
+    char const * portName = "sim:offline";
+    StarPrinterStatus status;
+
+    check("offline open", openPort(portName, "speed=10000,asb=200:cover") == STARIO_ERROR_SUCCESS);
+    check("offline begin", beginCheckedBlock(portName) == STARIO_ERROR_SUCCESS);
+    check("offline write", writeBlock(portName, 5000) == 5000);
+    check("offline end", endCheckedBlock(portName, &status) == STARIO_ERROR_SUCCESS);
+    check("offline reported", (status.offline == 1) && (status.coverOpen == 1));
+
+    closePort(portName);
+
+    portName = "sim:offlinepipelined";
+
+    CheckedBlockCompletion completion;
+
+    check("offline pipelined open", openPort(portName, "speed=10000,asb=200:cover") == STARIO_ERROR_SUCCESS);
+    check("offline pipelined begin", beginPipelinedCheckedBlocks(portName, 4) == STARIO_ERROR_SUCCESS);
+    check("offline pipelined write", writeBlock(portName, 5000) == 5000);
+    check("offline pipelined submit", submitCheckedBlock(portName, &completion.etbCounter) == STARIO_ERROR_SUCCESS);
+    check("offline pipelined completion", getCheckedBlockCompletions(portName, &completion, 1, 2000) == 1);
+    check("offline pipelined failed", (completion.failed == 1) && (completion.status.offline == 1));
+
+    closePort(portName);
+}
+
+// each "card=" reply comes back as doVisualCardCmd's result
+void checkVisualCard()
+{
+    static char const * const settings[] = {"card=ack", "card=nak", "card=dle"};
+    static long const results[] = {STARIO_ERROR_SUCCESS, STARIO_ERROR_NAK, STARIO_ERROR_DLE};
+
+    char const * portName = "sim:card";
+
+    long i = 0;
+    for (; i < 3; i++)
+    {
+        VisualCardCmd request;
+
+        memset(&request, 0x00, sizeof(request));
+        request.command = 0x20;
+        request.txData = "card";
+        request.txDataLength = 4;
+
+        check("visual card open", openPort(portName, settings[i]) == STARIO_ERROR_SUCCESS);
+
+        long result = doVisualCardCmd(portName, &request, 100);
+
+        if (result != results[i])
+        {
+            printf("FAILED visual card %s: result %ld\n", settings[i], result);
+
+            failures++;
+        }
+
+        if (results[i] == STARIO_ERROR_SUCCESS)
+        {
+            check("visual card response", (request.status == 0) && (request.rxDataLength == 4) &&
+                                          (memcmp(request.rxData, "card", 4) == 0));
+        }
+
+        closePort(portName);
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    checkEndCheckedBlock();
+    checkPipelined();
+    checkOffline();
+    checkVisualCard();
+
+    if (failures != 0)
+    {
+        printf("%ld simulator checks failed\n", failures);
+
+        return 1;
+    }
+
+    printf("simulator checks passed\n");
+
+    return 0;
+}
@@ -73,6 +73,7 @@ void dispStatus(StarPrinterStatus status)
     printf("\tstatus.etbAvailable = %d\n",              status.etbAvailable);
     printf("\tstatus.etbCounter = %d\n",                status.etbCounter);
     printf("\tstatus.presenterState = %d\n",            status.presenterState);
+    printf("\tstatus.statusWord = 0x%016llx\n",         status.statusWord);
 }
 
 int main(int argc, char ** argv)
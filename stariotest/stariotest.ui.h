@@ -326,91 +326,28 @@ void StarIOTest::pushButton_PrintImage_clicked()
         return;
     }
 
-    int cmdLength = 0;
-    if (width % 8)
-    {
-        cmdLength = (4 + 4 + 6 + 6 + (3 + width / 8 + 1) * height + 4) + 3;
-    }
-    else
-    {
-        cmdLength = (4 + 4 + 6 + 6 + (3 + width / 8) * height + 4) + 3;
-    }
-
-    unsigned char * cmd = new unsigned char [cmdLength];
-    if (cmd == NULL)
+    unsigned char * gray = new unsigned char [width * height];
+    if (gray == NULL)
     {
         ProcessErrorResult(this, "new []", STARIO_ERROR_RUNTIME);
 
         return;
     }
 
-    memset(cmd, 0x00, cmdLength);
-
-    int cmdIdx = 0;
-
-    cmd [ cmdIdx++ ] = 0x1b;
-    cmd [ cmdIdx++ ] = '*';
-    cmd [ cmdIdx++ ] = 'r';
-    cmd [ cmdIdx++ ] = 'R';
-
-    cmd [ cmdIdx++ ] = 0x1b;
-    cmd [ cmdIdx++ ] = '*';
-    cmd [ cmdIdx++ ] = 'r';
-    cmd [ cmdIdx++ ] = 'A';
-
-    cmd [ cmdIdx++ ] = 0x1b;
-    cmd [ cmdIdx++ ] = '*';
-    cmd [ cmdIdx++ ] = 'r';
-    cmd [ cmdIdx++ ] = 'E';
-    cmd [ cmdIdx++ ] = '1';
-    cmd [ cmdIdx++ ] = 0x00;
-
-    cmd [ cmdIdx++ ] = 0x1b;
-    cmd [ cmdIdx++ ] = '*';
-    cmd [ cmdIdx++ ] = 'r';
-    cmd [ cmdIdx++ ] = 'P';
-    cmd [ cmdIdx++ ] = '0';
-    cmd [ cmdIdx++ ] = 0x00;
-
-    for	(int y = 0; y < height; y++)
+    for (int y = 0; y < height; y++)
     {
-        if (width % 8)
-        {
-            cmd [ cmdIdx++ ] = 'b';
-            cmd [ cmdIdx++ ] = (unsigned char) ((width / 8 + 1) % 0x0100);
-            cmd [ cmdIdx++ ] = (unsigned char) ((width / 8 + 1) / 0x0100);
-        }
-        else
+        for (int x = 0; x < width; x++)
         {
-            cmd [ cmdIdx++ ] = 'b';
-            cmd [ cmdIdx++ ] = (unsigned char) ((width / 8) % 0x0100);
-            cmd [ cmdIdx++ ] = (unsigned char) ((width / 8) / 0x0100);
-        }
-
-        for	(int x = 0; x < width; x += 8, cmdIdx++)
-        {
-            switch (width -	x)
-            {
-                default:    if (qGray(image.pixel(x + 7, y)) == 0) cmd [ cmdIdx ] |= 0x01;
-                case 7:     if (qGray(image.pixel(x + 6, y)) == 0) cmd [ cmdIdx ] |= 0x02;
-                case 6:     if (qGray(image.pixel(x + 5, y)) == 0) cmd [ cmdIdx ] |= 0x04;
-                case 5:     if (qGray(image.pixel(x + 4, y)) == 0) cmd [ cmdIdx ] |= 0x08;
-                case 4:     if (qGray(image.pixel(x + 3, y)) == 0) cmd [ cmdIdx ] |= 0x10;
-                case 3:     if (qGray(image.pixel(x + 2, y)) == 0) cmd [ cmdIdx ] |= 0x20;
-                case 2:     if (qGray(image.pixel(x + 1, y)) == 0) cmd [ cmdIdx ] |= 0x40;
-                case 1:     if (qGray(image.pixel(x + 0, y)) == 0) cmd [ cmdIdx ] |= 0x80;
-            }
+            gray [ y * width + x ] = (unsigned char) qGray(image.pixel(x, y));
         }
     }
 
-    cmd [ cmdIdx++ ] = 0x1b;
-    cmd [ cmdIdx++ ] = '*';
-    cmd [ cmdIdx++ ] = 'r';
-    cmd [ cmdIdx++ ] = 'B';
-
-    cmd [ cmdIdx++ ] = 0x1b;
-    cmd [ cmdIdx++ ] = 'd';
-    cmd [ cmdIdx++ ] = '3';
+    // only pure black prints, as the bitmap is already 1 bit per pixel
+    RasterOptions options;
+    options.threshold = 1;
+    options.cut = 1;
+    options.dither = STARIO_DITHER_NONE;
+    options.compact = 1;
 
     long res = STARIO_ERROR_SUCCESS;
 
@@ -420,24 +357,22 @@ void StarIOTest::pushButton_PrintImage_clicked()
 
         if (res != STARIO_ERROR_SUCCESS)
         {
-            delete [] cmd;
+            delete [] gray;
 
             ProcessErrorResult(this, "beginCheckedBlock", res);
             return;
         }
     }
 
-    res = writePort(textEdit_PortName->text().ascii(), (char const *) cmd, (long) cmdLength);
+    // the library converts and sends the image a band at a time
+    res = writeRasterImage(textEdit_PortName->text().ascii(), gray, width, height, width, &options);
 
-    delete [] cmd;
+    delete [] gray;
 
-    if (res < STARIO_ERROR_SUCCESS)
+    if (res != STARIO_ERROR_SUCCESS)
     {
-        ProcessErrorResult(this, "writePort", res);
-    }
+        ProcessErrorResult(this, "writeRasterImage", res);
 
-    if (res < (long) cmdLength)
-    {
         if (ShowMsg(this, "Could not send all data.\nExecute hardware reset?", QMessageBox::Yes, QMessageBox::No) == QMessageBox::Yes)
         {
             pushButton_HdwrReset_clicked();